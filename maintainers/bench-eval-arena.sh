@@ -0,0 +1,46 @@
+#!/usr/bin/env bash
+
+# Compare the wall time and peak RSS of evaluations with and without the
+# evaluation arena (the `eval-arena` setting).
+#
+# Usage: maintainers/bench-eval-arena.sh [NIXPKGS] [RUNS]
+#
+# NIXPKGS defaults to `<nixpkgs>`. Set NIX to the `nix` binary to test, and
+# TIME to GNU time if it's not in /usr/bin.
+
+set -euo pipefail
+
+nixpkgs=${1:-$(nix-instantiate --find-file nixpkgs)}
+runs=${2:-3}
+nix=${NIX:-nix}
+
+timeCmd=${TIME:-/usr/bin/time}
+if ! [[ -x $timeCmd ]]; then
+    echo "bench-eval-arena.sh: GNU time not found, set TIME to its path" >&2
+    exit 1
+fi
+
+workloads=(
+    "hello:(import $nixpkgs { }).hello.drvPath"
+    "firefox:(import $nixpkgs { }).firefox.drvPath"
+    "nixos:(import $nixpkgs/nixos { configuration = { fileSystems.\"/\".device = \"x\"; boot.loader.grub.enable = false; }; }).system.drvPath"
+)
+
+printf '%-12s %-8s %10s %12s\n' workload arena 'time (s)' 'max RSS (MiB)'
+
+for workload in "${workloads[@]}"; do
+    name=${workload%%:*}
+    expr=${workload#*:}
+    for arena in false true; do
+        for ((i = 0; i < runs; i++)); do
+            stats=$(
+                "$timeCmd" -f '%e %M' \
+                    "$nix" eval --raw --impure --no-eval-cache \
+                    --option eval-arena "$arena" \
+                    --expr "$expr" 2>&1 >/dev/null | tail -n1
+            )
+            read -r secs kib <<<"$stats"
+            printf '%-12s %-8s %10s %12d\n' "$name" "$arena" "$secs" $((kib / 1024))
+        done
+    done
+done
@@ -4,7 +4,7 @@
 
 namespace nix {
 
-std::string fetchBuildLog(ref<Store> store, const StorePath & path, std::string_view what)
+std::string fetchBuildLog(ref<Store> store, const StorePath & path, std::string_view what, std::optional<size_t> tail)
 {
     auto subs = getDefaultSubstituters();
 
@@ -18,7 +18,7 @@ std::string fetchBuildLog(ref<Store> store, const StorePath & path, std::string_
         }
         auto & logSub = *logSubP;
 
-        auto log = logSub.getBuildLog(path);
+        auto log = tail ? logSub.getBuildLogTail(path, *tail) : logSub.getBuildLog(path);
         if (!log)
             continue;
         printInfo("got build log for '%s' from '%s'", what, logSub.config.getHumanReadableURI());
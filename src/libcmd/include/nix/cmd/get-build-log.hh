@@ -3,6 +3,7 @@
 
 #include "nix/store/store-api.hh"
 
+#include <optional>
 #include <string>
 #include <string_view>
 
@@ -15,9 +16,11 @@ namespace nix {
  * @param store The store to search (and its substituters).
  * @param path The store path to get the build log for.
  * @param what A description of what we're fetching the log for (used in messages).
+ * @param tail If set, only fetch the last this many lines of the log.
  * @return The build log content.
  * @throws Error if the build log is not available.
  */
-std::string fetchBuildLog(ref<Store> store, const StorePath & path, std::string_view what);
+std::string fetchBuildLog(
+    ref<Store> store, const StorePath & path, std::string_view what, std::optional<size_t> tail = std::nullopt);
 
 } // namespace nix
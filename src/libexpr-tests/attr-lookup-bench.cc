@@ -0,0 +1,88 @@
+#include <benchmark/benchmark.h>
+
+#include "nix/expr/eval.hh"
+#include "nix/expr/eval-settings.hh"
+#include "nix/fetchers/fetch-settings.hh"
+#include "nix/store/store-open.hh"
+#include "nix/util/fmt.hh"
+
+namespace nix {
+namespace {
+
+struct AttrLookupEnv
+{
+    ref<Store> store = openStore("dummy://");
+    fetchers::Settings fetchSettings{};
+    bool readOnlyMode = true;
+    EvalSettings evalSettings{readOnlyMode};
+    std::shared_ptr<EvalState> statePtr;
+    EvalState & state;
+
+    Bindings * bindings = nullptr;
+
+    /**
+     * The names to look up: the even ones are in `bindings`, the odd
+     * ones aren't.
+     */
+    std::vector<Symbol> names;
+
+    explicit AttrLookupEnv(size_t attrCount)
+        : evalSettings([&]() {
+            EvalSettings settings{readOnlyMode};
+            settings.nixPath = {};
+            return settings;
+        }())
+        , statePtr(std::make_shared<EvalState>(LookupPath{}, store, fetchSettings, evalSettings, nullptr))
+        , state(*statePtr)
+    {
+        for (size_t i = 0; i < 2 * attrCount; ++i)
+            names.push_back(state.symbols.create(fmt("pkg%|1$06d|", i)));
+
+        auto attrs = state.buildBindings(attrCount);
+        for (size_t i = 0; i < names.size(); i += 2)
+            attrs.alloc(names[i]).mkInt(i);
+        bindings = attrs.finish();
+    }
+};
+
+} // namespace
+
+static void BM_AttrLookup(benchmark::State & state)
+{
+    const auto attrCount = static_cast<size_t>(state.range(0));
+    AttrLookupEnv env(attrCount);
+
+    for (auto _ : state)
+        for (auto & name : env.names)
+            benchmark::DoNotOptimize(env.bindings->get(name));
+
+    state.SetItemsProcessed(state.iterations() * env.names.size());
+}
+
+BENCHMARK(BM_AttrLookup)->Arg(8)->Arg(64)->Arg(1'000)->Arg(100'000);
+
+/**
+ * Lookups in a large attrset with a small `//` update on top, as in
+ * `pkgs // { foo = ...; }`.
+ */
+static void BM_AttrLookupLayered(benchmark::State & state)
+{
+    const auto attrCount = static_cast<size_t>(state.range(0));
+    AttrLookupEnv env(attrCount);
+
+    auto top = env.state.buildBindings(2);
+    top.alloc(env.names[1]).mkInt(1);
+    top.alloc(env.names[3]).mkInt(3);
+    top.layerOnTopOf(*env.bindings);
+    auto layered = top.finish();
+
+    for (auto _ : state)
+        for (auto & name : env.names)
+            benchmark::DoNotOptimize(layered->get(name));
+
+    state.SetItemsProcessed(state.iterations() * env.names.size());
+}
+
+BENCHMARK(BM_AttrLookupLayered)->Arg(1'000)->Arg(100'000);
+
+} // namespace nix
@@ -2,6 +2,7 @@
 #include <gtest/gtest.h>
 
 #include "nix/expr/eval.hh"
+#include "nix/expr/function-memo.hh"
 #include "nix/expr/tests/libexpr.hh"
 
 namespace nix {
@@ -174,6 +175,71 @@ TEST_F(EvalStateTest, getBuiltin_fail)
     ASSERT_THROW(state.getBuiltin("nonexistent"), EvalError);
 }
 
+TEST_F(EvalStateTest, largeAttrsLookup)
+{
+    std::vector<Symbol> names;
+    for (size_t i = 0; i < 2'000; ++i)
+        names.push_back(state.symbols.create(fmt("a%d", i)));
+
+    /* Only every other name is present. */
+    auto attrs = state.buildBindings(names.size() / 2);
+    for (size_t i = 0; i < names.size(); i += 2)
+        attrs.alloc(names[i]).mkInt(i);
+    auto bindings = attrs.finish();
+
+    /* Look up often enough for the lookup index to be built. */
+    for (int round = 0; round < 3; ++round)
+        for (size_t i = 0; i < names.size(); ++i) {
+            auto attr = bindings->get(names[i]);
+            if (i % 2) {
+                ASSERT_EQ(attr, nullptr);
+            } else {
+                ASSERT_NE(attr, nullptr);
+                ASSERT_EQ(attr->name, names[i]);
+                ASSERT_EQ(attr->value->integer().value, (NixInt::Inner) i);
+            }
+        }
+
+    /* Lookups also use the index of a base layer. */
+    auto top = state.buildBindings(2);
+    top.alloc(names[1]).mkInt(-1);
+    top.alloc(names[2]).mkInt(-2);
+    top.layerOnTopOf(*bindings);
+    auto layered = top.finish();
+    ASSERT_EQ(layered->size(), bindings->size() + 1);
+    for (size_t i = 0; i < names.size(); ++i) {
+        auto attr = layered->get(names[i]);
+        if (i == 1 || i == 2)
+            ASSERT_EQ(attr->value->integer().value, -(NixInt::Inner) i);
+        else
+            ASSERT_EQ(attr != nullptr, i % 2 == 0);
+    }
+}
+
+TEST_F(EvalStateTest, largeAttrsLookupAfterPushBack)
+{
+    std::vector<Symbol> names;
+    for (size_t i = 0; i < 200; ++i)
+        names.push_back(state.symbols.create(fmt("b%d", i)));
+
+    /* Like the `builtins` attrset, which is extended after creation. */
+    auto & bindings = *state.mem.allocBindings(names.size());
+    for (size_t i = 0; i < names.size() - 1; ++i)
+        bindings.push_back(Attr(names[i], &state.getBuiltin("true")));
+    bindings.sort();
+
+    for (int round = 0; round < 3; ++round)
+        for (auto & name : names)
+            ASSERT_EQ(bindings.get(name) != nullptr, name != names.back());
+
+    bindings.push_back(Attr(names.back(), &state.getBuiltin("true")));
+    bindings.sort();
+
+    for (int round = 0; round < 3; ++round)
+        for (auto & name : names)
+            ASSERT_NE(bindings.get(name), nullptr);
+}
+
 class PureEvalTest : public LibExprTest
 {
 public:
@@ -211,4 +277,73 @@ TEST_F(PureEvalTest, pathExists)
     }
 }
 
+class FunctionMemoTest : public LibExprTest
+{
+public:
+    FunctionMemoTest()
+        : LibExprTest(openStore("dummy://"), [](bool & readOnlyMode) {
+            EvalSettings settings{readOnlyMode};
+            settings.nixPath = {};
+            settings.memoizeFunctions = true;
+            settings.memoizeThreshold = 1;
+            return settings;
+        })
+    {
+    }
+
+    FunctionMemo::LambdaStats getStats(std::string_view name)
+    {
+        for (auto & [fun, stats] : state.functionMemo->getStats())
+            if (fun->name && std::string_view(state.symbols[fun->name]) == name)
+                return stats;
+        return {};
+    }
+};
+
+TEST_F(FunctionMemoTest, repeatedCalls)
+{
+    auto v = eval("let f = x: x + 1; in builtins.foldl' (acc: i: acc + f 3) 0 (builtins.genList (i: i) 10)");
+    ASSERT_THAT(v, IsIntEq(40));
+
+    auto stats = getStats("f");
+    EXPECT_EQ(stats.lookups, 10);
+    EXPECT_EQ(stats.hits, 9);
+    EXPECT_EQ(stats.entries, 1);
+}
+
+TEST_F(FunctionMemoTest, differentArguments)
+{
+    auto v = eval(R"(let f = s: s + "!"; in f "a" + f "b" + f "a" + f "a${"b"}")");
+    ASSERT_THAT(v, IsStringEq("a!b!a!ab!"));
+}
+
+TEST_F(FunctionMemoTest, differentClosures)
+{
+    auto v = eval("let mk = a: x: x + a; f = mk 1; g = mk 2; in f 0 * 100 + g 0 * 10 + f 0");
+    ASSERT_THAT(v, IsIntEq(121));
+}
+
+TEST_F(FunctionMemoTest, attrsComparedByValue)
+{
+    auto v = eval("let f = { a, b }: a + b; in f { a = 1; b = 2; } * 100 + f { a = 1; b = 2; } * 10 + f { a = 1; b = 3; }");
+    ASSERT_THAT(v, IsIntEq(334));
+
+    auto stats = getStats("f");
+    EXPECT_EQ(stats.lookups, 3);
+    EXPECT_EQ(stats.hits, 1);
+}
+
+TEST_F(FunctionMemoTest, thunksComparedByIdentity)
+{
+    /* The argument of `f` is the same expression in a different
+       environment each time. (The last call of the lambda passed to
+       `map` is a hit, so `f` is only called three times.) */
+    auto v = eval("let f = x: x; xs = [ 10 20 30 ]; in toString (map (i: f (builtins.elemAt xs i)) [ 0 1 2 0 ])");
+    ASSERT_THAT(v, IsStringEq("10 20 30 10"));
+
+    auto stats = getStats("f");
+    EXPECT_EQ(stats.lookups, 3);
+    EXPECT_EQ(stats.hits, 0);
+}
+
 } // namespace nix
@@ -0,0 +1,83 @@
+#include <benchmark/benchmark.h>
+
+#include "nix/expr/eval.hh"
+#include "nix/expr/eval-settings.hh"
+#include "nix/fetchers/fetch-settings.hh"
+#include "nix/store/store-open.hh"
+#include "nix/util/fmt.hh"
+
+namespace nix {
+
+/**
+ * Evaluate `expr` (a function taking a size parameter) to a value,
+ * then deeply force it, as `nix eval --json` and `builtins.deepSeq` do.
+ */
+static void runForceValueDeepBench(benchmark::State & state, std::string_view expr)
+{
+    const auto size = static_cast<size_t>(state.range(0));
+    const auto exprStr = fmt("(%s) %d", expr, size);
+
+    for (auto _ : state) {
+        state.PauseTiming();
+
+        auto store = openStore("dummy://");
+        fetchers::Settings fetchSettings{};
+        bool readOnlyMode = true;
+        EvalSettings evalSettings{readOnlyMode};
+        evalSettings.nixPath = {};
+
+        auto stPtr = std::make_shared<EvalState>(LookupPath{}, store, fetchSettings, evalSettings, nullptr);
+        auto & st = *stPtr;
+        Expr * e = st.parseExprFromString(exprStr, st.rootPath(CanonPath::root));
+
+        Value v;
+        st.eval(e, v);
+
+        state.ResumeTiming();
+
+        st.forceValueDeep(v);
+        benchmark::DoNotOptimize(v);
+    }
+
+    state.SetItemsProcessed(state.iterations() * size);
+}
+
+/**
+ * A wide attribute set of small attribute sets and lists, like a
+ * package set or a NixOS option tree.
+ */
+static void BM_ForceValueDeepWide(benchmark::State & state)
+{
+    runForceValueDeepBench(state, R"(n:
+      builtins.listToAttrs (builtins.genList (i: {
+        name = "attr${toString i}";
+        value = { inherit i; s = "value ${toString i}"; l = [ i (i + 1) { x = i; } ]; };
+      }) n))");
+}
+
+BENCHMARK(BM_ForceValueDeepWide)->Arg(1'000)->Arg(10'000)->Arg(100'000);
+
+/**
+ * A deeply nested chain of attribute sets and lists.
+ */
+static void BM_ForceValueDeepNested(benchmark::State & state)
+{
+    runForceValueDeepBench(state, R"(n:
+      builtins.foldl' (acc: i: { inherit i; next = [ acc ]; }) null (builtins.genList (i: i) n))");
+}
+
+BENCHMARK(BM_ForceValueDeepNested)->Arg(1'000)->Arg(4'000);
+
+/**
+ * Many references to the same values, which are only forced once.
+ */
+static void BM_ForceValueDeepShared(benchmark::State & state)
+{
+    runForceValueDeepBench(state, R"(n:
+      let shared = builtins.genList (i: { inherit i; }) 100; in
+      builtins.genList (i: { inherit i shared; }) n)");
+}
+
+BENCHMARK(BM_ForceValueDeepShared)->Arg(1'000)->Arg(10'000);
+
+} // namespace nix
@@ -139,6 +139,37 @@ TEST_F(PrimOpTest, deepSeq)
     ASSERT_THROW(eval("let x = { z =  throw \"test\"; }; in builtins.deepSeq x { }"), ThrownError);
 }
 
+TEST_F(PrimOpTest, deepSeqNested)
+{
+    auto v = eval(
+        "let x = builtins.foldl' (acc: i: { inherit i; next = [ acc ]; }) null (builtins.genList (i: i) 3000); "
+        "in builtins.deepSeq x 1");
+    ASSERT_THAT(v, IsIntEq(1));
+}
+
+TEST_F(PrimOpTest, deepSeqInfinite)
+{
+    ASSERT_THROW(eval("let f = n: { inner = f (n + 1); }; in builtins.deepSeq (f 0) 1"), StackOverflowError);
+}
+
+TEST_F(PrimOpTest, deepSeqTraces)
+{
+    try {
+        eval("builtins.deepSeq { a = [ 1 { b = throw \"test\"; } ]; } 1");
+        FAIL() << "expected an error";
+    } catch (ThrownError & e) {
+        std::vector<std::string> traces;
+        for (auto & trace : e.info().traces)
+            traces.push_back(trace.hint.str());
+        auto b = std::ranges::find(traces, HintFmt("while evaluating the attribute '%1%'", "b").str());
+        auto elem = std::ranges::find(traces, HintFmt("while evaluating list element at index %1%", 1).str());
+        auto a = std::ranges::find(traces, HintFmt("while evaluating the attribute '%1%'", "a").str());
+        ASSERT_NE(a, traces.end());
+        ASSERT_LT(b, elem);
+        ASSERT_LT(elem, a);
+    }
+}
+
 TEST_F(PrimOpTest, trace)
 {
     CaptureLogging l;
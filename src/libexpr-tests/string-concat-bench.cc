@@ -0,0 +1,95 @@
+#include <benchmark/benchmark.h>
+
+#include "nix/expr/eval.hh"
+#include "nix/expr/eval-settings.hh"
+#include "nix/fetchers/fetch-settings.hh"
+#include "nix/store/store-open.hh"
+#include "nix/util/fmt.hh"
+
+namespace nix {
+
+/**
+ * Evaluate `expr` (a function taking the number of pieces to
+ * concatenate) and force the resulting string.
+ */
+static void runStringConcatBench(benchmark::State & state, std::string_view expr)
+{
+    const auto pieceCount = static_cast<size_t>(state.range(0));
+    const auto exprStr = fmt("(%s) %d", expr, pieceCount);
+
+    for (auto _ : state) {
+        state.PauseTiming();
+
+        auto store = openStore("dummy://");
+        fetchers::Settings fetchSettings{};
+        bool readOnlyMode = true;
+        EvalSettings evalSettings{readOnlyMode};
+        evalSettings.nixPath = {};
+
+        auto stPtr = std::make_shared<EvalState>(LookupPath{}, store, fetchSettings, evalSettings, nullptr);
+        auto & st = *stPtr;
+        Expr * e = st.parseExprFromString(exprStr, st.rootPath(CanonPath::root));
+
+        Value v;
+
+        state.ResumeTiming();
+
+        st.eval(e, v);
+        st.forceValue(v, noPos);
+        benchmark::DoNotOptimize(v.string_view());
+    }
+
+    state.SetItemsProcessed(state.iterations() * pieceCount);
+}
+
+/**
+ * `lib.foldl'`-style accumulation with `+`.
+ */
+static void BM_StringConcatFold(benchmark::State & state)
+{
+    runStringConcatBench(state, R"(n: builtins.foldl' (acc: i: acc + "piece ${toString i}\n") "" (builtins.genList (i: i) n))");
+}
+
+BENCHMARK(BM_StringConcatFold)->Arg(1'000)->Arg(10'000)->Arg(50'000);
+
+/**
+ * Building a configure flags string by interpolation, as in
+ * `"${flags} --with-${x}"`.
+ */
+static void BM_StringConcatInterpolation(benchmark::State & state)
+{
+    runStringConcatBench(
+        state, R"(n: builtins.foldl' (acc: i: "${acc} --with-feature-${toString i}") "" (builtins.genList (i: i) n))");
+}
+
+BENCHMARK(BM_StringConcatInterpolation)->Arg(1'000)->Arg(10'000)->Arg(50'000);
+
+/**
+ * Strings with context, e.g. a PATH built from store paths.
+ */
+static void BM_StringConcatWithContext(benchmark::State & state)
+{
+    runStringConcatBench(state, R"(n:
+      let
+        bin = i: builtins.appendContext "/nix/store/1rz4g4znpzjwh1xymhjpm42vipw92pr7-pkg${toString (i / 100)}/bin" {
+          "/nix/store/1rz4g4znpzjwh1xymhjpm42vipw92pr7-pkg${toString (i / 100)}" = { path = true; };
+        };
+      in
+        builtins.foldl' (acc: i: acc + ":${bin i}") "" (builtins.genList (i: i) n))");
+}
+
+BENCHMARK(BM_StringConcatWithContext)->Arg(1'000)->Arg(10'000);
+
+/**
+ * The non-quadratic baseline: `lib.concatMapStrings`, which uses
+ * `builtins.concatStringsSep`.
+ */
+static void BM_StringConcatMapStrings(benchmark::State & state)
+{
+    runStringConcatBench(
+        state, R"(n: builtins.concatStringsSep "" (map (i: "piece ${toString i}\n") (builtins.genList (i: i) n)))");
+}
+
+BENCHMARK(BM_StringConcatMapStrings)->Arg(1'000)->Arg(10'000)->Arg(50'000);
+
+} // namespace nix
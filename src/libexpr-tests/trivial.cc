@@ -355,4 +355,85 @@ TEST_F(TrivialExpressionTest, tooManyFormals)
             "too many formal arguments, implementation supports at most 65535")));
 }
 
+TEST_F(TrivialExpressionTest, repeatedConcat)
+{
+    std::string let = R"(
+      let
+        pieces = builtins.genList (i: "${toString i},") 2000;
+        s = builtins.foldl' (acc: x: acc + x) "" pieces;
+      in
+    )";
+    ASSERT_THAT(eval(let + "builtins.stringLength s"), IsIntEq(8890));
+    ASSERT_THAT(eval(let + "s == builtins.concatStringsSep \"\" pieces"), IsTrue());
+    ASSERT_THAT(eval(let + "builtins.substring 0 8 s"), IsStringEq("0,1,2,3,"));
+}
+
+TEST_F(TrivialExpressionTest, smallStringConcat)
+{
+    ASSERT_THAT(eval(R"("a" + "b")"), IsStringEq("ab"));
+    ASSERT_THAT(eval(R"("${"abc"}-${"def"}")"), IsStringEq("abc-def"));
+    ASSERT_THAT(eval(R"("abcd" + "efgh")"), IsStringEq("abcdefgh"));
+    ASSERT_THAT(eval(R"("" + "")"), IsStringEq(""));
+}
+
+TEST_F(TrivialExpressionTest, repeatedConcatOfSmallStrings)
+{
+    auto v = eval(R"(
+      let
+        s = builtins.foldl' (acc: i: acc + toString (builtins.bitAnd i 7)) "" (builtins.genList (i: i) 1000);
+      in
+        builtins.substring 500 10 s
+    )");
+    ASSERT_THAT(v, IsStringEq("4567012345"));
+}
+
+TEST_F(TrivialExpressionTest, repeatedInterpolation)
+{
+    auto v = eval(R"(
+      let
+        s = builtins.foldl' (acc: i: "${acc}--with-feature-${toString i} ") "" (builtins.genList (i: i) 100);
+      in
+        builtins.substring (builtins.stringLength s - 20) 20 s
+    )");
+    ASSERT_THAT(v, IsStringEq("8 --with-feature-99 "));
+}
+
+TEST_F(TrivialExpressionTest, repeatedConcatKeepsContext)
+{
+    std::string let = R"(
+      let
+        withContext = i: builtins.appendContext "" {
+          "/nix/store/1rz4g4znpzjwh1xymhjpm42vipw92pr7-p${toString i}" = { path = true; };
+        };
+        s = builtins.foldl' (acc: i: acc + "${withContext (i / 100)}0123456789") "" (builtins.genList (i: i) 300);
+      in
+    )";
+    ASSERT_THAT(
+        eval(let + "builtins.concatStringsSep \" \" (builtins.attrNames (builtins.getContext s))"),
+        IsStringEq(
+            "/nix/store/1rz4g4znpzjwh1xymhjpm42vipw92pr7-p0 "
+            "/nix/store/1rz4g4znpzjwh1xymhjpm42vipw92pr7-p1 "
+            "/nix/store/1rz4g4znpzjwh1xymhjpm42vipw92pr7-p2"));
+    ASSERT_THAT(eval(let + "builtins.hasContext (builtins.unsafeDiscardStringContext s)"), IsFalse());
+    ASSERT_THAT(eval(let + "builtins.stringLength s"), IsIntEq(3000));
+}
+
+TEST_F(TrivialExpressionTest, concatKeepsContextOfEmptyStrings)
+{
+    /* Like `lib.addContextFrom`, with a result that is long enough to
+       be a rope. */
+    std::string let = R"(
+      let
+        drv = derivation { name = "foo"; builder = "/bin/sh"; system = "x86_64-linux"; };
+        big = builtins.concatStringsSep "" (builtins.genList (i: "0123456789") 30);
+        before = builtins.getContext (builtins.substring 0 0 drv.outPath + big);
+        after = builtins.getContext (big + builtins.substring 0 0 drv.outPath);
+        drvPath = builtins.unsafeDiscardStringContext drv.drvPath;
+      in
+    )";
+    ASSERT_THAT(eval(let + "builtins.attrNames before == [ drvPath ]"), IsTrue());
+    ASSERT_THAT(eval(let + "before.${drvPath}.outputs == [ \"out\" ]"), IsTrue());
+    ASSERT_THAT(eval(let + "builtins.attrNames after == [ drvPath ]"), IsTrue());
+}
+
 } /* namespace nix */
@@ -1,6 +1,7 @@
 #include "nix/expr/value.hh"
 #include "nix/expr/static-string-data.hh"
 
+#include "nix/expr/tests/libexpr.hh"
 #include "nix/store/tests/libstore.hh"
 #include <gtest/gtest.h>
 
@@ -40,4 +41,50 @@ TEST_F(ValueTest, staticString)
     ASSERT_EQ(&sd1, &sd2);
 }
 
+class ValueStringTest : public LibExprTest
+{};
+
+TEST_F(ValueStringTest, smallString)
+{
+    Value v;
+    v.mkString("foo", state.mem);
+
+    ASSERT_EQ(nString, v.type());
+    ASSERT_EQ("foo", v.string_view());
+    ASSERT_STREQ("foo", v.c_str());
+    ASSERT_EQ(v.string_size(), 3u);
+    ASSERT_EQ(nullptr, v.context());
+
+    // Short strings are stored in the value itself
+    if (Value::maxSmallStringSize >= 3)
+        ASSERT_EQ(static_cast<const void *>(&v), &v.string_data());
+
+    // Copies don't refer to the original
+    Value copy = v;
+    v.mkInt(42);
+    ASSERT_EQ("foo", copy.string_view());
+}
+
+TEST_F(ValueStringTest, largeString)
+{
+    std::string s(Value::maxSmallStringSize + 1, 'x');
+    Value v;
+    v.mkString(s, state.mem);
+
+    ASSERT_EQ(s, v.string_view());
+    ASSERT_STREQ(s.c_str(), v.c_str());
+    ASSERT_NE(static_cast<const void *>(&v), &v.string_data());
+}
+
+TEST_F(ValueStringTest, smallStringWithContext)
+{
+    NixStringContext context{NixStringContextElem::parse("g1w7hy3qg1w7hy3qg1w7hy3qg1w7hy3q-x")};
+    Value v;
+    v.mkString("foo", context, state.mem);
+
+    ASSERT_EQ("foo", v.string_view());
+    ASSERT_NE(nullptr, v.context());
+    ASSERT_EQ(v.context()->size(), 1u);
+}
+
 } // namespace nix
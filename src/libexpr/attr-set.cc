@@ -1,7 +1,9 @@
 #include "nix/expr/attr-set.hh"
 #include "nix/expr/eval-inline.hh"
+#include "nix/expr/eval-gc.hh"
 
 #include <algorithm>
+#include <bit>
 
 namespace nix {
 
@@ -18,7 +20,94 @@ Bindings * EvalMemory::allocBindings(size_t capacity)
         throw Error("attribute set of size %d is too big", capacity);
     stats.nrAttrsets++;
     stats.nrAttrsInAttrsets += capacity;
-    return new (allocBytes(sizeof(Bindings) + sizeof(Attr) * capacity)) Bindings();
+    auto size = sizeof(Bindings) + sizeof(Attr) * capacity;
+    if (capacity < Bindings::minIndexedSize || capacity >= (1U << 27)) {
+        recordAllocation(AllocationKind::attrset, size);
+        return new (allocBytes(size)) Bindings();
+    }
+    /* Reserve a word for the index slot. Note that allocBytes() returns
+       zeroed memory, so the slot starts out as "not looked up yet". */
+    size += sizeof(uintptr_t);
+    recordAllocation(AllocationKind::attrset, size);
+    auto bindings = new (allocBytes(size)) Bindings();
+    bindings->hasIndexSlot = 1;
+    bindings->unusedCapacity = capacity;
+    return bindings;
+}
+
+/**
+ * An open-addressing hash table mapping attribute names to their
+ * position in a Bindings layer. It holds no pointers, so the garbage
+ * collector doesn't need to scan it.
+ */
+struct Bindings::Index
+{
+    /**
+     * The table has `1 << (32 - shift)` entries.
+     */
+    uint32_t shift;
+
+    /**
+     * 1 + the position of an attribute, or 0 for an empty entry.
+     */
+    uint32_t entries[0];
+
+    uint32_t hash(Symbol name) const noexcept
+    {
+        /* Fibonacci hashing: symbol IDs are mostly sequential, so
+           spread them using the high bits of the product. */
+        return (name.getId() * UINT32_C(2654435769)) >> shift;
+    }
+};
+
+const Attr * Bindings::getIndexed(Symbol name) const noexcept
+{
+    auto slot = indexSlot();
+    auto state = slot.load(std::memory_order_acquire);
+
+    if (state & 1 || !state) {
+        /* Only build the index once the cost of doing so (linear in
+           the size of the layer) has been made up for by the lookups
+           done so far, to avoid indexing attribute sets that are only
+           looked up a few times. */
+        auto lookups = state >> 1;
+        if (lookups + 1 < numAttrs / 8) {
+            /* Racing increments may get lost, which just delays
+               building the index. */
+            slot.store(((lookups + 1) << 1) | 1, std::memory_order_relaxed);
+            return getInLayer(name);
+        }
+
+        uint32_t shift = 32 - std::bit_width(2 * numAttrs - 1);
+        size_t size = size_t(1) << (32 - shift);
+        auto index = (Index *) GC_MALLOC_ATOMIC(sizeof(Index) + sizeof(uint32_t) * size);
+        if (!index)
+            return getInLayer(name);
+        index->shift = shift;
+        std::fill_n(index->entries, size, 0);
+        for (size_type i = 0; i < numAttrs; ++i) {
+            auto h = index->hash(attrs[i].name);
+            while (index->entries[h])
+                h = (h + 1) & (size - 1);
+            index->entries[h] = i + 1;
+        }
+
+        /* If another thread got there first, use its index; ours will
+           be garbage-collected. */
+        if (slot.compare_exchange_strong(state, (uintptr_t) index, std::memory_order_acq_rel))
+            state = (uintptr_t) index;
+        else if (state & 1 || !state)
+            return getInLayer(name);
+    }
+
+    auto index = (const Index *) state;
+    auto mask = (uint32_t(1) << (32 - index->shift)) - 1;
+    for (auto h = index->hash(name); index->entries[h]; h = (h + 1) & mask) {
+        auto & attr = attrs[index->entries[h] - 1];
+        if (attr.name == name)
+            return &attr;
+    }
+    return nullptr;
 }
 
 Value & BindingsBuilder::alloc(Symbol name, PosIdx pos)
@@ -36,6 +125,8 @@ Value & BindingsBuilder::alloc(std::string_view name, PosIdx pos)
 void Bindings::sort()
 {
     std::sort(attrs, attrs + numAttrs);
+    if (hasIndexSlot)
+        indexSlot().store(0, std::memory_order_relaxed);
 }
 
 Value & Value::mkAttrs(BindingsBuilder & bindings)
@@ -5,6 +5,7 @@
 #include "nix/expr/eval-inline.hh"
 #include "nix/store/store-api.hh"
 #include "nix/store/globals.hh"
+#include "nix/expr/primops.hh"
 // Need specialization involving `SymbolStr` just in this one module.
 #include "nix/util/strings-inline.hh"
 
@@ -32,6 +33,153 @@ void CachedEvalError::force()
         state, "evaluation of cached failed attribute '%s' unexpectedly succeeded", cursor->getAttrPathStr(attr));
 }
 
+static std::string showStat(const std::optional<SourceAccessor::Stat> & st)
+{
+    if (!st)
+        return "missing";
+    switch (st->type) {
+    case SourceAccessor::tRegular:
+        return st->isExecutable ? "executable" : "regular";
+    case SourceAccessor::tDirectory:
+        return "directory";
+    case SourceAccessor::tSymlink:
+        return "symlink";
+    default:
+        return "unknown";
+    }
+}
+
+static std::string hashListing(const SourceAccessor::DirEntries & entries)
+{
+    HashSink sink(HashAlgorithm::SHA256);
+    for (auto & [name, type] : entries)
+        sink(fmt("%s\t%d\n", name, type ? (int) *type : -1));
+    return sink.finish().hash.to_string(HashFormat::Nix32, true);
+}
+
+/**
+ * An accessor that records the accesses to the underlying tree in a
+ * `FileDependencies` log.
+ */
+struct TrackingSourceAccessor : SourceAccessor
+{
+    using Dependency = FileDependencies::Dependency;
+
+    ref<FileDependencies> deps;
+    ref<SourceAccessor> next;
+
+    TrackingSourceAccessor(ref<FileDependencies> deps, ref<SourceAccessor> next)
+        : deps(std::move(deps))
+        , next(std::move(next))
+    {
+        displayPrefix.clear();
+    }
+
+    void readFile(const CanonPath & path, Sink & sink, fun<void(uint64_t)> sizeCallback) override
+    {
+        HashSink hashSink(HashAlgorithm::SHA256);
+        TeeSink tee(sink, hashSink);
+        next->readFile(path, tee, sizeCallback);
+        deps->record(Dependency::Contents, path, hashSink.finish().hash.to_string(HashFormat::Nix32, true));
+    }
+
+    std::optional<Stat> maybeLstat(const CanonPath & path) override
+    {
+        auto st = next->maybeLstat(path);
+        deps->record(Dependency::Stat, path, showStat(st));
+        return st;
+    }
+
+    DirEntries readDirectory(const CanonPath & path) override
+    {
+        auto entries = next->readDirectory(path);
+        deps->record(Dependency::Listing, path, hashListing(entries));
+        return entries;
+    }
+
+    std::string readLink(const CanonPath & path) override
+    {
+        auto target = next->readLink(path);
+        deps->record(Dependency::Link, path, target);
+        return target;
+    }
+
+    std::string showPath(const CanonPath & path) override
+    {
+        return next->showPath(path);
+    }
+
+    /* Don't return a fingerprint or a physical path, since that would
+       allow callers to bypass this accessor (e.g. by using a cached
+       copy of the path in the store). */
+    std::pair<CanonPath, std::optional<std::string>> getFingerprint(const CanonPath & path) override
+    {
+        return {path, std::nullopt};
+    }
+
+    std::optional<time_t> getLastModified() override
+    {
+        return next->getLastModified();
+    }
+
+    void invalidateCache() override
+    {
+        next->invalidateCache();
+    }
+};
+
+FileDependencies::FileDependencies(ref<SourceAccessor> next, std::string treeId)
+    : next(std::move(next))
+    , treeId(std::move(treeId))
+{
+}
+
+ref<SourceAccessor> FileDependencies::getAccessor()
+{
+    return make_ref<TrackingSourceAccessor>(ref(shared_from_this()), next);
+}
+
+void FileDependencies::record(Dependency::Kind kind, const CanonPath & path, std::string value)
+{
+    auto state(state_.lock());
+    if (state->seen.insert({kind, path}).second)
+        state->log.push_back(Dependency{.kind = kind, .path = path, .value = std::move(value)});
+}
+
+void FileDependencies::recordTree()
+{
+    record(Dependency::Tree, CanonPath::root, treeId);
+}
+
+std::string FileDependencies::observe(Dependency::Kind kind, const CanonPath & path)
+{
+    switch (kind) {
+    case Dependency::Contents: {
+        HashSink sink(HashAlgorithm::SHA256);
+        next->readFile(path, sink);
+        return sink.finish().hash.to_string(HashFormat::Nix32, true);
+    }
+    case Dependency::Listing:
+        return hashListing(next->readDirectory(path));
+    case Dependency::Stat:
+        return showStat(next->maybeLstat(path));
+    case Dependency::Link:
+        return next->readLink(path);
+    case Dependency::Tree:
+        return treeId;
+    default:
+        throw Error("unexpected dependency type %d in evaluation cache", (int) kind);
+    }
+}
+
+std::vector<FileDependencies::Dependency> FileDependencies::getLog(size_t from)
+{
+    auto state(state_.lock());
+    if (from >= state->log.size())
+        return {};
+    return {state->log.begin() + from, state->log.end()};
+}
+
 static const char * schema = R"sql(
 create table if not exists Attributes (
     parent      integer not null,
@@ -39,10 +187,93 @@ create table if not exists Attributes (
     type        integer not null,
     value       text,
     context     text,
+    deps        integer not null default 0,
     primary key (parent, name)
 );
+
+create table if not exists Dependencies (
+    id          integer primary key,
+    kind        integer not null,
+    path        text not null,
+    value       text not null
+);
+
+create table if not exists SearchIndexes (
+    id          integer primary key,
+    attrPath    text unique not null,
+    deps        integer not null default 0
+);
+
+create table if not exists SearchEntries (
+    search      integer not null,
+    id          integer not null,
+    attrPath    text not null,
+    pname       text not null,
+    version     text not null,
+    description text not null,
+    primary key (search, id)
+);
+
+create table if not exists SearchTrigrams (
+    search      integer not null,
+    trigram     integer not null,
+    entries     blob not null, -- delta-encoded entry IDs, see encodeTrigramPosting()
+    primary key (search, trigram)
+);
 )sql";
 
+/**
+ * Append the trigrams in `s` to `trigrams`, ignoring case.
+ */
+static void addTrigrams(std::string_view s, std::vector<uint32_t> & trigrams)
+{
+    auto lower = toLower(std::string(s));
+    for (size_t i = 0; i + 3 <= lower.size(); ++i)
+        trigrams.push_back(
+            (uint32_t) (unsigned char) lower[i] << 16 | (uint32_t) (unsigned char) lower[i + 1] << 8
+            | (unsigned char) lower[i + 2]);
+}
+
+static void sortTrigrams(std::vector<uint32_t> & trigrams)
+{
+    std::sort(trigrams.begin(), trigrams.end());
+    trigrams.erase(std::unique(trigrams.begin(), trigrams.end()), trigrams.end());
+}
+
+/**
+ * Encode an ascending list of entry IDs as the differences between
+ * consecutive IDs (starting at -1) in LEB128. Since every difference
+ * is at least 1, the result doesn't contain any null bytes.
+ */
+static void encodeTrigramPosting(std::string & postings, uint64_t & prev, uint64_t id)
+{
+    auto delta = id + 1 - prev;
+    prev = id + 1;
+    while (delta >= 0x80) {
+        postings.push_back((char) ((delta & 0x7f) | 0x80));
+        delta >>= 7;
+    }
+    postings.push_back((char) delta);
+}
+
+static std::vector<uint64_t> decodeTrigramPostings(std::string_view postings)
+{
+    std::vector<uint64_t> ids;
+    uint64_t prev = 0, delta = 0;
+    unsigned int shift = 0;
+    for (unsigned char c : postings) {
+        delta |= (uint64_t) (c & 0x7f) << shift;
+        shift += 7;
+        if (!(c & 0x80)) {
+            prev += delta;
+            ids.push_back(prev - 1);
+            delta = 0;
+            shift = 0;
+        }
+    }
+    return ids;
+}
+
 struct AttrDb
 {
     std::atomic_bool failed{false};
@@ -56,21 +287,45 @@ struct AttrDb
         SQLiteStmt insertAttributeWithContext;
         SQLiteStmt queryAttribute;
         SQLiteStmt queryAttributes;
+        SQLiteStmt insertDependency;
         std::unique_ptr<SQLiteTxn> txn;
+
+        /**
+         * The number of entries of the `FileDependencies` log that
+         * have been written to the database.
+         */
+        size_t nrFlushed = 0;
+
+        /**
+         * The dependencies in the database.
+         */
+        std::set<std::pair<FileDependencies::Dependency::Kind, CanonPath>> persisted;
+
+        /**
+         * The ID of the last dependency in the database.
+         */
+        uint64_t lastDependency = 0;
     };
 
     std::unique_ptr<Sync<State>> _state;
 
     SymbolTable & symbols;
 
-    AttrDb(const StoreDirConfig & cfg, const Hash & fingerprint, SymbolTable & symbols)
+    std::shared_ptr<FileDependencies> fileDeps;
+
+    AttrDb(
+        const StoreDirConfig & cfg,
+        const Hash & fingerprint,
+        SymbolTable & symbols,
+        std::shared_ptr<FileDependencies> fileDeps)
         : cfg(cfg)
         , _state(std::make_unique<Sync<State>>())
         , symbols(symbols)
+        , fileDeps(std::move(fileDeps))
     {
         auto state(_state->lock());
 
-        auto cacheDir = getCacheDir() / "eval-cache-v6";
+        auto cacheDir = getCacheDir() / "eval-cache-v7";
         createDirs(cacheDir);
 
         auto dbPath = cacheDir / (fingerprint.to_string(HashFormat::Base16, false) + ".sqlite");
@@ -80,19 +335,97 @@ struct AttrDb
         state->db.exec(schema);
 
         state->insertAttribute.create(
-            state->db, "insert or replace into Attributes(parent, name, type, value) values (?, ?, ?, ?)");
+            state->db, "insert or replace into Attributes(parent, name, type, value, deps) values (?, ?, ?, ?, ?)");
 
         state->insertAttributeWithContext.create(
-            state->db, "insert or replace into Attributes(parent, name, type, value, context) values (?, ?, ?, ?, ?)");
+            state->db,
+            "insert or replace into Attributes(parent, name, type, value, context, deps) values (?, ?, ?, ?, ?, ?)");
 
         state->queryAttribute.create(
             state->db, "select rowid, type, value, context from Attributes where parent = ? and name = ?");
 
         state->queryAttributes.create(state->db, "select name from Attributes where parent = ?");
 
+        state->insertDependency.create(state->db, "insert into Dependencies(kind, path, value) values (?, ?, ?)");
+
+        if (this->fileDeps)
+            removeStaleAttrs(*state);
+
         state->txn = std::make_unique<SQLiteTxn>(state->db);
     }
 
+    /**
+     * Check the recorded dependencies in the order in which they were
+     * recorded, and remove the first one that has changed, as well as
+     * every dependency and attribute recorded after it.
+     */
+    void removeStaleAttrs(State & state)
+    {
+        std::vector<std::pair<uint64_t, FileDependencies::Dependency>> deps;
+
+        {
+            SQLiteStmt queryDependencies;
+            queryDependencies.create(state.db, "select id, kind, path, value from Dependencies order by id");
+            auto query(queryDependencies.use());
+            while (query.next())
+                deps.emplace_back(
+                    query.getInt(0),
+                    FileDependencies::Dependency{
+                        .kind = (FileDependencies::Dependency::Kind) query.getInt(1),
+                        .path = CanonPath(query.getStr(2)),
+                        .value = query.getStr(3),
+                    });
+        }
+
+        for (auto & [id, dep] : deps) {
+            bool valid;
+            try {
+                valid = fileDeps->observe(dep.kind, dep.path) == dep.value;
+            } catch (Error &) {
+                valid = false;
+            }
+            if (!valid) {
+                debug("evaluation cache dependency '%s' has changed", dep.path);
+                break;
+            }
+            state.persisted.insert({dep.kind, dep.path});
+            state.lastDependency = id;
+        }
+
+        state.db.exec(fmt("delete from Dependencies where id > %d", state.lastDependency));
+        state.db.exec(fmt("delete from Attributes where deps > %d", state.lastDependency));
+        state.db.exec(
+            fmt("delete from SearchEntries where search in (select id from SearchIndexes where deps > %d)",
+                state.lastDependency));
+        state.db.exec(
+            fmt("delete from SearchTrigrams where search in (select id from SearchIndexes where deps > %d)",
+                state.lastDependency));
+        state.db.exec(fmt("delete from SearchIndexes where deps > %d", state.lastDependency));
+    }
+
+    /**
+     * Write the accesses to the tree that haven't been written yet,
+     * and return the ID of the last dependency. An attribute written
+     * now depends on all dependencies up to that ID.
+     */
+    uint64_t flushDependencies(State & state)
+    {
+        if (!fileDeps)
+            return 0;
+
+        auto deps = fileDeps->getLog(state.nrFlushed);
+        state.nrFlushed += deps.size();
+
+        for (auto & dep : deps) {
+            if (!state.persisted.insert({dep.kind, dep.path}).second)
+                continue;
+            state.insertDependency.use()(dep.kind)(dep.path.abs())(dep.value).exec();
+            state.lastDependency = state.db.getLastInsertedRowId();
+        }
+
+        return state.lastDependency;
+    }
+
     ~AttrDb()
     {
         try {
@@ -123,14 +456,15 @@ struct AttrDb
     {
         return doSQLite([&]() {
             auto state(_state->lock());
+            auto deps = flushDependencies(*state);
 
-            state->insertAttribute.use()(key.first)(symbols[key.second])(AttrType::FullAttrs) (0, false).exec();
+            state->insertAttribute.use()(key.first)(symbols[key.second])(AttrType::FullAttrs) (0, false)(deps).exec();
 
             AttrId rowId = state->db.getLastInsertedRowId();
             assert(rowId);
 
             for (auto & attr : attrs)
-                state->insertAttribute.use()(rowId)(symbols[attr])(AttrType::Placeholder) (0, false).exec();
+                state->insertAttribute.use()(rowId)(symbols[attr])(AttrType::Placeholder) (0, false)(deps).exec();
 
             return rowId;
         });
@@ -140,6 +474,7 @@ struct AttrDb
     {
         return doSQLite([&]() {
             auto state(_state->lock());
+            auto deps = flushDependencies(*state);
 
             if (context) {
                 std::string ctx;
@@ -150,10 +485,11 @@ struct AttrDb
                     ctx.append(elem->view());
                     first = false;
                 }
-                state->insertAttributeWithContext.use()(key.first)(symbols[key.second])(AttrType::String) (s) (ctx)
+                state->insertAttributeWithContext.use()(key.first)(symbols[key.second])(AttrType::String) (s) (ctx)(
+                    deps)
                     .exec();
             } else {
-                state->insertAttribute.use()(key.first)(symbols[key.second])(AttrType::String) (s).exec();
+                state->insertAttribute.use()(key.first)(symbols[key.second])(AttrType::String) (s)(deps).exec();
             }
 
             return state->db.getLastInsertedRowId();
@@ -164,8 +500,9 @@ struct AttrDb
     {
         return doSQLite([&]() {
             auto state(_state->lock());
+            auto deps = flushDependencies(*state);
 
-            state->insertAttribute.use()(key.first)(symbols[key.second])(AttrType::Bool) (b ? 1 : 0).exec();
+            state->insertAttribute.use()(key.first)(symbols[key.second])(AttrType::Bool) (b ? 1 : 0)(deps).exec();
 
             return state->db.getLastInsertedRowId();
         });
@@ -175,8 +512,9 @@ struct AttrDb
     {
         return doSQLite([&]() {
             auto state(_state->lock());
+            auto deps = flushDependencies(*state);
 
-            state->insertAttribute.use()(key.first)(symbols[key.second])(AttrType::Int) (n).exec();
+            state->insertAttribute.use()(key.first)(symbols[key.second])(AttrType::Int) (n)(deps).exec();
 
             return state->db.getLastInsertedRowId();
         });
@@ -186,10 +524,11 @@ struct AttrDb
     {
         return doSQLite([&]() {
             auto state(_state->lock());
+            auto deps = flushDependencies(*state);
 
             state->insertAttribute
                 .use()(key.first)(symbols[key.second])(
-                    AttrType::ListOfStrings) (dropEmptyInitThenConcatStringsSep("\t", l))
+                    AttrType::ListOfStrings) (dropEmptyInitThenConcatStringsSep("\t", l))(deps)
                 .exec();
 
             return state->db.getLastInsertedRowId();
@@ -200,8 +539,9 @@ struct AttrDb
     {
         return doSQLite([&]() {
             auto state(_state->lock());
+            auto deps = flushDependencies(*state);
 
-            state->insertAttribute.use()(key.first)(symbols[key.second])(AttrType::Placeholder) (0, false).exec();
+            state->insertAttribute.use()(key.first)(symbols[key.second])(AttrType::Placeholder) (0, false)(deps).exec();
 
             return state->db.getLastInsertedRowId();
         });
@@ -211,8 +551,9 @@ struct AttrDb
     {
         return doSQLite([&]() {
             auto state(_state->lock());
+            auto deps = flushDependencies(*state);
 
-            state->insertAttribute.use()(key.first)(symbols[key.second])(AttrType::Missing) (0, false).exec();
+            state->insertAttribute.use()(key.first)(symbols[key.second])(AttrType::Missing) (0, false)(deps).exec();
 
             return state->db.getLastInsertedRowId();
         });
@@ -222,8 +563,9 @@ struct AttrDb
     {
         return doSQLite([&]() {
             auto state(_state->lock());
+            auto deps = flushDependencies(*state);
 
-            state->insertAttribute.use()(key.first)(symbols[key.second])(AttrType::Misc) (0, false).exec();
+            state->insertAttribute.use()(key.first)(symbols[key.second])(AttrType::Misc) (0, false)(deps).exec();
 
             return state->db.getLastInsertedRowId();
         });
@@ -233,8 +575,9 @@ struct AttrDb
     {
         return doSQLite([&]() {
             auto state(_state->lock());
+            auto deps = flushDependencies(*state);
 
-            state->insertAttribute.use()(key.first)(symbols[key.second])(AttrType::Failed) (0, false).exec();
+            state->insertAttribute.use()(key.first)(symbols[key.second])(AttrType::Failed) (0, false)(deps).exec();
 
             return state->db.getLastInsertedRowId();
         });
@@ -285,12 +628,133 @@ struct AttrDb
             throw Error("unexpected type in evaluation cache");
         }
     }
+
+    void setSearchIndex(std::string_view attrPath, const std::vector<SearchIndexEntry> & entries)
+    {
+        doSQLite([&]() {
+            auto state(_state->lock());
+            auto deps = flushDependencies(*state);
+
+            SQLiteStmt deleteEntries, deleteTrigrams, insertIndex, insertEntry, insertTrigram;
+            deleteEntries.create(
+                state->db, "delete from SearchEntries where search in (select id from SearchIndexes where attrPath = ?)");
+            deleteTrigrams.create(
+                state->db,
+                "delete from SearchTrigrams where search in (select id from SearchIndexes where attrPath = ?)");
+            insertIndex.create(state->db, "insert or replace into SearchIndexes(attrPath, deps) values (?, ?)");
+            insertEntry.create(
+                state->db,
+                "insert into SearchEntries(search, id, attrPath, pname, version, description) values (?, ?, ?, ?, ?, ?)");
+            insertTrigram.create(state->db, "insert into SearchTrigrams(search, trigram, entries) values (?, ?, ?)");
+
+            deleteEntries.use()(attrPath).exec();
+            deleteTrigrams.use()(attrPath).exec();
+            insertIndex.use()(attrPath)(deps).exec();
+            auto search = state->db.getLastInsertedRowId();
+
+            std::map<uint32_t, std::pair<uint64_t, std::string>> postings;
+            std::vector<uint32_t> trigrams;
+
+            for (const auto & [id, entry] : enumerate(entries)) {
+                insertEntry.use()(search)(id)(entry.attrPath)(entry.pname)(entry.version)(entry.description).exec();
+
+                trigrams.clear();
+                addTrigrams(entry.attrPath, trigrams);
+                addTrigrams(entry.pname, trigrams);
+                addTrigrams(entry.description, trigrams);
+                sortTrigrams(trigrams);
+                for (auto trigram : trigrams) {
+                    auto & [prev, p] = postings[trigram];
+                    encodeTrigramPosting(p, prev, id);
+                }
+            }
+
+            for (auto & [trigram, p] : postings)
+                insertTrigram.use()(search)(trigram)((const unsigned char *) p.second.data(), p.second.size()).exec();
+
+            return search;
+        });
+    }
+
+    std::optional<std::vector<SearchIndexEntry>>
+    getSearchIndex(std::string_view attrPath, const std::vector<std::string> & literals)
+    {
+        if (failed)
+            return std::nullopt;
+
+        auto state(_state->lock());
+
+        SQLiteStmt queryIndex, queryTrigram, queryEntry, queryEntries;
+        queryIndex.create(state->db, "select id from SearchIndexes where attrPath = ?");
+        queryTrigram.create(state->db, "select entries from SearchTrigrams where search = ? and trigram = ?");
+        queryEntry.create(
+            state->db, "select attrPath, pname, version, description from SearchEntries where search = ? and id = ?");
+        queryEntries.create(
+            state->db, "select attrPath, pname, version, description from SearchEntries where search = ? order by id");
+
+        auto index(queryIndex.use()(attrPath));
+        if (!index.next())
+            return std::nullopt;
+        auto search = index.getInt(0);
+
+        std::vector<uint32_t> trigrams;
+        for (auto & literal : literals)
+            addTrigrams(literal, trigrams);
+        sortTrigrams(trigrams);
+
+        /* Intersect the entries containing each trigram. If there are
+           no trigrams, every entry is a candidate. */
+        std::optional<std::vector<uint64_t>> candidates;
+        for (auto trigram : trigrams) {
+            auto query(queryTrigram.use()(search)(trigram));
+            if (!query.next())
+                return std::vector<SearchIndexEntry>();
+            auto ids = decodeTrigramPostings(query.getStr(0));
+            if (candidates) {
+                std::vector<uint64_t> common;
+                std::ranges::set_intersection(*candidates, ids, std::back_inserter(common));
+                candidates = std::move(common);
+            } else
+                candidates = std::move(ids);
+            if (candidates->empty())
+                return std::vector<SearchIndexEntry>();
+        }
+
+        std::vector<SearchIndexEntry> entries;
+
+        auto getEntry = [](SQLiteStmt::Use & query) {
+            return SearchIndexEntry{
+                .attrPath = query.getStr(0),
+                .pname = query.getStr(1),
+                .version = query.getStr(2),
+                .description = query.getStr(3),
+            };
+        };
+
+        if (candidates) {
+            for (auto id : *candidates) {
+                auto query(queryEntry.use()(search)(id));
+                if (query.next())
+                    entries.push_back(getEntry(query));
+            }
+        } else {
+            auto query(queryEntries.use()(search));
+            while (query.next())
+                entries.push_back(getEntry(query));
+        }
+
+        return entries;
+    }
 };
 
-static std::shared_ptr<AttrDb> makeAttrDb(const StoreDirConfig & cfg, const Hash & fingerprint, SymbolTable & symbols)
+static std::shared_ptr<AttrDb> makeAttrDb(
+    const StoreDirConfig & cfg,
+    const Hash & fingerprint,
+    SymbolTable & symbols,
+    std::shared_ptr<FileDependencies> fileDeps)
 {
     try {
-        return std::make_shared<AttrDb>(cfg, fingerprint, symbols);
+        return std::make_shared<AttrDb>(cfg, fingerprint, symbols, std::move(fileDeps));
     } catch (SQLiteError &) {
         ignoreExceptionExceptInterrupt();
         return nullptr;
@@ -298,8 +762,11 @@ static std::shared_ptr<AttrDb> makeAttrDb(const StoreDirConfig & cfg, const Hash
 }
 
 EvalCache::EvalCache(
-    std::optional<std::reference_wrapper<const Hash>> useCache, EvalState & state, RootLoader rootLoader)
-    : db(useCache ? makeAttrDb(*state.store, *useCache, state.symbols) : nullptr)
+    std::optional<std::reference_wrapper<const Hash>> useCache,
+    EvalState & state,
+    RootLoader rootLoader,
+    std::shared_ptr<FileDependencies> fileDeps)
+    : db(useCache ? makeAttrDb(*state.store, *useCache, state.symbols, std::move(fileDeps)) : nullptr)
     , state(state)
     , rootLoader(rootLoader)
 {
@@ -410,6 +877,7 @@ Value & AttrCursor::forceValue()
         if (v.type() == nString)
             cachedValue = {root->db->setString(getKey(), v.string_view(), v.context()), string_t{v.string_view(), {}}};
         else if (v.type() == nPath) {
+            root->state.recordLocationDependency(v.path());
             auto path = v.path().path;
             cachedValue = {root->db->setString(getKey(), path.abs()), string_t{path.abs(), {}}};
         } else if (v.type() == nBool)
@@ -721,4 +1189,37 @@ StorePath AttrCursor::forceDerivation()
     return drvPath;
 }
 
+std::optional<std::vector<SearchIndexEntry>> AttrCursor::querySearchIndex(const std::vector<std::string> & literals)
+{
+    if (!root->db)
+        return std::nullopt;
+    return root->db->getSearchIndex(getAttrPathStr(), literals);
+}
+
+void AttrCursor::putSearchIndex(const std::vector<SearchIndexEntry> & entries)
+{
+    if (root->db)
+        root->db->setSearchIndex(getAttrPathStr(), entries);
+}
+
+static void prim_recordTreeDependency(EvalState & state, const PosIdx pos, Value ** args, Value & v)
+{
+    auto mountPoint = state.forceStringNoCtx(
+        *args[0], pos, "while evaluating the first argument passed to builtins.recordTreeDependency");
+    state.recordLocationDependency(state.rootPath(CanonPath(mountPoint)));
+    state.forceValue(*args[1], pos);
+    v = *args[1];
+}
+
+/**
+ * Used by `callFlake()` to make the attributes that reveal the store
+ * path or NAR hash of a tracked tree depend on the entire tree.
+ */
+static RegisterPrimOp primop_recordTreeDependency({
+    .name = "recordTreeDependency",
+    .args = {"mountPoint", "value"},
+    .impl = prim_recordTreeDependency,
+    .internal = true,
+});
+
 } // namespace nix::eval_cache
@@ -1,8 +1,18 @@
 #include "nix/util/environment-variables.hh"
+#include "nix/expr/counter.hh"
 #include "nix/expr/eval-settings.hh"
 #include "nix/util/config-global.hh"
 #include "nix/expr/eval-gc.hh"
 #include "nix/expr/value.hh"
+#include "nix/util/alignment.hh"
+#include "nix/util/bump-memory-resource.hh"
+#include "nix/util/logging.hh"
+#include "nix/util/sync.hh"
+
+#include <atomic>
+#include <cstring>
+#include <memory>
+#include <mutex>
 
 #include "expr-config-private.hh"
 
@@ -37,6 +47,78 @@ namespace nix {
  */
 static_assert(sizeof(void *) * 2 == GC_GRANULE_BYTES, "Boehm GC must use GC_GRANULE_WORDS = 2");
 
+/**
+ * Settings of the garbage collector. These are applied by `initGC()`,
+ * i.e. before command-line arguments are processed, so they can only
+ * be set in the configuration file or `NIX_CONFIG`.
+ */
+struct GCSettings : Config
+{
+    Setting<unsigned int> markers{
+        this,
+        0,
+        "gc-markers",
+        R"(
+          The number of threads (including the one that starts a
+          collection) that the garbage collector of the Nix evaluator uses
+          for marking. `1` disables parallel marking. The default, `0`, uses
+          one thread per CPU, up to a limit built into the garbage collector,
+          unless it's overridden by the `GC_MARKERS` environment variable.
+
+          This must be set in the configuration file or
+          [`NIX_CONFIG`](@docroot@/command-ref/env-common.md#env-NIX_CONFIG), since
+          the garbage collector is started before command-line options are processed.
+        )"};
+
+    Setting<bool> incremental{
+        this,
+        false,
+        "gc-incremental",
+        R"(
+          Whether the garbage collector of the Nix evaluator runs in incremental and
+          generational mode. Collections are then interleaved with evaluation in
+          smaller steps, and mostly only scan recently modified memory. This
+          reduces the length of pauses, but usually increases the total time
+          spent in garbage collection, and isn't supported on all platforms.
+
+          Like [`gc-markers`](#conf-gc-markers), this can't be set on the command line.
+        )"};
+
+    Setting<uint64_t> initialHeapSize{
+        this,
+        0,
+        "gc-initial-heap-size",
+        R"(
+          The initial size in bytes of the heap of the Nix evaluator. A larger
+          heap means fewer garbage collections at the cost of a higher memory
+          usage. The default, `0`, is 25% of physical memory, but at most
+          384 MiB. The
+          [`GC_INITIAL_HEAP_SIZE`](@docroot@/command-ref/env-common.md#env-GC_INITIAL_HEAP_SIZE)
+          environment variable takes precedence over this setting.
+
+          Like [`gc-markers`](#conf-gc-markers), this can't be set on the command line.
+        )"};
+
+    Setting<unsigned int> freeSpaceDivisor{
+        this,
+        0,
+        "gc-free-space-divisor",
+        R"(
+          Controls how eagerly the Nix evaluator grows its heap rather than
+          collecting garbage: roughly, a collection is triggered once the amount
+          of memory allocated since the previous one exceeds the heap size
+          divided by this number. Smaller values trade memory for speed. The
+          default, `0`, uses the garbage collector's built-in value (3), unless
+          it's overridden by the `GC_FREE_SPACE_DIVISOR` environment variable.
+
+          Like [`gc-markers`](#conf-gc-markers), this can't be set on the command line.
+        )"};
+};
+
+static GCSettings gcSettings;
+
+static GlobalConfig::Register rGCSettings(&gcSettings);
+
 /* Called when the Boehm GC runs out of memory. */
 static void * oomHandler(size_t requested)
 {
@@ -44,6 +126,99 @@ static void * oomHandler(size_t requested)
     throw std::bad_alloc();
 }
 
+namespace {
+
+/**
+ * Measurements of garbage collections, gathered by
+ * `onCollectionEvent()` and `onHeapResize()`. Boehm calls these with
+ * its allocation lock held and possibly with the world stopped, so
+ * they must not allocate or take locks; they only write to atomics and
+ * to storage that was allocated by `initGCReal()`.
+ */
+struct GCMetrics
+{
+    using Clock = std::chrono::steady_clock;
+
+    /* These are only accessed by the callbacks. */
+    Clock::time_point cycleStart;
+    Clock::time_point worldStopped;
+    Clock::duration cyclePause{0};
+    size_t heapSize = 0;
+
+    /* These are written by the callbacks and read by `getGCStats()`. */
+    std::atomic<std::chrono::nanoseconds::rep> totalPause{0};
+    std::atomic<std::chrono::nanoseconds::rep> maxPause{0};
+    std::atomic<size_t> heapGrowths{0};
+
+    size_t initialHeapSize = 0;
+
+    /**
+     * The first `maxCycles` collections, if statistics are enabled.
+     * Slots below `nrCycles` are never written again.
+     */
+    static constexpr size_t maxCycles = 1 << 16;
+    std::unique_ptr<GCCycleStats[]> cycles;
+    std::atomic<size_t> nrCycles{0};
+};
+
+GCMetrics gcMetrics;
+
+} // namespace
+
+static void GC_CALLBACK onCollectionEvent(GC_EventType event)
+{
+    auto now = GCMetrics::Clock::now();
+
+    switch (event) {
+    case GC_EVENT_START:
+        gcMetrics.cycleStart = now;
+        break;
+
+    case GC_EVENT_PRE_STOP_WORLD:
+        gcMetrics.worldStopped = now;
+        break;
+
+    /* In incremental mode, the world is also stopped outside of
+       collections. We count those pauses towards the next
+       collection. */
+    case GC_EVENT_POST_START_WORLD:
+        gcMetrics.cyclePause += now - gcMetrics.worldStopped;
+        break;
+
+    case GC_EVENT_END: {
+        auto pause = std::chrono::duration_cast<std::chrono::nanoseconds>(gcMetrics.cyclePause);
+        gcMetrics.cyclePause = {};
+
+        /* The callbacks are serialised by the allocation lock, so
+           there is only one writer. */
+        gcMetrics.totalPause.fetch_add(pause.count(), std::memory_order_relaxed);
+        if (pause.count() > gcMetrics.maxPause.load(std::memory_order_relaxed))
+            gcMetrics.maxPause.store(pause.count(), std::memory_order_relaxed);
+
+        auto n = gcMetrics.nrCycles.load(std::memory_order_relaxed);
+        if (gcMetrics.cycles && n < GCMetrics::maxCycles) {
+            gcMetrics.cycles[n] = {
+                .pause = pause,
+                .duration = now - gcMetrics.cycleStart,
+                .heapSize = gcMetrics.heapSize,
+            };
+            gcMetrics.nrCycles.store(n + 1, std::memory_order_release);
+        }
+        break;
+    }
+
+    default:
+        break;
+    }
+}
+
+static void GC_CALLBACK onHeapResize(GC_word newSize)
+{
+    if (newSize > gcMetrics.heapSize)
+        gcMetrics.heapGrowths.fetch_add(1, std::memory_order_relaxed);
+    gcMetrics.heapSize = newSize;
+}
+
 static inline void initGCReal()
 {
     /* Initialise the Boehm garbage collector. */
@@ -60,11 +235,17 @@ static inline void initGCReal()
        start of something. */
     GC_start_performance_measurement();
 
+    if (gcSettings.markers != 0)
+        GC_set_markers_count(gcSettings.markers);
+
     GC_INIT();
 
     /* Enable parallel marking. */
     GC_allow_register_threads();
 
+    if (gcSettings.freeSpaceDivisor != 0)
+        GC_set_free_space_divisor(gcSettings.freeSpaceDivisor);
+
     /* Register valid displacements in case we are using alignment niches
        for storing the type information. This way tagged pointers are considered
        to be valid, even when they are not aligned. */
@@ -78,25 +259,42 @@ static inline void initGCReal()
        physical RAM, up to a maximum of 384 MiB) so that in most cases
        we don't need to garbage collect at all.  (Collection has a
        fairly significant overhead.)  The heap size can be overridden
-       through libgc's GC_INITIAL_HEAP_SIZE environment variable.  We
-       should probably also provide a nix.conf setting for this.  Note
-       that GC_expand_hp() causes a lot of virtual, but not physical
+       through the gc-initial-heap-size setting or libgc's
+       GC_INITIAL_HEAP_SIZE environment variable.  Note that
+       GC_expand_hp() causes a lot of virtual, but not physical
        (resident) memory to be allocated.  This might be a problem on
        systems that don't overcommit. */
     if (!getEnv("GC_INITIAL_HEAP_SIZE")) {
-        size_t size = 32 * 1024 * 1024;
+        size_t size = gcSettings.initialHeapSize;
+        if (size == 0) {
+            size = 32 * 1024 * 1024;
 #  if HAVE_SYSCONF && defined(_SC_PAGESIZE) && defined(_SC_PHYS_PAGES)
-        size_t maxSize = 384 * 1024 * 1024;
-        long pageSize = sysconf(_SC_PAGESIZE);
-        long pages = sysconf(_SC_PHYS_PAGES);
-        if (pageSize != -1)
-            size = (pageSize * pages) / 4; // 25% of RAM
-        if (size > maxSize)
-            size = maxSize;
+            size_t maxSize = 384 * 1024 * 1024;
+            long pageSize = sysconf(_SC_PAGESIZE);
+            long pages = sysconf(_SC_PHYS_PAGES);
+            if (pageSize != -1)
+                size = (pageSize * pages) / 4; // 25% of RAM
+            if (size > maxSize)
+                size = maxSize;
 #  endif
+        }
         debug("setting initial heap size to %1% bytes", size);
         GC_expand_hp(size);
     }
+
+    gcMetrics.heapSize = GC_get_heap_size();
+    gcMetrics.initialHeapSize = gcMetrics.heapSize;
+    /* Don't accumulate these in long-running processes unless they're
+       going to be shown. */
+    if (Counter::enabled)
+        gcMetrics.cycles = std::make_unique<GCCycleStats[]>(GCMetrics::maxCycles);
+    GC_set_on_heap_resize(onHeapResize);
+    GC_set_on_collection_event(onCollectionEvent);
+
+    /* Enable this last, since it makes the collector start an
+       incremental collection right away. */
+    if (gcSettings.incremental)
+        GC_enable_incremental();
 }
 
 static size_t gcCyclesAfterInit = 0;
@@ -107,6 +305,24 @@ size_t getGCCycles()
     return static_cast<size_t>(GC_get_gc_no()) - gcCyclesAfterInit;
 }
 
+GCStats getGCStats()
+{
+    assertGCInitialized();
+
+    GCStats stats{
+        .totalPause = std::chrono::nanoseconds(gcMetrics.totalPause.load(std::memory_order_relaxed)),
+        .maxPause = std::chrono::nanoseconds(gcMetrics.maxPause.load(std::memory_order_relaxed)),
+        .initialHeapSize = gcMetrics.initialHeapSize,
+        .heapGrowths = gcMetrics.heapGrowths.load(std::memory_order_relaxed),
+    };
+
+    if (gcMetrics.cycles)
+        stats.cycles.assign(
+            gcMetrics.cycles.get(), gcMetrics.cycles.get() + gcMetrics.nrCycles.load(std::memory_order_acquire));
+
+    return stats;
+}
+
 #endif
 
 static bool gcInitialised = false;
@@ -136,4 +352,178 @@ void assertGCInitialized()
     assert(gcInitialised);
 }
 
+std::atomic<bool> evalArenaActive{false};
+
+namespace {
+
+/**
+ * Upstream resource for the arena in case it can't reserve its address
+ * space up front. Unlike fresh anonymous mappings, memory from the
+ * regular heap has to be cleared explicitly.
+ */
+struct ZeroedMemoryResource : std::pmr::memory_resource
+{
+    void * do_allocate(std::size_t bytes, std::size_t alignment) override
+    {
+        auto p = ::operator new(bytes, std::align_val_t(alignment));
+        std::memset(p, 0, bytes);
+        return p;
+    }
+
+    void do_deallocate(void * p, std::size_t bytes, std::size_t alignment) override
+    {
+        ::operator delete(p, bytes, std::align_val_t(alignment));
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource & other) const noexcept override
+    {
+        return this == &other;
+    }
+};
+
+struct EvalArena
+{
+    /**
+     * The size of the chunks from which threads allocate without
+     * synchronisation. Larger allocations get a chunk of their own.
+     */
+    static constexpr size_t chunkSize = 1 << 20;
+
+    /**
+     * Same as the Boehm GC granule size.
+     */
+    static constexpr unsigned alignment = 2 * sizeof(void *);
+
+    const size_t limit;
+    const bool fallback;
+
+    ZeroedMemoryResource upstream;
+    BumpMemoryResource resource;
+
+    struct State
+    {
+        size_t bytes = 0;
+        bool full = false;
+
+        /**
+         * The memory taken from `resource`, with adjacent chunks
+         * merged.
+         */
+        std::vector<std::pair<char *, size_t>> regions;
+    };
+
+    Sync<State> state_;
+
+    EvalArena(size_t limit, bool fallback)
+        : limit(limit)
+        , fallback(fallback)
+        , resource(limit, &upstream)
+    {
+    }
+
+    /**
+     * Take `size` bytes from the arena, or return `nullptr` if it's
+     * full and falling back to garbage collection is allowed. If it
+     * isn't, every allocation after the arena has filled up throws.
+     */
+    char * take(size_t size)
+    {
+        auto state(state_.lock());
+
+        if (!state->full && state->bytes + size > limit) {
+            state->full = true;
+
+            if (fallback) {
+                printTalkative("evaluation arena is full, falling back to garbage collection");
+
+#if NIX_USE_BOEHMGC
+                /* Objects in the garbage-collected heap may only be
+                   referenced from the arena. */
+                for (auto & [p, size] : state->regions)
+                    GC_add_roots(p, p + size);
+                GC_enable();
+#endif
+
+                evalArenaActive = false;
+            }
+        }
+
+        if (state->full) {
+            if (!fallback)
+                throw Error(
+                    "evaluation needs more than %d bytes of memory; increase 'eval-arena-size' or enable 'eval-arena-fallback'",
+                    limit);
+            return nullptr;
+        }
+
+        auto p = (char *) resource.allocate(size, alignment);
+        state->bytes += size;
+
+        if (!state->regions.empty() && state->regions.back().first + state->regions.back().second == p)
+            state->regions.back().second += size;
+        else
+            state->regions.emplace_back(p, size);
+
+        return p;
+    }
+};
+
+/* Never freed, since evaluation memory lives until exit. */
+EvalArena * evalArena = nullptr;
+
+struct ThreadChunk
+{
+    char * pos = nullptr;
+    char * end = nullptr;
+};
+
+thread_local ThreadChunk threadChunk;
+
+} // namespace
+
+void enableEvalArena(size_t limit, bool fallback)
+{
+    assertGCInitialized();
+
+    static std::once_flag once;
+    std::call_once(once, [&]() {
+        evalArena = new EvalArena(limit, fallback);
+#if NIX_USE_BOEHMGC
+        /* The collector doesn't scan the arena, so it mustn't free
+           anything that the arena refers to. */
+        GC_disable();
+#endif
+        evalArenaActive = true;
+    });
+}
+
+void * allocFromEvalArena(size_t n)
+{
+    n = alignUp(n, EvalArena::alignment);
+
+    auto & chunk = threadChunk;
+    if (n <= size_t(chunk.end - chunk.pos)) {
+        auto p = chunk.pos;
+        chunk.pos += n;
+        return p;
+    }
+
+    if (n > EvalArena::chunkSize / 4)
+        return evalArena->take(n);
+
+    auto p = evalArena->take(EvalArena::chunkSize);
+    if (!p)
+        return nullptr;
+    chunk = {.pos = p + n, .end = p + EvalArena::chunkSize};
+    return p;
+}
+
+EvalArenaStats getEvalArenaStats()
+{
+    if (!evalArena)
+        return {};
+    auto state(evalArena->state_.lock());
+    return {.enabled = true, .full = state->full, .bytes = state->bytes};
+}
+
 } // namespace nix
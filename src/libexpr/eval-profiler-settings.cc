@@ -14,6 +14,8 @@ EvalProfilerMode BaseSetting<EvalProfilerMode>::parse(const std::string & str) c
         return EvalProfilerMode::disabled;
     else if (str == "flamegraph")
         return EvalProfilerMode::flamegraph;
+    else if (str == "memory")
+        return EvalProfilerMode::memory;
     else
         throw UsageError("option '%s' has invalid value '%s'", name, str);
 }
@@ -31,6 +33,8 @@ std::string BaseSetting<EvalProfilerMode>::to_string() const
         return "disabled";
     else if (value == EvalProfilerMode::flamegraph)
         return "flamegraph";
+    else if (value == EvalProfilerMode::memory)
+        return "memory";
     else
         unreachable();
 }
@@ -40,6 +44,7 @@ NLOHMANN_JSON_SERIALIZE_ENUM(
     {
         {EvalProfilerMode::disabled, "disabled"},
         {EvalProfilerMode::flamegraph, "flamegraph"},
+        {EvalProfilerMode::memory, "memory"},
     });
 
 /* Explicit instantiation of templates */
@@ -3,6 +3,8 @@
 #include "nix/expr/eval.hh"
 #include "nix/util/lru-cache.hh"
 
+#include <random>
+
 namespace nix {
 
 void EvalProfiler::preFunctionCallHook(EvalState & state, const Value & v, std::span<Value *> args, const PosIdx pos) {}
@@ -103,6 +105,14 @@ struct DerivationStrictFrameInfo
     auto operator<=>(const DerivationStrictFrameInfo & rhs) const = default;
 };
 
+/** Memory allocation, as the innermost frame of an allocation profile. */
+struct AllocationFrameInfo
+{
+    AllocationKind kind;
+    std::ostream & symbolize(const EvalState & state, std::ostream & os, PosCache & posCache) const;
+    auto operator<=>(const AllocationFrameInfo & rhs) const = default;
+};
+
 /** Fallback frame info. */
 struct GenericFrameInfo
 {
@@ -111,8 +121,13 @@ struct GenericFrameInfo
     auto operator<=>(const GenericFrameInfo & rhs) const = default;
 };
 
-using FrameInfo =
-    std::variant<LambdaFrameInfo, PrimOpFrameInfo, FunctorFrameInfo, DerivationStrictFrameInfo, GenericFrameInfo>;
+using FrameInfo = std::variant<
+    LambdaFrameInfo,
+    PrimOpFrameInfo,
+    FunctorFrameInfo,
+    DerivationStrictFrameInfo,
+    AllocationFrameInfo,
+    GenericFrameInfo>;
 using FrameStack = std::vector<FrameInfo>;
 
 /**
@@ -133,7 +148,12 @@ class SampleStack : public EvalProfiler
     FrameInfo getPrimOpFrameInfo(const PrimOp & primOp, std::span<Value *> args, PosIdx pos);
 
 public:
-    SampleStack(EvalState & state, const std::filesystem::path & profileFile, std::chrono::nanoseconds period)
+    /**
+     * @param period How often to sample the stack on function calls, or
+     *   `std::nullopt` to only take samples explicitly (@see addSample).
+     */
+    SampleStack(
+        EvalState & state, const std::filesystem::path & profileFile, std::optional<std::chrono::nanoseconds> period)
         : state(state)
         , sampleInterval(period)
         , profileFd([&]() {
@@ -166,13 +186,20 @@ public:
     SampleStack(const SampleStack &) = delete;
     SampleStack & operator=(const SampleStack &) = delete;
     ~SampleStack();
-private:
+protected:
+    /**
+     * Add `weight` to the samples of the current stack, with `frame` on
+     * top of it.
+     */
+    void addSample(FrameInfo frame, uint64_t weight);
+
     /** Hold on to an instance of EvalState for symbolizing positions. */
     EvalState & state;
-    std::chrono::nanoseconds sampleInterval;
+private:
+    std::optional<std::chrono::nanoseconds> sampleInterval;
     AutoCloseFD profileFd;
     FrameStack stack;
-    std::map<FrameStack, uint32_t> callCount;
+    std::map<FrameStack, uint64_t> callCount;
     std::chrono::time_point<std::chrono::high_resolution_clock> lastStackSample =
         std::chrono::high_resolution_clock::now();
     std::chrono::time_point<std::chrono::high_resolution_clock> lastDump = std::chrono::high_resolution_clock::now();
@@ -235,7 +262,7 @@ SampleStack::preFunctionCallHook(EvalState & state, const Value & v, std::span<V
 
     auto now = std::chrono::high_resolution_clock::now();
 
-    if (now - lastStackSample > sampleInterval) {
+    if (sampleInterval && now - lastStackSample > *sampleInterval) {
         callCount[stack] += 1;
         lastStackSample = now;
     }
@@ -252,6 +279,13 @@ SampleStack::postFunctionCallHook(EvalState & state, const Value & v, std::span<
         stack.pop_back();
 }
 
+void SampleStack::addSample(FrameInfo frame, uint64_t weight)
+{
+    stack.push_back(std::move(frame));
+    callCount[stack] += weight;
+    stack.pop_back();
+}
+
 std::ostream & LambdaFrameInfo::symbolize(const EvalState & state, std::ostream & os, PosCache & posCache) const
 {
     if (auto pos = posCache.lookup(callPos); std::holds_alternative<std::monostate>(pos.origin))
@@ -288,6 +322,29 @@ std::ostream & PrimOpFrameInfo::symbolize(const EvalState & state, std::ostream
     return os;
 }
 
+std::ostream & AllocationFrameInfo::symbolize(const EvalState & state, std::ostream & os, PosCache & posCache) const
+{
+    os << "allocate ";
+    switch (kind) {
+    case AllocationKind::value:
+        os << "value";
+        break;
+    case AllocationKind::env:
+        os << "env";
+        break;
+    case AllocationKind::attrset:
+        os << "attrset";
+        break;
+    case AllocationKind::list:
+        os << "list";
+        break;
+    case AllocationKind::string:
+        os << "string";
+        break;
+    }
+    return os;
+}
+
 std::ostream &
 DerivationStrictFrameInfo::symbolize(const EvalState & state, std::ostream & os, PosCache & posCache) const
 {
@@ -347,6 +404,41 @@ SampleStack::~SampleStack()
     }
 }
 
+/**
+ * Allocation profiler. Rather than periodically, this samples the stack
+ * every so many bytes allocated by the evaluator, weighting each sample
+ * by the number of bytes allocated since the previous one.
+ */
+class AllocationProfiler : public SampleStack, public AllocationSampler
+{
+    uint64_t interval;
+
+    /* Randomise the distance between samples, so that it doesn't line
+       up with periodic allocation patterns. */
+    std::minstd_rand rng{std::random_device{}()};
+    std::exponential_distribution<double> nextSample;
+
+public:
+    AllocationProfiler(EvalState & state, const std::filesystem::path & profileFile, uint64_t interval)
+        : SampleStack(state, profileFile, std::nullopt)
+        , interval(interval)
+        , nextSample(interval ? 1.0 / interval : 1.0)
+    {
+        state.mem.setAllocationSampler(this);
+    }
+
+    ~AllocationProfiler()
+    {
+        state.mem.setAllocationSampler(nullptr);
+    }
+
+    uint64_t sampleAllocation(AllocationKind kind, uint64_t bytes) override
+    {
+        addSample(AllocationFrameInfo{.kind = kind}, bytes);
+        return interval ? (uint64_t) nextSample(rng) : 0;
+    }
+};
+
 } // namespace
 
 ref<EvalProfiler> makeSampleStackProfiler(EvalState & state, std::filesystem::path profileFile, uint64_t frequency)
@@ -358,4 +450,9 @@ ref<EvalProfiler> makeSampleStackProfiler(EvalState & state, std::filesystem::pa
     return make_ref<SampleStack>(state, profileFile, period);
 }
 
+ref<EvalProfiler> makeAllocationProfiler(EvalState & state, std::filesystem::path profileFile, uint64_t interval)
+{
+    return make_ref<AllocationProfiler>(state, profileFile, interval);
+}
+
 } // namespace nix
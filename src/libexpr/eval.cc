@@ -15,6 +15,7 @@
 #include "nix/expr/eval-inline.hh"
 #include "nix/store/filetransfer.hh"
 #include "nix/expr/function-trace.hh"
+#include "nix/expr/function-memo.hh"
 #include "nix/store/profiles.hh"
 #include "nix/expr/print.hh"
 #include "nix/fetchers/filtering-source-accessor.hh"
@@ -25,6 +26,8 @@
 #include "nix/fetchers/fetch-to-store.hh"
 #include "nix/fetchers/tarball.hh"
 #include "nix/fetchers/input-cache.hh"
+#include "nix/fetchers/cache.hh"
+#include "nix/fetchers/fetch-settings.hh"
 #include "nix/util/current-process.hh"
 
 #include "parser-tab.hh"
@@ -47,6 +50,7 @@
 #include <nlohmann/json.hpp>
 #include <boost/container/small_vector.hpp>
 #include <boost/unordered/concurrent_flat_map.hpp>
+#include <boost/unordered/unordered_flat_set.hpp>
 
 #include "nix/util/strings-inline.hh"
 
@@ -86,6 +90,8 @@ static const char * makeImmutableString(std::string_view s)
 
 StringData & StringData::alloc(EvalMemory & mem, size_t size)
 {
+    mem.stats.nrStrings++;
+    mem.recordAllocation(AllocationKind::string, sizeof(StringData) + size + 1);
     void * t = mem.allocBytes(sizeof(StringData) + size + 1);
     if (!t)
         throw std::bad_alloc();
@@ -233,6 +239,24 @@ EvalMemory::EvalMemory()
     assertGCInitialized();
 }
 
+void EvalMemory::setAllocationSampler(AllocationSampler * sampler)
+{
+    allocationSampler = sampler;
+    bytesUntilSample = sampleInterval = allocationSampler ? 0 : std::numeric_limits<int64_t>::max();
+}
+
+void EvalMemory::sampleAllocation(AllocationKind kind)
+{
+    if (!allocationSampler) {
+        bytesUntilSample = sampleInterval = std::numeric_limits<int64_t>::max();
+        return;
+    }
+    auto bytes = sampleInterval - bytesUntilSample;
+    auto next = allocationSampler->sampleAllocation(kind, bytes);
+    bytesUntilSample = sampleInterval =
+        (int64_t) std::min<uint64_t>(next, std::numeric_limits<int64_t>::max() / 2);
+}
+
 EvalState::EvalState(
     const LookupPath & lookupPathFromArguments,
     ref<Store> store,
@@ -328,11 +352,17 @@ EvalState::EvalState(
     });
 #endif
 
+    if (settings.evalArena)
+        enableEvalArena(settings.evalArenaSize, settings.evalArenaFallback);
+
     corepkgsFS->setPathDisplay("<nix", ">");
     internalFS->setPathDisplay("«nix-internal»", "");
 
     countCalls = getEnv("NIX_COUNT_CALLS").value_or("0") != "0";
 
+    if (settings.memoizeFunctions)
+        functionMemo = std::make_unique<FunctionMemo>(settings.memoizeThreshold);
+
     static_assert(sizeof(Env) <= 16, "environment must be <= 16 bytes");
 
     /* Construct the Nix expression search path. */
@@ -373,6 +403,10 @@ EvalState::EvalState(
         profiler.addProfiler(
             makeSampleStackProfiler(*this, settings.evalProfileFile.get(), settings.evalProfilerFrequency));
         break;
+    case EvalProfilerMode::memory:
+        profiler.addProfiler(
+            makeAllocationProfiler(*this, settings.evalProfileFile.get(), settings.evalProfilerMemoryInterval));
+        break;
     case EvalProfilerMode::disabled:
         break;
     }
@@ -878,6 +912,12 @@ DebugTraceStacker::DebugTraceStacker(EvalState & evalState, DebugTrace t)
 
 void Value::mkString(std::string_view s, EvalMemory & mem)
 {
+    /* The empty string is never allocated (see StringData::make()). */
+    if (!s.empty() && s.size() <= maxSmallStringSize) {
+        mem.stats.nrSmallStrings++;
+        setSmallString(s);
+        return;
+    }
     mkStringNoCopy(StringData::make(mem, s));
 }
 
@@ -887,7 +927,9 @@ Value::StringWithContext::Context::fromBuilder(const NixStringContext & context,
     if (context.empty())
         return nullptr;
 
-    auto ctx = new (mem.allocBytes(sizeof(Context) + context.size() * sizeof(value_type))) Context(context.size());
+    auto size = sizeof(Context) + context.size() * sizeof(value_type);
+    mem.recordAllocation(AllocationKind::string, size);
+    auto ctx = new (mem.allocBytes(size)) Context(context.size());
     std::ranges::transform(
         context, ctx->elems, [&](const NixStringContextElem & elt) { return &StringData::make(mem, elt.to_string()); });
     return ctx;
@@ -895,6 +937,10 @@ Value::StringWithContext::Context::fromBuilder(const NixStringContext & context,
 
 void Value::mkString(std::string_view s, const NixStringContext & context, EvalMemory & mem)
 {
+    if (context.empty()) {
+        mkString(s, mem);
+        return;
+    }
     mkStringNoCopy(StringData::make(mem, s), Value::StringWithContext::Context::fromBuilder(context, mem));
 }
 
@@ -903,6 +949,129 @@ void Value::mkStringMove(const StringData & s, const NixStringContext & context,
     mkStringNoCopy(s, Value::StringWithContext::Context::fromBuilder(context, mem));
 }
 
+const Value::StringWithContext::Context Value::StringWithContext::Context::unresolved{0};
+
+void Value::mkStringConcat(const Value & left, const Value & right, EvalMemory & mem)
+{
+    auto l = left.getStorage<StringWithContext>();
+    auto r = right.getStorage<StringWithContext>();
+    /* Small strings live in the values themselves, which may be
+       temporaries, so the rope needs its own copy of them. */
+    if (left.isSmallString())
+        l.str = &StringData::make(mem, left.string_view());
+    if (right.isSmallString())
+        r.str = &StringData::make(mem, right.string_view());
+    mem.recordAllocation(AllocationKind::string, sizeof(StringRope));
+    auto rope = new (mem.allocBytes(sizeof(StringRope))) StringRope{
+        .size_ = ((left.string_size() + right.string_size()) << StringData::sizeShift) | StringData::ropeFlag,
+        .left = l,
+        .right = r,
+        .mem = &mem,
+    };
+    setStorage(
+        StringWithContext{
+            .str = reinterpret_cast<const StringData *>(rope),
+            .context = l.context || r.context ? &StringWithContext::Context::unresolved : nullptr,
+        });
+}
+
+static const Value::StringRope & asRope(const StringData * str)
+{
+    assert(str->size_ & StringData::ropeFlag);
+    return *reinterpret_cast<const Value::StringRope *>(str);
+}
+
+/**
+ * Compute the concatenated string of a rope, or return it if it has
+ * been computed before.
+ */
+static const StringData & flattenRope(const Value::StringRope & rope)
+{
+    if (auto flat = rope.flat.load(std::memory_order_acquire))
+        return *flat;
+
+    auto & res = StringData::alloc(*rope.mem, StringData::decodeSize(rope.size_));
+    auto * out = res.data();
+
+    /* Ropes built by repeated concatenation are very deep, so don't
+       recurse. */
+    std::vector<const StringData *> todo{rope.right.str, rope.left.str};
+    while (!todo.empty()) {
+        auto str = todo.back();
+        todo.pop_back();
+        if (str->size_ & StringData::ropeFlag) {
+            auto & part = asRope(str);
+            if (!(str = part.flat.load(std::memory_order_acquire))) {
+                todo.push_back(part.right.str);
+                todo.push_back(part.left.str);
+                continue;
+            }
+        }
+        std::memcpy(out, str->data(), str->size());
+        out += str->size();
+    }
+    *out = '\0';
+
+    rope.flat.store(&res, std::memory_order_release);
+    return res;
+}
+
+/**
+ * Compute the context of a rope, or return it if it has been computed
+ * before.
+ */
+static const Value::StringWithContext::Context * resolveRopeContext(const Value::StringRope & rope)
+{
+    using Context = Value::StringWithContext::Context;
+
+    if (auto context = rope.context.load(std::memory_order_acquire))
+        return context;
+
+    NixStringContext context;
+    std::vector<Value::StringWithContext> todo{rope.right, rope.left};
+    while (!todo.empty()) {
+        auto part = todo.back();
+        todo.pop_back();
+        if (part.context == &Context::unresolved) {
+            auto & partRope = asRope(part.str);
+            if (!(part.context = partRope.context.load(std::memory_order_acquire))) {
+                todo.push_back(partRope.right);
+                todo.push_back(partRope.left);
+                continue;
+            }
+        }
+        if (part.context)
+            for (auto * elem : *part.context)
+                /* These have been parsed before, so this doesn't throw. */
+                context.insert(NixStringContextElem::parse(elem->view()));
+    }
+
+    auto res = Context::fromBuilder(context, *rope.mem);
+    rope.context.store(res, std::memory_order_release);
+    return res;
+}
+
+const StringData & Value::flattenString() const
+{
+    auto string = getStorage<StringWithContext>();
+    auto & rope = asRope(string.str);
+    auto & res = flattenRope(rope);
+    /* The rope is no longer reachable from this value, so resolve the
+       context now. */
+    if (string.context == &StringWithContext::Context::unresolved)
+        string.context = resolveRopeContext(rope);
+    const_cast<Value *>(this)->setStorage(StringWithContext{.str = &res, .context = string.context});
+    return res;
+}
+
+const Value::StringWithContext::Context * Value::resolveContext() const
+{
+    auto string = getStorage<StringWithContext>();
+    auto context = resolveRopeContext(asRope(string.str));
+    const_cast<Value *>(this)->setStorage(StringWithContext{.str = string.str, .context = context});
+    return context;
+}
+
 void Value::mkPath(const SourcePath & path, EvalMemory & mem)
 {
     mkPath(&*path.accessor, StringData::make(mem, path.path.abs()));
@@ -945,6 +1114,8 @@ ListBuilder::ListBuilder(EvalMemory & mem, size_t size)
     : size(size)
     , elems(size <= 2 ? inlineElems : (Value **) mem.allocBytes(size * sizeof(Value *)))
 {
+    if (size > 2)
+        mem.recordAllocation(AllocationKind::list, size * sizeof(Value *));
 }
 
 Value * EvalState::getBool(bool b)
@@ -969,6 +1140,7 @@ void EvalState::mkPos(Value & v, PosIdx p)
 {
     auto origin = positions.originOf(p);
     if (auto path = std::get_if<SourcePath>(&origin)) {
+        recordLocationDependency(*path);
         auto attrs = buildBindings(3);
         attrs.alloc(s.file).mkString(path->path.abs(), mem);
         makePositionThunks(*this, p, attrs.alloc(s.line), attrs.alloc(s.column));
@@ -1644,7 +1816,10 @@ void EvalState::callFunction(Value & fun, std::span<Value *> args, Value & vRes,
                                      lambda.name ? concatStrings("'", symbols[lambda.name], "'") : "anonymous lambda")
                                : nullptr;
 
-                lambda.body->eval(*this, env2, vCur);
+                if (functionMemo) [[unlikely]]
+                    evalLambdaBodyMemoized(lambda, env2, *args[0], vCur);
+                else
+                    lambda.body->eval(*this, env2, vCur);
             } catch (Error & e) {
                 if (loggerSettings.showTrace.get()) {
                     addErrorTrace(
@@ -1794,6 +1969,17 @@ void EvalState::incrFunctionCall(ExprLambda * fun)
     functionCalls[fun]++;
 }
 
+// Lifted out of callFunction() for the same reason.
+void EvalState::evalLambdaBodyMemoized(ExprLambda & lambda, Env & env, Value & arg, Value & v)
+{
+    FunctionMemo::Key key;
+    if (functionMemo->lookup(lambda, env.up, arg, key, v))
+        return;
+    lambda.body->eval(*this, env, v);
+    if (!key.empty())
+        functionMemo->record(lambda, std::move(key), v);
+}
+
 void EvalState::autoCallFunction(const Bindings & args, Value & fun, Value & res)
 {
     auto pos = fun.determinePos(noPos);
@@ -2085,6 +2271,12 @@ void EvalState::concatLists(Value & v, std::span<Value * const> lists, const Pos
     v.mkList(list);
 }
 
+/**
+ * Concatenations resulting in strings of at least this size produce
+ * ropes rather than flat strings.
+ */
+static constexpr size_t minRopeSize = 256;
+
 void ExprConcatStrings::eval(EvalState & state, Env & env, Value & v)
 {
     NixStringContext context;
@@ -2145,13 +2337,19 @@ void ExprConcatStrings::eval(EvalState & state, Env & env, Value & v)
         } else {
             if (strings.empty())
                 strings.reserve(es.size());
-            /* skip canonization of first path, which would only be not
-            canonized in the first place if it's coming from a ./${foo} type
-            path */
-            auto part = state.coerceToString(
-                i_pos, vTmp, context, "while evaluating a path segment", false, firstType == nString, !first);
-            sSize += part->size();
-            strings.emplace_back(std::move(part));
+            if (firstType == nString && vTmp.type() == nString) {
+                /* Strings are concatenated (maybe lazily) below. */
+                sSize += vTmp.string_size();
+                strings.emplace_back(std::string_view{});
+            } else {
+                /* skip canonization of first path, which would only be not
+                canonized in the first place if it's coming from a ./${foo} type
+                path */
+                auto part = state.coerceToString(
+                    i_pos, vTmp, context, "while evaluating a path segment", false, firstType == nString, !first);
+                sSize += part->size();
+                strings.emplace_back(std::move(part));
+            }
         }
 
         first = false;
@@ -2174,6 +2372,42 @@ void ExprConcatStrings::eval(EvalState & state, Env & env, Value & v)
         }
         v.mkPath(state.rootPath(CanonPath(resultStr)), state.mem);
     } else {
+        auto parts = std::span(values.data(), es.size());
+
+        /* Concatenate large strings lazily, to avoid copying the same
+           data over and over when strings are built up by repeated
+           concatenation. */
+        if (sSize >= minRopeSize && std::ranges::all_of(parts, [](Value & part) { return part.type() == nString; })) {
+            std::optional<Value> res;
+            for (auto & part : parts) {
+                /* Empty strings can still carry context (e.g. from
+                   `builtins.substring 0 0 drv.outPath`). */
+                if (part.string_size() == 0 && !part.context())
+                    continue;
+                if (res)
+                    res->mkStringConcat(Value(*res), part, state.mem);
+                else
+                    res = part;
+            }
+            v = *res;
+            return;
+        }
+
+        for (size_t i = 0; i < parts.size(); ++i)
+            if (parts[i].type() == nString) {
+                copyContext(parts[i], context);
+                strings[i] = parts[i].string_view();
+            }
+
+        if (sSize <= Value::maxSmallStringSize && context.empty()) {
+            /* Short enough to be stored in `v` itself. */
+            std::string resultStr;
+            for (const auto & part : strings)
+                resultStr += *part;
+            v.mkString(resultStr, state.mem);
+            return;
+        }
+
         auto & resultStr = StringData::alloc(state.mem, sSize);
         auto * tmp = resultStr.data();
         for (const auto & part : strings) {
@@ -2267,48 +2501,107 @@ void EvalState::tryFixupBlackHolePos(Value & v, PosIdx pos)
 
 void EvalState::forceValueDeep(Value & v)
 {
-    std::set<const Value *> seen;
+    boost::unordered_flat_set<const Value *> seen;
+
+    /**
+     * An attribute set or list whose elements are being forced. We
+     * use an explicit stack rather than recursion, since the values
+     * can be nested very deeply.
+     */
+    struct Frame
+    {
+        Value & v;
+
+        /**
+         * For attribute sets, the next attribute to force.
+         */
+        Bindings::const_iterator nextAttr;
+
+        /**
+         * For lists, the index of the next element to force.
+         */
+        size_t nextElem = 0;
+
+        /**
+         * The attribute being forced, or null for a list.
+         */
+        const Attr * attr = nullptr;
+
+        std::unique_ptr<DebugTraceStacker> dts;
+    };
+
+    std::vector<Frame> stack;
 
-    [&, &state(*this)](this const auto & recurse, Value & v) {
-        auto _level = state.addCallDepth(v.determinePos(noPos));
+    /* Debug traces must be popped in reverse order. */
+    Finally popFrames([&]() {
+        while (!stack.empty())
+            stack.pop_back();
+    });
 
+    /* Force `v` and, if it's an attribute set or list, push it to be
+       forced deeply. */
+    auto visit = [&](Value & v) {
         if (!seen.insert(&v).second)
             return;
 
-        state.forceValue(v, v.determinePos(noPos));
+        // Catch infinite recursion in lazily produced values, e.g.
+        // `let f = n: { inner = f (n + 1); }; in f 0`.
+        if (stack.size() > settings.maxCallDepth)
+            error<StackOverflowError>().atPos(v.determinePos(noPos)).debugThrow();
 
-        if (v.type() == nAttrs) {
-            for (auto & i : *v.attrs())
-                try {
-                    // If the value is a thunk, we're evaling. Otherwise no trace necessary.
-                    auto dts = state.debugRepl && i.value->isThunk() ? makeDebugTraceStacker(
-                                                                           state,
-                                                                           *i.value->thunk().expr,
-                                                                           *i.value->thunk().env,
-                                                                           i.pos,
-                                                                           "while evaluating the attribute '%1%'",
-                                                                           state.symbols[i.name])
-                                                                     : nullptr;
-
-                    recurse(*i.value);
-                } catch (Error & e) {
-                    state.addErrorTrace(e, i.pos, "while evaluating the attribute '%1%'", state.symbols[i.name]);
-                    throw;
+        forceValue(v, v.determinePos(noPos));
+
+        if (v.type() == nAttrs)
+            stack.push_back(Frame{.v = v, .nextAttr = v.attrs()->begin()});
+        else if (v.isList())
+            stack.push_back(Frame{.v = v});
+    };
+
+    try {
+        visit(v);
+
+        while (!stack.empty()) {
+            auto & frame = stack.back();
+            frame.dts.reset();
+
+            if (frame.v.type() == nAttrs) {
+                if (frame.nextAttr == frame.v.attrs()->end()) {
+                    stack.pop_back();
+                    continue;
                 }
-        }
+                auto & i = *frame.nextAttr++;
+                frame.attr = &i;
+                // If the value is a thunk, we're evaling. Otherwise no trace necessary.
+                if (debugRepl && i.value->isThunk())
+                    frame.dts = makeDebugTraceStacker(
+                        *this,
+                        *i.value->thunk().expr,
+                        *i.value->thunk().env,
+                        i.pos,
+                        "while evaluating the attribute '%1%'",
+                        symbols[i.name]);
+                visit(*i.value);
+            }
 
-        else if (v.isList()) {
-            size_t index = 0;
-            for (auto v2 : v.listView())
-                try {
-                    recurse(*v2);
-                    index++;
-                } catch (Error & e) {
-                    state.addErrorTrace(e, "while evaluating list element at index %1%", index);
-                    throw;
+            else {
+                if (frame.nextElem == frame.v.listSize()) {
+                    stack.pop_back();
+                    continue;
                 }
+                visit(*frame.v.listView()[frame.nextElem++]);
+            }
         }
-    }(v);
+    } catch (Error & e) {
+        /* Add a trace for every enclosing attribute and list element,
+           innermost first. */
+        for (auto & frame : std::views::reverse(stack)) {
+            if (frame.attr)
+                addErrorTrace(e, frame.attr->pos, "while evaluating the attribute '%1%'", symbols[frame.attr->name]);
+            else
+                addErrorTrace(e, "while evaluating list element at index %1%", frame.nextElem - 1);
+        }
+        throw;
+    }
 }
 
 NixInt EvalState::forceInt(Value & v, const PosIdx pos, std::string_view errorCtx)
@@ -2503,6 +2796,7 @@ BackedStringView EvalState::coerceToString(
         } else if (copyToStore) {
             return store->printStorePath(copyPathToStore(context, v.path()));
         } else {
+            recordLocationDependency(v.path());
             return std::string{v.path().path.abs()};
         }
     }
@@ -3060,6 +3354,7 @@ void EvalState::printStatistics()
         ms * 0.001;
     });
     auto gcCycles = getGCCycles();
+    auto gcStats = getGCStats();
 #endif
 
     auto outPath = getEnv("NIX_SHOW_STATS_PATH").value_or("-");
@@ -3090,6 +3385,10 @@ void EvalState::printStatistics()
         {"number", memstats.nrValues.load()},
         {"bytes", bValues},
     };
+    topObj["strings"] = {
+        {"number", memstats.nrStrings.load()},
+        {"inline", memstats.nrSmallStrings.load()},
+    };
     topObj["symbols"] = {
         {"number", symbols.size()},
         {"bytes", symbols.totalSize()},
@@ -3113,12 +3412,81 @@ void EvalState::printStatistics()
     topObj["nrPrimOpCalls"] = nrPrimOpCalls.load();
     topObj["nrFunctionCalls"] = nrFunctionCalls.load();
 #if NIX_USE_BOEHMGC
+    auto toSeconds = [](std::chrono::nanoseconds d) { return std::chrono::duration<double>(d).count(); };
     topObj["gc"] = {
         {"heapSize", heapSize},
+        {"initialHeapSize", gcStats.initialHeapSize},
+        {"heapGrowths", gcStats.heapGrowths},
         {"totalBytes", totalBytes},
         {"cycles", gcCycles},
+        {"pauseTotal", toSeconds(gcStats.totalPause)},
+        {"pauseMax", toSeconds(gcStats.maxPause)},
     };
+    auto & collections = topObj["gc"]["collections"] = json::array();
+    for (auto & cycle : gcStats.cycles)
+        collections.push_back({
+            {"pause", toSeconds(cycle.pause)},
+            {"time", toSeconds(cycle.duration)},
+            {"heapSize", cycle.heapSize},
+        });
 #endif
+    if (auto arenaStats = getEvalArenaStats(); arenaStats.enabled)
+        topObj["arena"] = {
+            {"bytes", arenaStats.bytes},
+            {"full", arenaStats.full},
+        };
+
+    if (functionMemo) {
+        auto memoStats = functionMemo->getStats();
+        std::erase_if(memoStats, [](auto & i) { return i.second.lookups == 0; });
+        std::sort(memoStats.begin(), memoStats.end(), [](auto & a, auto & b) {
+            return a.second.hits > b.second.hits;
+        });
+
+        uint64_t lookups = 0, hits = 0, entries = 0;
+        for (auto & [fun, stats] : memoStats) {
+            lookups += stats.lookups;
+            hits += stats.hits;
+            entries += stats.entries;
+        }
+
+        auto & memo = topObj["memoization"] = {
+            {"lookups", lookups},
+            {"hits", hits},
+            {"entries", entries},
+        };
+        auto & list = memo["functions"] = json::array();
+        for (auto & [fun, stats] : memoStats) {
+            json obj = json::object();
+            if (fun->name)
+                obj["name"] = (std::string_view) symbols[fun->name];
+            else
+                obj["name"] = nullptr;
+            if (auto pos = positions[fun->pos]) {
+                if (auto path = std::get_if<SourcePath>(&pos.origin))
+                    obj["file"] = path->to_string();
+                obj["line"] = pos.line;
+                obj["column"] = pos.column;
+            }
+            obj["calls"] = stats.calls;
+            obj["lookups"] = stats.lookups;
+            obj["hits"] = stats.hits;
+            obj["entries"] = stats.entries;
+            obj["disabled"] = stats.disabled;
+            list.push_back(obj);
+        }
+    }
+
+    if (auto cache = fetchSettings.getCacheIfOpen()) {
+        auto cacheStats = cache->getStats();
+        topObj["fetcherCache"] = {
+            {"hits", cacheStats.hits},
+            {"misses", cacheStats.misses},
+            {"upserts", cacheStats.upserts},
+            {"flushes", cacheStats.flushes},
+            {"lockWaitTime", std::chrono::duration<float>(cacheStats.lockWaitTime).count()},
+        };
+    }
 
     if (countCalls) {
         topObj["primops"] = primOpCalls;
@@ -0,0 +1,277 @@
+#include "nix/expr/function-memo.hh"
+#include "nix/expr/attr-set.hh"
+
+#include <boost/container_hash/hash.hpp>
+
+#include <bit>
+#include <cstring>
+
+namespace nix {
+
+namespace {
+
+enum KeyTag : uintptr_t {
+    ktInt = 1,
+    ktFloat,
+    ktBool,
+    ktNull,
+    ktString,
+    ktStringData,
+    ktPath,
+    ktPathData,
+    ktAttrs,
+    ktAttrsIdentity,
+    ktList,
+    ktListIdentity,
+    ktLambda,
+    ktPrimOp,
+    ktPrimOpApp,
+    ktThunk,
+    ktApp,
+    ktExternal,
+    ktFailed,
+};
+
+/**
+ * The maximum number of values in an argument that are compared by
+ * value. Beyond that, values are compared by identity.
+ */
+constexpr unsigned int maxKeyValues = 16;
+
+/**
+ * The maximum length of strings and paths that are compared by value.
+ */
+constexpr size_t maxKeyStringSize = 256;
+
+/**
+ * The number of lookups after which a lambda stops being memoized if
+ * fewer than 1 in `minHitRatio` of them were hits.
+ */
+constexpr uint64_t probationLookups = 1024;
+constexpr uint64_t minHitRatio = 16;
+
+void appendPointer(FunctionMemo::Key & key, const void * p)
+{
+    key.push_back((uintptr_t) p);
+}
+
+void appendUInt64(FunctionMemo::Key & key, uint64_t n)
+{
+    key.push_back((uintptr_t) n);
+    if constexpr (sizeof(uintptr_t) < sizeof(uint64_t))
+        key.push_back((uintptr_t) (n >> 32));
+}
+
+void appendString(FunctionMemo::Key & key, std::string_view s)
+{
+    key.push_back(s.size());
+    for (size_t i = 0; i < s.size(); i += sizeof(uintptr_t)) {
+        uintptr_t word = 0;
+        std::memcpy(&word, s.data() + i, std::min(sizeof(uintptr_t), s.size() - i));
+        key.push_back(word);
+    }
+}
+
+/**
+ * Append a key identifying `v` to `key`, or return `false` if `v`
+ * can't be identified. The key must not depend on the address of `v`
+ * itself, since it may be a temporary. Only pointers to heap objects
+ * that are never mutated (other than by forcing a thunk) are used.
+ */
+bool appendValue(FunctionMemo::Key & key, const Value & v, unsigned int & budget)
+{
+    bool byValue = budget > 0;
+    if (byValue)
+        budget--;
+
+    switch (v.type()) {
+    case nInt:
+        key.push_back(ktInt);
+        appendUInt64(key, v.integer().value);
+        break;
+
+    case nFloat:
+        key.push_back(ktFloat);
+        appendUInt64(key, std::bit_cast<uint64_t>(v.fpoint()));
+        break;
+
+    case nBool:
+        key.push_back(ktBool);
+        key.push_back(v.boolean());
+        break;
+
+    case nNull:
+        key.push_back(ktNull);
+        break;
+
+    case nString:
+        /* Note that small strings are stored in the value itself, but
+           they're always compared by value since they have no
+           context. */
+        if (v.string_size() <= maxKeyStringSize && !v.context()) {
+            key.push_back(ktString);
+            appendString(key, v.string_view());
+        } else {
+            key.push_back(ktStringData);
+            appendPointer(key, &v.string_data());
+            appendPointer(key, v.context());
+        }
+        break;
+
+    case nPath:
+        if (v.pathStrView().size() <= maxKeyStringSize) {
+            key.push_back(ktPath);
+            appendPointer(key, v.pathAccessor());
+            appendString(key, v.pathStrView());
+        } else {
+            key.push_back(ktPathData);
+            appendPointer(key, v.pathAccessor());
+            appendPointer(key, v.pathStrView().data());
+        }
+        break;
+
+    case nAttrs:
+        if (byValue && v.attrs()->size() <= budget) {
+            key.push_back(ktAttrs);
+            key.push_back(v.attrs()->size());
+            for (auto & attr : *v.attrs()) {
+                key.push_back(attr.name.getId());
+                if (!appendValue(key, *attr.value, budget))
+                    return false;
+            }
+        } else {
+            key.push_back(ktAttrsIdentity);
+            appendPointer(key, v.attrs());
+        }
+        break;
+
+    case nList: {
+        auto list = v.listView();
+        if (byValue && list.size() <= budget) {
+            key.push_back(ktList);
+            key.push_back(list.size());
+            for (auto elem : list)
+                if (!appendValue(key, *elem, budget))
+                    return false;
+        } else {
+            key.push_back(ktListIdentity);
+            key.push_back(list.size());
+            /* Lists of up to two elements are stored in the value
+               itself, so use the addresses of the elements. */
+            if (list.size() <= 2)
+                for (auto elem : list)
+                    appendPointer(key, elem);
+            else
+                appendPointer(key, list.data());
+        }
+        break;
+    }
+
+    case nFunction:
+        if (v.isLambda()) {
+            key.push_back(ktLambda);
+            appendPointer(key, v.lambda().fun);
+            appendPointer(key, v.lambda().env);
+        } else if (v.isPrimOp()) {
+            key.push_back(ktPrimOp);
+            appendPointer(key, v.primOp());
+        } else {
+            key.push_back(ktPrimOpApp);
+            appendPointer(key, v.primOpApp().left);
+            appendPointer(key, v.primOpApp().right);
+        }
+        break;
+
+    case nThunk:
+        /* A thunk that is being evaluated no longer refers to its
+           expression. */
+        if (v.isBlackhole())
+            return false;
+        if (v.isApp()) {
+            key.push_back(ktApp);
+            appendPointer(key, v.app().left);
+            appendPointer(key, v.app().right);
+        } else {
+            key.push_back(ktThunk);
+            appendPointer(key, v.thunk().env);
+            appendPointer(key, v.thunk().expr);
+        }
+        break;
+
+    case nExternal:
+        key.push_back(ktExternal);
+        appendPointer(key, v.external());
+        break;
+
+    case nFailed:
+        key.push_back(ktFailed);
+        appendPointer(key, &v.failed());
+        break;
+    }
+
+    return true;
+}
+
+} // namespace
+
+size_t FunctionMemo::KeyHash::operator()(const Key & key) const noexcept
+{
+    return boost::hash_range(key.begin(), key.end());
+}
+
+FunctionMemo::FunctionMemo(unsigned int threshold)
+    : threshold(threshold)
+{
+}
+
+bool FunctionMemo::lookup(const ExprLambda & fun, Env * env, const Value & arg, Key & key, Value & res)
+{
+    auto & memo = lambdas[&fun];
+
+    key.clear();
+
+    if (memo.stats.disabled || ++memo.stats.calls < threshold)
+        return false;
+
+    appendPointer(key, env);
+    unsigned int budget = maxKeyValues;
+    if (!appendValue(key, arg, budget)) {
+        key.clear();
+        return false;
+    }
+
+    memo.stats.lookups++;
+
+    if (auto i = memo.results.find(key); i != memo.results.end()) {
+        memo.stats.hits++;
+        res = i->second;
+        key.clear();
+        return true;
+    }
+
+    if (memo.stats.lookups >= probationLookups && memo.stats.hits * minHitRatio < memo.stats.lookups) {
+        memo.stats.disabled = true;
+        memo.results = {};
+        key.clear();
+    }
+
+    return false;
+}
+
+void FunctionMemo::record(const ExprLambda & fun, Key && key, const Value & res)
+{
+    lambdas[&fun].results.insert_or_assign(std::move(key), res);
+}
+
+std::vector<std::pair<const ExprLambda *, FunctionMemo::LambdaStats>> FunctionMemo::getStats() const
+{
+    std::vector<std::pair<const ExprLambda *, LambdaStats>> stats;
+    for (auto & [fun, memo] : lambdas) {
+        auto s = memo.stats;
+        s.entries = memo.results.size();
+        stats.emplace_back(fun, s);
+    }
+    return stats;
+}
+
+} // namespace nix
@@ -8,6 +8,7 @@
 #include <boost/iterator/function_output_iterator.hpp>
 
 #include <algorithm>
+#include <atomic>
 #include <functional>
 #include <ranges>
 #include <optional>
@@ -89,7 +90,21 @@ private:
     /**
      * Length of the layers list.
      */
-    uint32_t numLayers = 1;
+    uint32_t numLayers : 4 = 1;
+
+    /**
+     * Whether a word is reserved after the attrs FAM for a lookup
+     * index (@see indexSlot). This is only the case for Bindings
+     * allocated with a capacity of at least @ref minIndexedSize.
+     */
+    uint32_t hasIndexSlot : 1 = 0;
+
+    /**
+     * Number of allocated but not yet used elements of the attrs FAM,
+     * used to locate the index slot. Only maintained if @ref
+     * hasIndexSlot is set.
+     */
+    uint32_t unusedCapacity : 27 = 0;
 
     /**
      * Bindings that this attrset is "layered" on top of.
@@ -116,7 +131,48 @@ private:
      */
     static constexpr unsigned maxLayers = 8;
 
+    /**
+     * The word after the used part of the attrs FAM. It is zero if
+     * the Bindings hasn't been looked up yet, `(n << 1) | 1` after `n`
+     * lookups, and otherwise points to the `Index` that was built
+     * after enough lookups.
+     */
+    std::atomic_ref<uintptr_t> indexSlot() const noexcept
+    {
+        return std::atomic_ref<uintptr_t>(
+            *reinterpret_cast<uintptr_t *>(const_cast<Attr *>(attrs) + numAttrs + unusedCapacity));
+    }
+
+    /**
+     * Look up an attribute in this layer by binary search.
+     */
+    const Attr * getInLayer(Symbol name) const noexcept
+    {
+        auto key = Attr{name, nullptr};
+        auto first = attrs;
+        auto last = first + numAttrs;
+        const Attr * i = std::lower_bound(first, last, key);
+        if (i != last && i->name == name)
+            return i;
+        return nullptr;
+    }
+
+    struct Index;
+
+    /**
+     * Look up an attribute in this layer through its index, building
+     * the index if it has been looked up often enough.
+     */
+    const Attr * getIndexed(Symbol name) const noexcept;
+
 public:
+    /**
+     * Bindings allocated with at least this capacity get a hash index
+     * over their attribute names once they have been looked up
+     * sufficiently often, making lookups constant-time rather than
+     * logarithmic. Smaller Bindings are not affected.
+     */
+    static constexpr size_type minIndexedSize = 64;
     size_type size() const
     {
         return numAttrsInChain;
@@ -343,8 +399,19 @@ public:
 
     void push_back(const Attr & attr)
     {
+        if (hasIndexSlot) {
+            /* Don't let the attribute overwrite the index slot if the
+               Bindings is overfilled. */
+            if (unusedCapacity == 0)
+                hasIndexSlot = 0;
+            else
+                --unusedCapacity;
+        }
         attrs[numAttrs++] = attr;
         numAttrsInChain = numAttrs;
+        /* Any index built so far is stale. */
+        if (hasIndexSlot)
+            indexSlot().store(0, std::memory_order_relaxed);
     }
 
     /**
@@ -352,18 +419,11 @@ public:
      */
     const Attr * get(Symbol name) const noexcept
     {
-        auto getInChunk = [key = Attr{name, nullptr}](const Bindings & chunk) -> const Attr * {
-            auto first = chunk.attrs;
-            auto last = first + chunk.numAttrs;
-            const Attr * i = std::lower_bound(first, last, key);
-            if (i != last && i->name == key.name)
-                return i;
-            return nullptr;
-        };
-
         const Bindings * currentChunk = this;
         while (currentChunk) {
-            const Attr * maybeAttr = getInChunk(*currentChunk);
+            const Attr * maybeAttr = currentChunk->hasIndexSlot && currentChunk->numAttrs >= minIndexedSize
+                                         ? currentChunk->getIndexed(name)
+                                         : currentChunk->getInLayer(name);
             if (maybeAttr)
                 return maybeAttr;
             currentChunk = currentChunk->baseLayer;
@@ -432,6 +492,11 @@ public:
     friend class EvalMemory;
 };
 
+static_assert(
+    sizeof(Bindings) == 4 * sizeof(uint32_t) + sizeof(Bindings *),
+    "Bindings are allocated for every attribute set, so avoid growing them. "
+    "Data that is only needed by large attribute sets belongs after the attrs FAM.");
+
 static_assert(std::forward_iterator<Bindings::iterator>);
 static_assert(std::ranges::forward_range<Bindings>);
 
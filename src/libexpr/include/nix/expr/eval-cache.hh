@@ -7,6 +7,7 @@
 #include "nix/expr/attr-path.hh"
 
 #include <functional>
+#include <set>
 #include <variant>
 
 namespace nix::eval_cache {
@@ -14,6 +15,94 @@ namespace nix::eval_cache {
 struct AttrDb;
 class AttrCursor;
 
+/**
+ * A log of the accesses to a source tree that is not identified by a
+ * revision (such as a Git working directory with uncommitted changes),
+ * used to determine which evaluation cache entries are still valid
+ * after the tree has changed.
+ *
+ * Since thunks are shared between attributes, the cache considers an
+ * attribute to depend on every access made before the attribute was
+ * computed, not just the accesses made while computing it.
+ */
+class FileDependencies : public std::enable_shared_from_this<FileDependencies>
+{
+public:
+
+    struct Dependency
+    {
+        enum Kind : int {
+            /**
+             * The contents of a regular file.
+             */
+            Contents = 0,
+            /**
+             * The entries of a directory.
+             */
+            Listing = 1,
+            /**
+             * The type of a file, or whether it exists at all.
+             */
+            Stat = 2,
+            /**
+             * The target of a symlink.
+             */
+            Link = 3,
+            /**
+             * The entire tree. This is recorded when something reveals
+             * the store path or NAR hash of the tree.
+             */
+            Tree = 4,
+        };
+
+        Kind kind;
+        CanonPath path;
+        std::string value;
+    };
+
+private:
+
+    ref<SourceAccessor> next;
+
+    /**
+     * Identifies the current contents of the entire tree, i.e. its
+     * store path.
+     */
+    std::string treeId;
+
+    struct State
+    {
+        std::vector<Dependency> log;
+        std::set<std::pair<Dependency::Kind, CanonPath>> seen;
+    };
+
+    Sync<State> state_;
+
+public:
+
+    FileDependencies(ref<SourceAccessor> next, std::string treeId);
+
+    /**
+     * Return an accessor to the tree that records every access.
+     */
+    ref<SourceAccessor> getAccessor();
+
+    void record(Dependency::Kind kind, const CanonPath & path, std::string value);
+
+    void recordTree();
+
+    /**
+     * Return the current value of a dependency, without recording
+     * it. Throws if the file can't be accessed in the requested way.
+     */
+    std::string observe(Dependency::Kind kind, const CanonPath & path);
+
+    /**
+     * Return the accesses recorded since the first `from` accesses.
+     */
+    std::vector<Dependency> getLog(size_t from);
+};
+
 struct CachedEvalError : CloneableError<CachedEvalError, EvalError>
 {
     const ref<AttrCursor> cursor;
@@ -44,7 +133,16 @@ class EvalCache : public std::enable_shared_from_this<EvalCache>
 
 public:
 
-    EvalCache(std::optional<std::reference_wrapper<const Hash>> useCache, EvalState & state, RootLoader rootLoader);
+    /**
+     * @param fileDeps If set, cached attributes are only used as long
+     * as the files they depend on haven't changed, so `useCache` need
+     * not identify the contents of the tree.
+     */
+    EvalCache(
+        std::optional<std::reference_wrapper<const Hash>> useCache,
+        EvalState & state,
+        RootLoader rootLoader,
+        std::shared_ptr<FileDependencies> fileDeps = nullptr);
 
     ref<AttrCursor> getRoot();
 };
@@ -78,6 +176,17 @@ struct int_t
     NixInt x;
 };
 
+/**
+ * A package below an attribute, as found by `nix search`.
+ */
+struct SearchIndexEntry
+{
+    std::string attrPath;
+    std::string pname;
+    std::string version;
+    std::string description;
+};
+
 typedef uint64_t AttrId;
 typedef std::pair<AttrId, Symbol> AttrKey;
 typedef std::pair<std::string, NixStringContext> string_t;
@@ -169,6 +278,24 @@ public:
      * Force creation of the .drv file in the Nix store.
      */
     StorePath forceDerivation();
+
+    /**
+     * Return the packages stored by `putSearchIndex()` for this
+     * attribute, in the order in which they were stored, or
+     * `std::nullopt` if there are none. Only packages that contain
+     * every string in `literals` (ignoring case) in their attribute
+     * path, name or description are guaranteed to be returned; others
+     * may be omitted.
+     */
+    std::optional<std::vector<SearchIndexEntry>> querySearchIndex(const std::vector<std::string> & literals);
+
+    /**
+     * Store the packages found by a complete traversal of this
+     * attribute, along with a trigram index of their attribute paths,
+     * names and descriptions, so that subsequent searches don't need
+     * to traverse the attribute again.
+     */
+    void putSearchIndex(const std::vector<SearchIndexEntry> & entries);
 };
 
 } // namespace nix::eval_cache
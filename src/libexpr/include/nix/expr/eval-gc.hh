@@ -1,7 +1,10 @@
 #pragma once
 ///@file
 
+#include <atomic>
+#include <chrono>
 #include <cstddef>
+#include <vector>
 
 // For `NIX_USE_BOEHMGC`
 #include "nix/expr/config.hh"
@@ -55,6 +58,92 @@ void assertGCInitialized();
  * The number of GC cycles since initGC().
  */
 size_t getGCCycles();
+
+struct GCCycleStats
+{
+    /**
+     * The time during which the world was stopped, including any
+     * incremental steps since the previous collection.
+     */
+    std::chrono::nanoseconds pause;
+
+    /**
+     * The time from the start to the end of the collection.
+     */
+    std::chrono::nanoseconds duration;
+
+    /**
+     * The size of the heap after the collection.
+     */
+    size_t heapSize;
+};
+
+struct GCStats
+{
+    /**
+     * The collections since initGC(). These are only recorded if
+     * `NIX_SHOW_STATS` is set, and only for the first 65536
+     * collections.
+     */
+    std::vector<GCCycleStats> cycles;
+
+    std::chrono::nanoseconds totalPause{0};
+    std::chrono::nanoseconds maxPause{0};
+
+    size_t initialHeapSize = 0;
+
+    /**
+     * The number of times the heap has grown since initGC().
+     */
+    size_t heapGrowths = 0;
+};
+
+GCStats getGCStats();
 #endif
 
+/**
+ * Whether evaluation memory is currently allocated from the arena
+ * (see `enableEvalArena()`).
+ */
+extern std::atomic<bool> evalArenaActive;
+
+/**
+ * Allocate all subsequent evaluation memory (i.e. everything allocated
+ * through `EvalMemory`) from an arena of at most `limit` bytes that is
+ * never freed, and disable garbage collection. Each thread
+ * bump-allocates from its own chunk of the arena.
+ *
+ * Once the arena is full, we either fall back to the garbage collector
+ * (which then treats the arena as a root) or throw an error, depending
+ * on `fallback`.
+ *
+ * This can only be done once per process; subsequent calls have no
+ * effect.
+ */
+void enableEvalArena(size_t limit, bool fallback);
+
+/**
+ * Allocate `n` zeroed bytes from the evaluation arena. Returns
+ * `nullptr` if the arena is no longer in use, in which case the caller
+ * should use the regular allocator.
+ */
+void * allocFromEvalArena(size_t n);
+
+struct EvalArenaStats
+{
+    bool enabled = false;
+
+    /**
+     * Whether the arena became full.
+     */
+    bool full = false;
+
+    /**
+     * The number of bytes taken from the arena.
+     */
+    size_t bytes = 0;
+};
+
+EvalArenaStats getEvalArenaStats();
+
 } // namespace nix
@@ -16,6 +16,8 @@ namespace nix {
 inline void * EvalMemory::allocBytes(size_t n)
 {
     void * p;
+    if (evalArenaActive.load(std::memory_order_relaxed) && (p = allocFromEvalArena(n)))
+        return p;
 #if NIX_USE_BOEHMGC
     p = GC_MALLOC(n);
 #else
@@ -29,6 +31,13 @@ inline void * EvalMemory::allocBytes(size_t n)
 [[gnu::always_inline]]
 Value * EvalMemory::allocValue()
 {
+    stats.nrValues++;
+    recordAllocation(AllocationKind::value, sizeof(Value));
+
+    if (evalArenaActive.load(std::memory_order_relaxed))
+        if (auto p = allocFromEvalArena(sizeof(Value)))
+            return (Value *) p;
+
 #if NIX_USE_BOEHMGC
     /* Allocation cache for GC'd Value objects. Boehm GC is already a global resource, so thread_local is
        a natural solution. Multiple EvalState instances on the same thread will reuse the same cache. */
@@ -54,7 +63,6 @@ Value * EvalMemory::allocValue()
     void * p = allocBytes(sizeof(Value));
 #endif
 
-    stats.nrValues++;
     return (Value *) p;
 }
 
@@ -63,11 +71,12 @@ Env & EvalMemory::allocEnv(size_t size)
 {
     stats.nrEnvs++;
     stats.nrValuesInEnvs += size;
+    recordAllocation(AllocationKind::env, sizeof(Env) + size * sizeof(Value *));
 
     Env * env;
 
 #if NIX_USE_BOEHMGC
-    if (size == 1) {
+    if (size == 1 && !evalArenaActive.load(std::memory_order_relaxed)) {
         /* Allocation cache for size-1 Env objects. Boehm GC is already a global resource, so thread_local is
            a natural solution. Multiple EvalState instances on the same thread will reuse the same cache. */
         static thread_local std::shared_ptr<void *> env1AllocCache{
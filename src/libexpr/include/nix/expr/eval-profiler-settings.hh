@@ -5,7 +5,7 @@
 
 namespace nix {
 
-enum struct EvalProfilerMode { disabled, flamegraph };
+enum struct EvalProfilerMode { disabled, flamegraph, memory };
 
 NIX_DECLARE_CONFIG_SERIALISER(EvalProfilerMode)
 
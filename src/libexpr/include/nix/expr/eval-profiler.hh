@@ -7,6 +7,7 @@
 
 #include "nix/util/ref.hh"
 
+#include <cstdint>
 #include <vector>
 #include <span>
 #include <bitset>
@@ -109,6 +110,38 @@ public:
     postFunctionCallHook(EvalState & state, const Value & v, std::span<Value *> args, const PosIdx pos) override;
 };
 
+/**
+ * The kinds of evaluator memory distinguished by allocation profiles.
+ */
+enum struct AllocationKind { value, env, attrset, list, string };
+
+/**
+ * Receives samples of evaluator memory allocations from `EvalMemory`.
+ */
+class AllocationSampler
+{
+public:
+    virtual ~AllocationSampler() = default;
+
+    /**
+     * Called for the allocation that made the number of bytes allocated
+     * since the previous sample exceed the sampling interval.
+     *
+     * @param kind What the allocation that triggered the sample is for.
+     * @param bytes Number of bytes allocated since the previous sample,
+     *   including this allocation.
+     * @return Number of bytes to allocate before taking the next sample.
+     */
+    virtual uint64_t sampleAllocation(AllocationKind kind, uint64_t bytes) = 0;
+};
+
 ref<EvalProfiler> makeSampleStackProfiler(EvalState & state, std::filesystem::path profileFile, uint64_t frequency);
 
+/**
+ * Make a profiler that attributes evaluator memory allocations to the
+ * call stack, taking a sample every `interval` allocated bytes on
+ * average. It registers itself with `state.mem`.
+ */
+ref<EvalProfiler> makeAllocationProfiler(EvalState & state, std::filesystem::path profileFile, uint64_t interval);
+
 } // namespace nix
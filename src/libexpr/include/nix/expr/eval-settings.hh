@@ -269,6 +269,7 @@ struct EvalSettings : Config
           Enables evaluation profiling. The following modes are supported:
 
           * `flamegraph` stack sampling profiler. Outputs folded format, one line per stack (suitable for `flamegraph.pl` and compatible tools).
+          * `memory` allocation profiler. Attributes the memory allocated by the evaluator (values, environments, attribute sets, lists and strings) to the function call stack, sampling every [`eval-profiler-memory-interval`](#conf-eval-profiler-memory-interval) bytes on average. Outputs the same format as `flamegraph`, with sizes in bytes instead of sample counts.
 
           Use [`eval-profile-file`](#conf-eval-profile-file) to specify where the profile is saved.
 
@@ -293,6 +294,15 @@ struct EvalSettings : Config
           See [`eval-profiler`](#conf-eval-profiler).
         )"};
 
+    Setting<uint64_t> evalProfilerMemoryInterval{
+        this,
+        128 * 1024,
+        "eval-profiler-memory-interval",
+        R"(
+          Specifies the average number of bytes allocated between two samples of the `memory` [evaluation profiler](#conf-eval-profiler).
+          Use `0` to sample every allocation.
+        )"};
+
     Setting<bool> useEvalCache{
         this,
         true,
@@ -301,6 +311,8 @@ struct EvalSettings : Config
             Whether to use the flake evaluation cache.
             Certain commands won't have to evaluate when invoked for the second time with a particular version of a flake.
             Intermediate results are not cached.
+
+            For a local flake with uncommitted changes, a cached attribute is reused as long as the files read before it was computed haven't changed.
         )"};
 
     Setting<bool> ignoreExceptionsDuringTry{
@@ -473,6 +485,86 @@ struct EvalSettings : Config
           The default value is chosen to balance performance and memory usage. On 32 bit systems
           where memory is scarce, the default is a large value to reduce the amount of allocations.
     )"};
+
+    Setting<bool> evalArena{
+        this,
+        false,
+        "eval-arena",
+        R"(
+          If set to `true`, memory for values, environments, attribute sets, lists and
+          strings is bump-allocated from a large arena, and garbage collection is
+          disabled. Memory is then never freed until Nix exits.
+
+          This avoids the overhead of garbage collection, which makes short-lived
+          evaluations (such as a single `nix eval` or `nix-instantiate`) faster, at the
+          cost of a higher peak memory usage. It is not suitable for long-running
+          processes like [`nix repl`](@docroot@/command-ref/new-cli/nix3-repl.md).
+
+          The size of the arena is limited by [`eval-arena-size`](#conf-eval-arena-size).
+        )"};
+
+    Setting<uint64_t> evalArenaSize{
+        this,
+        sizeof(void *) >= 8 ? uint64_t(8) << 30 : uint64_t(64) << 20,
+        "eval-arena-size",
+        R"(
+          The maximum number of bytes that can be allocated from the arena if
+          [`eval-arena`](#conf-eval-arena) is enabled. This much address space is
+          reserved up front, but memory is only used as it's allocated.
+
+          What happens when the arena is full is determined by
+          [`eval-arena-fallback`](#conf-eval-arena-fallback).
+        )"};
+
+    Setting<bool> evalArenaFallback{
+        this,
+        true,
+        "eval-arena-fallback",
+        R"(
+          If set to `true`, evaluation switches to garbage-collected memory once the
+          arena (see [`eval-arena`](#conf-eval-arena)) is full. Otherwise, evaluation
+          is aborted with an error.
+        )"};
+
+    Setting<bool> memoizeFunctions{
+        this,
+        false,
+        "eval-memoize-functions",
+        R"(
+          If set to `true`, the evaluator caches the results of function calls, and
+          reuses them when a function is called again with the same closure and the same
+          argument. This is experimental, and is intended to measure and reduce the cost
+          of functions that are repeatedly applied to the same arguments, such as in the
+          NixOS module system.
+
+          Arguments that have already been evaluated to small values (such as numbers,
+          strings without context, and small attribute sets and lists of those) are
+          compared by value. Other arguments are compared by identity, e.g. two
+          attribute sets are only considered the same if they're the result of the same
+          evaluation.
+
+          A function is only memoized once it has been called
+          [`eval-memoize-threshold`](#conf-eval-memoize-threshold) times, and stops
+          being memoized if few of its calls are found in the cache. Cached results and
+          the arguments they're keyed on are never freed by garbage collection, so this
+          can increase memory usage considerably.
+
+          Since the body of a memoized function isn't evaluated again, side effects
+          such as [`builtins.trace`](@docroot@/language/builtins.md#builtins-trace)
+          happen only once per distinct argument.
+
+          Statistics about memoized functions are included in the output of
+          [`NIX_SHOW_STATS`](@docroot@/command-ref/env-common.md#env-NIX_SHOW_STATS).
+        )"};
+
+    Setting<unsigned int> memoizeThreshold{
+        this,
+        64,
+        "eval-memoize-threshold",
+        R"(
+          The number of times a function must be called before its calls are memoized,
+          if [`eval-memoize-functions`](#conf-eval-memoize-functions) is enabled.
+        )"};
 };
 
 /**
@@ -47,6 +47,7 @@ struct Input;
 } // namespace fetchers
 struct EvalSettings;
 class EvalState;
+class FunctionMemo;
 class StorePath;
 struct SingleDerivedPath;
 enum RepairFlag : bool;
@@ -55,6 +56,7 @@ struct MountedSourceAccessor;
 
 namespace eval_cache {
 class EvalCache;
+class FileDependencies;
 }
 
 /**
@@ -315,6 +317,12 @@ public:
         Counter nrAttrsets;
         Counter nrAttrsInAttrsets;
         Counter nrListElems;
+        Counter nrStrings;
+        /**
+         * Strings stored inline in a `Value` (@see Value::mkString),
+         * i.e. string allocations avoided.
+         */
+        Counter nrSmallStrings;
     };
 
     EvalMemory();
@@ -346,13 +354,45 @@ public:
         return stats;
     }
 
+    /**
+     * Report allocations to `sampler` (@see recordAllocation), or stop
+     * doing so if it's null. The sampler must unset itself before it's
+     * destroyed.
+     */
+    void setAllocationSampler(AllocationSampler * sampler);
+
+    /**
+     * Account for an allocation of `n` bytes in allocation profiles.
+     * This is a no-op unless an `AllocationSampler` is set.
+     */
+    [[gnu::always_inline]]
+    void recordAllocation(AllocationKind kind, size_t n)
+    {
+        if ((bytesUntilSample -= n) < 0) [[unlikely]]
+            sampleAllocation(kind);
+    }
+
     /**
      * Storage for the AST nodes
      */
     Exprs exprs;
 
 private:
+    friend class StringData;
+    friend struct Value;
+
     Statistics stats;
+
+    AllocationSampler * allocationSampler = nullptr;
+
+    /**
+     * The number of bytes after which `allocationSampler` should
+     * take the next sample, and the number it was last set to.
+     */
+    int64_t bytesUntilSample = std::numeric_limits<int64_t>::max();
+    int64_t sampleInterval = std::numeric_limits<int64_t>::max();
+
+    [[gnu::noinline]] void sampleAllocation(AllocationKind kind);
 };
 
 class EvalState : public std::enable_shared_from_this<EvalState>
@@ -368,6 +408,12 @@ public:
 
     EvalMemory mem;
 
+    /**
+     * The results of function calls, if `eval-memoize-functions` is
+     * enabled.
+     */
+    std::unique_ptr<FunctionMemo> functionMemo;
+
     /**
      * If set, force copying files to the Nix store even if they
      * already exist there.
@@ -458,6 +504,21 @@ public:
      */
     std::map<const Hash, ref<eval_cache::EvalCache>> evalCaches;
 
+    /**
+     * The trees mounted in `storeFS` whose accesses are recorded for
+     * the evaluation cache, indexed by mount point.
+     */
+    std::map<CanonPath, ref<eval_cache::FileDependencies>> trackedTrees;
+
+    /**
+     * Record that the location of `path` (as opposed to its
+     * contents) has been revealed, e.g. by coercing it to a string
+     * without copying it to the store. If `path` is inside a tracked
+     * tree, this makes everything computed from now on depend on the
+     * entire tree, since the location of the tree is its store path.
+     */
+    void recordLocationDependency(const SourcePath & path);
+
 private:
 
     /* Cache for calls to addToStore(); maps source paths to the store
@@ -1127,6 +1188,8 @@ private:
 
     void incrFunctionCall(ExprLambda * fun);
 
+    void evalLambdaBodyMemoized(ExprLambda & lambda, Env & env, Value & arg, Value & v);
+
     typedef boost::unordered_flat_map<PosIdx, size_t, std::hash<PosIdx>> AttrSelects;
     AttrSelects attrSelects;
 
@@ -0,0 +1,89 @@
+#pragma once
+///@file
+
+#include "nix/expr/eval-gc.hh"
+#include "nix/expr/value.hh"
+
+#include <vector>
+
+#include <boost/unordered/unordered_flat_map.hpp>
+
+namespace nix {
+
+struct Env;
+struct ExprLambda;
+
+/**
+ * A cache of the results of applying lambdas to arguments, used if
+ * `eval-memoize-functions` is enabled.
+ *
+ * A call is identified by the lambda, its closure and its argument.
+ * Arguments that have already been evaluated to small values (such as
+ * numbers, strings without context, and small attribute sets and lists
+ * of those) are compared by value. Other values are compared by
+ * identity: attribute sets and lists by their contents' address,
+ * functions by their closure, and thunks by their unevaluated
+ * expression and environment. Since the keys refer to these objects,
+ * the cache keeps them alive.
+ *
+ * A lambda is only memoized once it has been called `threshold` times,
+ * and stops being memoized (dropping its cached results) if too few
+ * lookups hit.
+ */
+class FunctionMemo
+{
+public:
+
+    using Key = std::vector<uintptr_t, traceable_allocator<uintptr_t>>;
+
+    struct LambdaStats
+    {
+        uint64_t calls = 0;
+        uint64_t lookups = 0;
+        uint64_t hits = 0;
+        size_t entries = 0;
+        bool disabled = false;
+    };
+
+private:
+
+    struct KeyHash
+    {
+        size_t operator()(const Key & key) const noexcept;
+    };
+
+    struct LambdaMemo
+    {
+        LambdaStats stats;
+
+        boost::unordered_flat_map<
+            Key,
+            Value,
+            KeyHash,
+            std::equal_to<Key>,
+            traceable_allocator<std::pair<const Key, Value>>>
+            results;
+    };
+
+    unsigned int threshold;
+
+    boost::unordered_flat_map<const ExprLambda *, LambdaMemo> lambdas;
+
+public:
+
+    FunctionMemo(unsigned int threshold);
+
+    /**
+     * Look up the result of applying the lambda `fun` with closure
+     * `env` to `arg`. If it's cached, store it in `res` and return
+     * `true`. Otherwise, if calls of `fun` are being memoized, set `key`
+     * to the key under which the result should be passed to `record()`.
+     */
+    bool lookup(const ExprLambda & fun, Env * env, const Value & arg, Key & key, Value & res);
+
+    void record(const ExprLambda & fun, Key && key, const Value & res);
+
+    std::vector<std::pair<const ExprLambda *, LambdaStats>> getStats() const;
+};
+
+} // namespace nix
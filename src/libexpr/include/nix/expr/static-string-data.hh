@@ -11,13 +11,13 @@ struct StringData::Static
     /**
      * @note Must be first to make layout compatible with StringData.
      */
-    const size_t size = N - 1;
+    const size_t size = (N - 1) << StringData::sizeShift;
     char data[N];
 
     consteval Static(const char (&str)[N])
     {
         static_assert(N > 0);
-        if (str[size] != '\0')
+        if (str[N - 1] != '\0')
             throw;
         std::copy_n(str, N, data);
     }
@@ -1,6 +1,7 @@
 #pragma once
 ///@file
 
+#include <atomic>
 #include <bit>
 #include <cassert>
 #include <cstddef>
@@ -212,9 +213,34 @@ class StringData
 public:
     using size_type = std::size_t;
 
+    /**
+     * The length of the string, shifted left by `sizeShift` bits.
+     */
     size_type size_;
     char data_[];
 
+    /**
+     * The number of low bits of `size_` that are ignored. A `Value`
+     * that holds a short string inline uses them for its
+     * discriminator, which lets it pass itself off as a `StringData`
+     * (@see Value::mkString).
+     */
+    static constexpr unsigned int sizeShift = 3;
+
+    /**
+     * Set in `size_` if this is actually the header of a
+     * `Value::StringRope` (@see Value::string_data).
+     */
+    static constexpr size_type ropeFlag = size_type(1) << (sizeof(size_type) * 8 - 1);
+
+    /**
+     * Return the length of a string (or rope) from its `size_`.
+     */
+    static constexpr size_t decodeSize(size_type size_) noexcept
+    {
+        return (size_ & ~ropeFlag) >> sizeShift;
+    }
+
     /*
      * This in particular ensures that we cannot have a `StringData`
      * that we use by value, which is just what we want!
@@ -237,7 +263,7 @@ private:
     StringData() = delete;
 
     explicit StringData(size_type size)
-        : size_(size)
+        : size_(size << sizeShift)
     {
     }
 
@@ -254,9 +280,9 @@ public:
      */
     static StringData & alloc(EvalMemory & mem, size_t size);
 
-    size_t size() const
+    constexpr size_t size() const noexcept
     {
-        return size_;
+        return size_ >> sizeShift;
     }
 
     char * data() noexcept
@@ -276,7 +302,7 @@ public:
 
     constexpr std::string_view view() const noexcept
     {
-        return std::string_view(data_, size_);
+        return std::string_view(data_, size());
     }
 
     template<size_t N>
@@ -380,14 +406,57 @@ struct ValueBase
              * @return null pointer when context.empty()
              */
             static Context * fromBuilder(const NixStringContext & context, EvalMemory & mem);
+
+            /**
+             * Placeholder for the not yet computed context of a rope.
+             */
+            static const Context unresolved;
         };
 
         /**
-         * May be null for a string without context.
+         * May be null for a string without context. For a rope (see
+         * below), this may be `&Context::unresolved`, meaning that the
+         * context is the union of the contexts of its parts.
          */
         const Context * context;
     };
 
+    /**
+     * A lazy concatenation of two strings, which `str` in a
+     * `StringWithContext` may point to instead of a `StringData`. This
+     * makes repeated concatenation (e.g. `foldl' (acc: x: acc + x)`)
+     * linear instead of quadratic. The concatenated string is only
+     * computed once it's needed as a contiguous string, and the context
+     * only once it's inspected.
+     */
+    struct StringRope
+    {
+        /**
+         * Length of the concatenated string, encoded like
+         * `StringData::size_` and with `StringData::ropeFlag` set.
+         * Must be first, to overlap with `StringData::size_`.
+         */
+        StringData::size_type size_;
+
+        /**
+         * The concatenated strings, each of which may be a rope itself.
+         */
+        StringWithContext left, right;
+
+        EvalMemory * mem;
+
+        /**
+         * The concatenated string, once it has been computed.
+         */
+        mutable std::atomic<const StringData *> flat = nullptr;
+
+        /**
+         * The union of the contexts of `left` and `right`, once it
+         * has been computed.
+         */
+        mutable std::atomic<const StringWithContext::Context *> context = nullptr;
+    };
+
     struct Path
     {
         SourceAccessor * accessor;
@@ -556,6 +625,19 @@ protected:
 #undef NIX_VALUE_STORAGE_GET_IMPL
 #undef NIX_VALUE_STORAGE_FOR_EACH_FIELD
 
+    /** This layout doesn't store strings inline. */
+    static constexpr size_t maxSmallStringSize = 0;
+
+    void setSmallString(std::string_view s) noexcept
+    {
+        nixUnreachableWhenHardened();
+    }
+
+    bool isSmallString() const noexcept
+    {
+        return false;
+    }
+
     /** Get internal type currently occupying the storage. */
     InternalType getInternalType() const noexcept
     {
@@ -634,6 +716,12 @@ class alignas(16)
      * PrimaryDiscriminator::pdPairOfPointers - Payloads that consist of a pair of pointers.
      * In this case the 3 lower bits of payload[1] can be tagged.
      *
+     * PrimaryDiscriminator::pdSmallString - A tString without context of at most
+     * `maxSmallStringSize` bytes, stored in the payload itself rather than in a
+     * separately allocated StringData. The payload is laid out like a StringData,
+     * with the size in the upper bits of payload[0] and the NUL-terminated string
+     * in payload[1], so that it can be used as one.
+     *
      * The primary discriminator with value 0 is reserved for uninitialized Values,
      * which are useful for diagnostics in C bindings.
      */
@@ -645,6 +733,7 @@ class alignas(16)
         pdString,
         pdPath,
         pdPairOfPointers, //< layout: Pair of pointers payload
+        pdSmallString, //< layout: Inline StringData
     };
 
 #if defined(__x86_64__) && defined(__SSE2__)
@@ -816,6 +905,8 @@ protected:
             return static_cast<InternalType>(tFirstSingleUntaggable + (pd - pdListN));
         case pdPairOfPointers:
             return static_cast<InternalType>(tFirstPairOfPointers + (payload[1] & discriminatorMask));
+        case pdSmallString:
+            return tString;
         [[unlikely]] default:
             nixUnreachableWhenHardened();
         }
@@ -891,6 +982,11 @@ protected:
     void getStorage(StringWithContext & string) const noexcept
     {
         Payload payload = loadPayload();
+        if (getPrimaryDiscriminator(payload[0]) == pdSmallString) {
+            string.str = reinterpret_cast<const StringData *>(&payloadWords);
+            string.context = nullptr;
+            return;
+        }
         string.context = untagPointer<decltype(string.context)>(payload[0]);
         string.str = std::bit_cast<const StringData *>(payload[1]);
     }
@@ -958,6 +1054,23 @@ protected:
         setUntaggablePayload<pdPath>(path.accessor, path.path);
     }
 
+    static constexpr size_t maxSmallStringSize = sizeof(PackedPointer) - 1;
+
+    void setSmallString(std::string_view s) noexcept
+    {
+        static_assert(sizeof(Payload) == sizeof(StringData) + sizeof(PackedPointer));
+        assert(s.size() <= maxSmallStringSize);
+        Payload payload = {};
+        payload[0] = static_cast<int>(pdSmallString) | (PackedPointer(s.size()) << StringData::sizeShift);
+        std::memcpy(&payload[1], s.data(), s.size());
+        updatePayload(payload);
+    }
+
+    bool isSmallString() const noexcept
+    {
+        return getPrimaryDiscriminator(loadPayload()[0]) == pdSmallString;
+    }
+
     void setStorage(Failed * failed) noexcept
     {
         setSingleDWordPayload<tFailed>(std::bit_cast<PackedPointer>(failed));
@@ -1179,6 +1292,12 @@ struct Value : public ValueStorage<sizeof(void *)>
      */
     static Value vFalse;
 
+    /**
+     * The maximum length of strings that are stored in the value
+     * itself (@see mkString).
+     */
+    using ValueStorage::maxSmallStringSize;
+
 private:
     template<InternalType... discriminator>
     bool isa() const noexcept
@@ -1196,6 +1315,18 @@ private:
         return out;
     }
 
+    /**
+     * Compute the string of a rope and make this value point to it
+     * directly.
+     */
+    [[gnu::noinline]] const StringData & flattenString() const;
+
+    /**
+     * Compute the context of a rope and make this value point to it
+     * directly.
+     */
+    [[gnu::noinline]] const StringWithContext::Context * resolveContext() const;
+
 public:
 
     /**
@@ -1318,12 +1449,23 @@ public:
         setStorage(StringWithContext{.str = &s, .context = context});
     }
 
+    /**
+     * Make this a copy of the string `s`. Strings without context of
+     * at most `maxSmallStringSize` bytes are stored in the value
+     * itself instead of being allocated separately.
+     */
     void mkString(std::string_view s, EvalMemory & mem);
 
     void mkString(std::string_view s, const NixStringContext & context, EvalMemory & mem);
 
     void mkStringMove(const StringData & s, const NixStringContext & context, EvalMemory & mem);
 
+    /**
+     * Make this the concatenation of the strings `left` and `right`,
+     * lazily (@see StringRope). Either may be a rope itself.
+     */
+    void mkStringConcat(const Value & left, const Value & right, EvalMemory & mem);
+
     void mkPath(const SourcePath & path, EvalMemory & mem);
 
     inline void mkPath(SourceAccessor * accessor, const StringData & path) noexcept
@@ -1435,24 +1577,47 @@ public:
             ref(pathAccessor()->shared_from_this()), CanonPath(CanonPath::unchecked_t(), std::string(pathStrView())));
     }
 
-    const StringData & string_data() const noexcept
+    /**
+     * @note For a small string (@see mkString), this and the results of
+     * `c_str()` and `string_view()` point into the value itself, so they
+     * are only valid as long as the value isn't moved or overwritten.
+     *
+     * If the string is a rope, this flattens it, which allocates and
+     * may therefore throw. The same applies to `context()`.
+     */
+    const StringData & string_data() const
     {
-        return *getStorage<StringWithContext>().str;
+        auto str = getStorage<StringWithContext>().str;
+        if (str->size_ & StringData::ropeFlag) [[unlikely]]
+            return flattenString();
+        return *str;
     }
 
-    const char * c_str() const noexcept
+    const char * c_str() const
     {
-        return getStorage<StringWithContext>().str->data();
+        return string_data().data();
     }
 
-    std::string_view string_view() const noexcept
+    std::string_view string_view() const
     {
         return string_data().view();
     }
 
-    const Value::StringWithContext::Context * context() const noexcept
+    /**
+     * The length of the string. Unlike `string_view().size()`, this
+     * doesn't need to flatten a rope.
+     */
+    size_t string_size() const noexcept
+    {
+        return StringData::decodeSize(getStorage<StringWithContext>().str->size_);
+    }
+
+    const Value::StringWithContext::Context * context() const
     {
-        return getStorage<StringWithContext>().context;
+        auto context = getStorage<StringWithContext>().context;
+        if (context == &StringWithContext::Context::unresolved) [[unlikely]]
+            return resolveContext();
+        return context;
     }
 
     ExternalValueBase * external() const noexcept
@@ -1,5 +1,6 @@
 #include "nix/store/store-api.hh"
 #include "nix/expr/eval.hh"
+#include "nix/expr/eval-cache.hh"
 #include "nix/util/mounted-source-accessor.hh"
 #include "nix/fetchers/fetch-to-store.hh"
 
@@ -60,6 +61,21 @@ void EvalState::ensureLazyPathsCopied(const NixStringContext & context)
             ensureLazyPathCopied(o->path);
 }
 
+void EvalState::recordLocationDependency(const SourcePath & path)
+{
+    if (trackedTrees.empty() || path.accessor != rootFS)
+        return;
+
+    for (auto dir = path.path;; dir.pop()) {
+        if (auto i = trackedTrees.find(dir); i != trackedTrees.end()) {
+            i->second->recordTree();
+            return;
+        }
+        if (dir.isRoot())
+            return;
+    }
+}
+
 StorePath
 EvalState::mountInput(fetchers::Input & input, const fetchers::Input & originalInput, ref<SourceAccessor> accessor)
 {
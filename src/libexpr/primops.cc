@@ -1911,6 +1911,7 @@ static void prim_toPath(EvalState & state, const PosIdx pos, Value ** args, Valu
     NixStringContext context;
     auto path =
         state.coerceToPath(pos, *args[0], context, "while evaluating the first argument passed to builtins.toPath");
+    state.recordLocationDependency(path);
     v.mkString(path.path.abs(), context, state.mem);
 }
 
@@ -2806,6 +2807,7 @@ bool EvalState::callPathFilter(Value * filterFun, const SourcePath & path, PosId
 
     /* Call the filter function.  The first argument is the path, the
        second is a string indicating the type of the file. */
+    recordLocationDependency(path);
     Value arg1;
     arg1.mkString(path.path.abs(), mem);
 
@@ -40,8 +40,10 @@ json printValueAsJSON(
     case nPath:
         if (copyToStore)
             out = state.store->printStorePath(state.copyPathToStore(context, v.path()));
-        else
+        else {
+            state.recordLocationDependency(v.path());
             out = v.path().path.abs();
+        }
         break;
 
     case nNull:
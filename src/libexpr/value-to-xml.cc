@@ -26,8 +26,10 @@ static void printValueAsXML(
 
 static void posToXML(EvalState & state, XMLAttrs & xmlAttrs, const Pos & pos)
 {
-    if (auto path = std::get_if<SourcePath>(&pos.origin))
+    if (auto path = std::get_if<SourcePath>(&pos.origin)) {
+        state.recordLocationDependency(*path);
         xmlAttrs["path"] = path->path.abs();
+    }
     xmlAttrs["line"] = fmt("%1%", pos.line);
     xmlAttrs["column"] = fmt("%1%", pos.column);
 }
@@ -88,6 +90,7 @@ static void printValueAsXML(
         break;
 
     case nPath:
+        state.recordLocationDependency(v.path());
         doc.writeEmptyElement("path", singletonAttrs("value", v.path().to_string()));
         break;
 
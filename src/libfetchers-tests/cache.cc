@@ -0,0 +1,112 @@
+#include "nix/store/globals.hh"
+#include "nix/fetchers/cache.hh"
+#include "nix/fetchers/fetch-settings.hh"
+#include "nix/util/environment-variables.hh"
+#include "nix/util/file-system.hh"
+
+#include <gtest/gtest.h>
+
+#include <thread>
+
+namespace nix::fetchers {
+
+class CacheTest : public ::testing::Test
+{
+    std::unique_ptr<AutoDelete> delTmpDir;
+
+protected:
+    std::filesystem::path tmpDir;
+
+    void SetUp() override
+    {
+        tmpDir = createTempDir();
+        delTmpDir = std::make_unique<AutoDelete>(tmpDir, /*recursive=*/true);
+        nix::initLibStore(/*loadConfig=*/false);
+        setEnvOs(OS_STR("NIX_CACHE_HOME"), tmpDir.native());
+    }
+
+    void TearDown() override
+    {
+        unsetEnvOs(OS_STR("NIX_CACHE_HOME"));
+        delTmpDir.reset();
+    }
+};
+
+TEST_F(CacheTest, lookupAfterUpsertIsServedFromMemory)
+{
+    Settings settings;
+    auto cache = settings.getCache();
+
+    Cache::Key key{"test", {{"name", std::string("foo")}}};
+
+    ASSERT_FALSE(cache->lookup(key));
+    cache->upsert(key, {{"value", std::string("bar")}});
+
+    auto res = cache->lookup(key);
+    ASSERT_TRUE(res);
+    EXPECT_EQ(getStrAttr(*res, "value"), "bar");
+
+    auto stats = cache->getStats();
+    EXPECT_EQ(stats.misses, 1u);
+    EXPECT_EQ(stats.hits, 1u);
+    EXPECT_EQ(stats.upserts, 1u);
+}
+
+TEST_F(CacheTest, upsertsAreWrittenToDatabase)
+{
+    Cache::Key key{"test", {{"name", std::string("foo")}}};
+
+    {
+        Settings settings;
+        settings.getCache()->upsert(key, {{"value", std::string("bar")}});
+        EXPECT_EQ(settings.getCache()->getStats().flushes, 0u);
+    }
+
+    Settings settings;
+    auto cache = settings.getCache();
+
+    auto res = cache->lookup(key);
+    ASSERT_TRUE(res);
+    EXPECT_EQ(getStrAttr(*res, "value"), "bar");
+    EXPECT_EQ(cache->getStats().misses, 1u);
+
+    ASSERT_TRUE(cache->lookup(key));
+    EXPECT_EQ(cache->getStats().hits, 1u);
+}
+
+TEST_F(CacheTest, flushWritesTailBatch)
+{
+    Cache::Key key{"test", {{"name", std::string("foo")}}};
+
+    Settings settings;
+    auto cache = settings.getCache();
+    cache->upsert(key, {{"value", std::string("bar")}});
+    cache->flush();
+    EXPECT_EQ(cache->getStats().flushes, 1u);
+
+    /* Read it back through another connection while the first cache is
+       still open, as if this process had exec()ed. */
+    Settings settings2;
+    auto res = settings2.getCache()->lookup(key);
+    ASSERT_TRUE(res);
+    EXPECT_EQ(getStrAttr(*res, "value"), "bar");
+}
+
+TEST_F(CacheTest, pendingUpsertsAreFlushedInBackground)
+{
+    Cache::Key key{"test", {{"name", std::string("foo")}}};
+
+    Settings settings;
+    auto cache = settings.getCache();
+    cache->upsert(key, {{"value", std::string("bar")}});
+
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    while (cache->getStats().flushes == 0 && std::chrono::steady_clock::now() < deadline)
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    EXPECT_EQ(cache->getStats().flushes, 1u);
+
+    Settings settings2;
+    ASSERT_TRUE(settings2.getCache()->lookup(key));
+}
+
+} // namespace nix::fetchers
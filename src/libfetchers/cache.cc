@@ -3,11 +3,18 @@
 #include "nix/util/users.hh"
 #include "nix/store/sqlite.hh"
 #include "nix/util/sync.hh"
+#include "nix/util/finally.hh"
 #include "nix/store/store-api.hh"
 #include "nix/store/globals.hh"
 
 #include <nlohmann/json.hpp>
 
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <thread>
+#include <unordered_map>
+
 namespace nix::fetchers {
 
 static const char * schema = R"sql(
@@ -34,6 +41,62 @@ struct CacheImpl : Cache
 
     Sync<State> _state;
 
+    struct Entry
+    {
+        Attrs value;
+        time_t timestamp;
+    };
+
+    /**
+     * In-memory copy of every entry we have read or written, so that
+     * repeated lookups don't have to go through the (single) database
+     * connection. It is split into shards to reduce contention
+     * between fetcher threads.
+     */
+    struct Shard
+    {
+        std::unordered_map<std::string, Entry> entries;
+    };
+
+    static constexpr size_t nrShards = 16;
+
+    std::array<SharedSync<Shard>, nrShards> shards;
+
+    struct PendingUpsert
+    {
+        std::string domain, keyJSON, valueJSON;
+        time_t timestamp;
+    };
+
+    struct Pending
+    {
+        std::vector<PendingUpsert> upserts;
+        std::chrono::steady_clock::time_point oldest;
+        bool quit = false;
+    };
+
+    /**
+     * Upserts that are visible in `shards` but haven't been written
+     * to the database yet. They are written in a single transaction
+     * once there are enough of them, by `flusherThread` once the
+     * oldest is more than `maxDelay` old, or by an explicit `flush()`.
+     */
+    Sync<Pending> pending;
+
+    /**
+     * Signalled when `pending` becomes non-empty or `quit` is set.
+     */
+    std::condition_variable wakeup;
+
+    std::thread flusherThread;
+
+    static constexpr size_t maxPending = 64;
+
+    static constexpr std::chrono::seconds maxDelay{1};
+
+    std::atomic<uint64_t> nrHits{0}, nrMisses{0}, nrUpserts{0}, nrFlushes{0};
+    std::atomic<std::chrono::nanoseconds::rep> lockWaitTime{0};
+
     /**
      * This is a back-reference to the `Settings` that owns us.
      */
@@ -55,13 +118,113 @@ struct CacheImpl : Cache
             state->db, "insert or replace into Cache(domain, key, value, timestamp) values (?, ?, ?, ?)");
 
         state->lookup.create(state->db, "select value, timestamp from Cache where domain = ? and key = ?");
+
+        flusherThread = std::thread([this]() { flusherThreadEntry(); });
+    }
+
+    ~CacheImpl()
+    {
+        try {
+            pending.lock()->quit = true;
+            wakeup.notify_all();
+            flusherThread.join();
+            flush(*pending.lock());
+        } catch (...) {
+            ignoreExceptionInDestructor();
+        }
+    }
+
+    void flusherThreadEntry()
+    {
+        auto pending_(pending.lock());
+        while (!pending_->quit) {
+            if (pending_->upserts.empty()) {
+                pending_.wait(wakeup);
+                continue;
+            }
+            if (std::chrono::steady_clock::now() < pending_->oldest + maxDelay) {
+                pending_.wait_until(wakeup, pending_->oldest + maxDelay);
+                continue;
+            }
+            try {
+                flush(*pending_);
+            } catch (std::exception & e) {
+                /* Drop the batch rather than retrying it forever; the
+                   entries are still in memory for this process. */
+                printError("error writing to the fetcher cache: %s", e.what());
+                pending_->upserts.clear();
+            }
+        }
+    }
+
+    Sync<State>::WriteLock lockState()
+    {
+        auto before = std::chrono::steady_clock::now();
+        Finally addWaitTime([&]() { lockWaitTime += (std::chrono::steady_clock::now() - before).count(); });
+        return _state.lock();
+    }
+
+    static std::string makeCacheKey(Domain domain, std::string_view keyJSON)
+    {
+        return std::string(domain) + '\0' + std::string(keyJSON);
+    }
+
+    SharedSync<Shard> & getShard(const std::string & cacheKey)
+    {
+        return shards[std::hash<std::string>{}(cacheKey) % nrShards];
+    }
+
+    /**
+     * Write the pending upserts to the database in a single
+     * transaction. Called with `pending` locked so that upserts reach
+     * the database in the order in which they were made.
+     */
+    void flush(Pending & pending)
+    {
+        if (pending.upserts.empty())
+            return;
+
+        auto state(lockState());
+
+        SQLiteTxn txn(state->db);
+        for (auto & upsert : pending.upserts)
+            state->upsert.use()(upsert.domain)(upsert.keyJSON)(upsert.valueJSON)(upsert.timestamp).exec();
+        txn.commit();
+
+        pending.upserts.clear();
+        nrFlushes++;
     }
 
     void upsert(const Key & key, const Attrs & value) override
     {
-        _state.lock()
-            ->upsert.use()(key.first)(attrsToJSON(key.second).dump())(attrsToJSON(value).dump())(time(nullptr))
-            .exec();
+        auto keyJSON = attrsToJSON(key.second).dump();
+        auto cacheKey = makeCacheKey(key.first, keyJSON);
+        auto timestamp = time(nullptr);
+
+        nrUpserts++;
+
+        auto pending_(pending.lock());
+
+        getShard(cacheKey).lock()->entries.insert_or_assign(cacheKey, Entry{value, timestamp});
+
+        if (pending_->upserts.empty()) {
+            pending_->oldest = std::chrono::steady_clock::now();
+            wakeup.notify_all();
+        }
+        pending_->upserts.push_back({
+            .domain = std::string(key.first),
+            .keyJSON = std::move(keyJSON),
+            .valueJSON = attrsToJSON(value).dump(),
+            .timestamp = timestamp,
+        });
+
+        if (pending_->upserts.size() >= maxPending)
+            flush(*pending_);
+    }
+
+    void flush() override
+    {
+        flush(*pending.lock());
     }
 
     std::optional<Attrs> lookup(const Key & key) override
@@ -81,11 +244,32 @@ struct CacheImpl : Cache
         return {};
     }
 
-    std::optional<Result> lookupExpired(const Key & key) override
+    Result makeResult(Attrs value, time_t timestamp)
     {
-        auto state(_state.lock());
+        return Result{
+            .expired = settings.tarballTtl.get() == 0 || timestamp + settings.tarballTtl < time(nullptr),
+            .value = std::move(value),
+        };
+    }
 
+    std::optional<Result> lookupExpired(const Key & key) override
+    {
         auto keyJSON = attrsToJSON(key.second).dump();
+        auto cacheKey = makeCacheKey(key.first, keyJSON);
+        auto & shard = getShard(cacheKey);
+
+        {
+            auto shard_(shard.readLock());
+            auto i = shard_->entries.find(cacheKey);
+            if (i != shard_->entries.end()) {
+                nrHits++;
+                return makeResult(i->second.value, i->second.timestamp);
+            }
+        }
+
+        nrMisses++;
+
+        auto state(lockState());
 
         auto stmt(state->lookup.use()(key.first)(keyJSON));
         if (!stmt.next()) {
@@ -98,9 +282,23 @@ struct CacheImpl : Cache
 
         debug("using cache entry '%s:%s' -> '%s'", key.first, keyJSON, valueJSON);
 
-        return Result{
-            .expired = settings.tarballTtl.get() == 0 || timestamp + settings.tarballTtl < time(nullptr),
-            .value = jsonToAttrs(nlohmann::json::parse(valueJSON)),
+        auto value = jsonToAttrs(nlohmann::json::parse(valueJSON));
+
+        /* Don't overwrite an entry that was upserted while we were
+           querying the database. */
+        shard.lock()->entries.try_emplace(cacheKey, Entry{value, timestamp});
+
+        return makeResult(std::move(value), timestamp);
+    }
+
+    Stats getStats() override
+    {
+        return Stats{
+            .hits = nrHits,
+            .misses = nrMisses,
+            .upserts = nrUpserts,
+            .flushes = nrFlushes,
+            .lockWaitTime = std::chrono::nanoseconds(lockWaitTime.load()),
         };
     }
 
@@ -164,4 +362,9 @@ ref<Cache> Settings::getCache() const
     return ref<Cache>(*cache);
 }
 
+std::shared_ptr<Cache> Settings::getCacheIfOpen() const
+{
+    return *_cache.lock();
+}
+
 } // namespace nix::fetchers
@@ -4,6 +4,8 @@
 #include "nix/fetchers/fetchers.hh"
 #include "nix/store/path.hh"
 
+#include <chrono>
+
 namespace nix::fetchers {
 
 /**
@@ -76,6 +78,41 @@ struct Cache
      * has exceeded `settings.tarballTTL`.
      */
     virtual std::optional<ResultWithStorePath> lookupStorePathWithTTL(Key key, Store & store) = 0;
+
+    /**
+     * Write upserts that haven't been written to the database yet.
+     * This must be called before the process is replaced by `exec()`,
+     * since the cache's destructor won't run in that case.
+     */
+    virtual void flush() = 0;
+
+    struct Stats
+    {
+        /**
+         * Lookups answered from memory.
+         */
+        uint64_t hits = 0;
+
+        /**
+         * Lookups that had to query the database.
+         */
+        uint64_t misses = 0;
+
+        uint64_t upserts = 0;
+
+        /**
+         * Number of transactions used to write upserts to the
+         * database.
+         */
+        uint64_t flushes = 0;
+
+        /**
+         * Total time spent waiting for the database connection.
+         */
+        std::chrono::nanoseconds lockWaitTime{0};
+    };
+
+    virtual Stats getStats() = 0;
 };
 
 } // namespace nix::fetchers
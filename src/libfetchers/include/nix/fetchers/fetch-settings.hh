@@ -150,6 +150,12 @@ struct Settings : public Config
 
     ref<Cache> getCache() const;
 
+    /**
+     * Like `getCache()`, but return null rather than opening the
+     * cache if it hasn't been used yet.
+     */
+    std::shared_ptr<Cache> getCacheIfOpen() const;
+
     ref<GitRepo> getTarballCache() const;
 
 private:
@@ -3,7 +3,7 @@
 # The contents of the lock file, in JSON format.
 lockFileStr:
 
-# A mapping of lock file node IDs to { sourceInfo, subdir } attrsets,
+# A mapping of lock file node IDs to { sourceInfo, subdir, flakeFile? } attrsets,
 # with sourceInfo.outPath providing an SourceAccessor to a previously
 # fetched tree. This is necessary for possibly unlocked inputs, in
 # particular the root input, but also --override-inputs pointing to
@@ -62,7 +62,9 @@ let
         else
           sourceInfo.outPath + (if subdir == "" then "" else "/" + subdir);
 
-      flake = import (outPath + "/flake.nix");
+      # The override may provide `flake.nix` as a path value, so that
+      # importing it doesn't require the store path of the tree.
+      flake = import (overrides.${key}.flakeFile or (outPath + "/flake.nix"));
 
       inputs = mapAttrs (inputName: inputSpec: allNodes.${resolveInput inputSpec}.result) (
         node.inputs or { }
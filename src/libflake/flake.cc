@@ -30,6 +30,7 @@
 #include "nix/store/store-api.hh"
 #include "nix/fetchers/fetchers.hh"
 #include "nix/util/finally.hh"
+#include "nix/util/thread-pool.hh"
 #include "nix/fetchers/fetch-settings.hh"
 #include "nix/flake/settings.hh"
 #include "nix/expr/value-to-json.hh"
@@ -462,6 +463,30 @@ LockedFlake lockFlake(
 
         std::vector<FlakeRef> parents;
 
+        /* Fetch the given inputs concurrently so that the sequential
+           pass in `computeLocks` finds them in the input cache. This
+           doesn't affect the lock file, which is still computed in a
+           fixed order. Errors are ignored here; they are reported
+           (with the proper context) when the sequential pass fetches
+           the input again. */
+        auto prefetchInputs = [&](const std::vector<std::pair<fetchers::Input, fetchers::UseRegistries>> & inputs) {
+            if (inputs.size() < 2 || settings.lockFetchJobs <= 1)
+                return;
+
+            ThreadPool pool{std::min<size_t>(settings.lockFetchJobs, inputs.size())};
+
+            for (auto & [input, useRegistries] : inputs)
+                pool.enqueue([&]() {
+                    try {
+                        state.inputCache->getAccessor(state.fetchSettings, *state.store, input, useRegistries);
+                    } catch (Error & e) {
+                        debug("failed to prefetch flake input '%s': %s", input.to_string(), e.what());
+                    }
+                });
+
+            pool.process();
+        };
+
         std::function<void(
             const FlakeInputs & flakeInputs,
             ref<Node> node,
@@ -528,6 +553,40 @@ LockedFlake lockFlake(
                         follow);
             }
 
+            /* Find the inputs that the loop below will have to fetch
+               (i.e. new non-relative ones) and fetch them in
+               parallel. */
+            {
+                std::vector<std::pair<fetchers::Input, fetchers::UseRegistries>> toFetch;
+
+                for (auto & [id, input2] : flakeInputs) {
+                    auto nonEmptyInputAttrPath = NonEmptyInputAttrPath::append(inputAttrPathPrefix, id);
+                    auto i = overrides.find(nonEmptyInputAttrPath);
+                    auto & input = i != overrides.end() ? i->second.input : input2;
+
+                    if (input.follows || !input.ref || input.ref->input.isRelative())
+                        continue;
+
+                    /* The loop below refuses to fetch these, so don't
+                       fetch them here either. */
+                    if (!lockFlags.allowUnlocked && !input.ref->input.isLocked(state.fetchSettings))
+                        continue;
+
+                    if (oldNode && !lockFlags.inputUpdates.count(nonEmptyInputAttrPath))
+                        if (auto oldLock = get(oldNode->inputs, id))
+                            if (auto oldLock2 = std::get_if<0>(&*oldLock);
+                                oldLock2 && (*oldLock2)->originalRef.canonicalize() == input.ref->canonicalize())
+                                continue;
+
+                    auto inputIsOverride = explicitCliOverrides.contains(nonEmptyInputAttrPath);
+                    toFetch.emplace_back(
+                        input.ref->input,
+                        input2.isFlake && inputIsOverride ? fetchers::UseRegistries::All : useRegistriesInputs);
+                }
+
+                prefetchInputs(toFetch);
+            }
+
             /* Go over the flake inputs, resolve/fetch them if
                necessary (i.e. if they're new or the flakeref changed
                from what's in the lock file). */
@@ -930,6 +989,33 @@ static Value * requireInternalFile(EvalState & state, CanonPath path)
     return v;
 }
 
+/**
+ * Make the attributes of `vSourceInfo` that reveal the contents of the
+ * tracked tree mounted on `mountPoint` (i.e. its store path and NAR
+ * hash) record a dependency on the entire tree when they're evaluated.
+ */
+static void trackSourceInfo(EvalState & state, const CanonPath & mountPoint, Value & vSourceInfo)
+{
+    auto vRecord = get(state.internalPrimOps, "recordTreeDependency");
+    assert(vRecord);
+
+    auto vMountPoint = state.allocValue();
+    vMountPoint->mkString(mountPoint.abs(), state.mem);
+
+    auto sNarHash = state.symbols.create("narHash");
+
+    auto attrs = state.buildBindings(vSourceInfo.attrs()->size());
+    for (auto & attr : *vSourceInfo.attrs()) {
+        if (attr.name == state.s.outPath || attr.name == sNarHash) {
+            auto vFun = state.allocValue();
+            vFun->mkApp(*vRecord, vMountPoint);
+            attrs.alloc(attr.name).mkApp(vFun, attr.value);
+        } else
+            attrs.insert(attr);
+    }
+    vSourceInfo.mkAttrs(attrs);
+}
+
 void callFlake(EvalState & state, const LockedFlake & lockedFlake, Value & vRes)
 {
     experimentalFeatureSettings.require(Xp::Flakes);
@@ -939,7 +1025,7 @@ void callFlake(EvalState & state, const LockedFlake & lockedFlake, Value & vRes)
     auto overrides = state.buildBindings(lockedFlake.nodePaths.size());
 
     for (auto & [node, sourcePath] : lockedFlake.nodePaths) {
-        auto override = state.buildBindings(2);
+        auto override = state.buildBindings(3);
 
         auto & vSourceInfo = override.alloc(state.symbols.create("sourceInfo"));
 
@@ -960,6 +1046,16 @@ void callFlake(EvalState & state, const LockedFlake & lockedFlake, Value & vRes)
 
         override.alloc(state.symbols.create("dir")).mkString(CanonPath(subdir).rel(), state.mem);
 
+        /* If this node lives in a tracked tree (i.e. it's the root or
+           a relative path input of a tracked root), then import
+           `flake.nix` through a path value rather than through
+           `outPath`, which depends on the entire tree. */
+        auto i = state.trackedTrees.find(CanonPath(state.store->printStorePath(storePath)));
+        if (i != state.trackedTrees.end()) {
+            trackSourceInfo(state, i->first, vSourceInfo);
+            override.alloc(state.symbols.create("flakeFile")).mkPath(sourcePath / "flake.nix", state.mem);
+        }
+
         overrides.alloc(state.symbols.create(key->second)).mkAttrs(override);
     }
 
@@ -1004,11 +1100,66 @@ std::optional<Fingerprint> LockedFlake::getFingerprint(Store & store, const fetc
 
 Flake::~Flake() {}
 
+/**
+ * If the top-level flake is a local tree that is not identified by a
+ * revision (e.g. a Git working directory with uncommitted changes),
+ * start recording the accesses to it, and return a fingerprint that
+ * doesn't depend on its contents. That way, the evaluation cache can
+ * be reused after the tree has changed, as long as the files that a
+ * cached attribute depends on haven't changed.
+ */
+static std::optional<std::pair<Fingerprint, ref<eval_cache::FileDependencies>>>
+trackFileDependencies(EvalState & state, const LockedFlake & lockedFlake)
+{
+    auto & input = lockedFlake.flake.lockedRef.input;
+
+    if (input.getRev() || !input.getSourcePath() || lockedFlake.lockFile.isUnlocked(state.fetchSettings))
+        return std::nullopt;
+
+    CanonPath mountPoint(
+        state.store->printStorePath(state.store->toStorePath(lockedFlake.flake.path.path.abs()).first));
+
+    auto i = state.trackedTrees.find(mountPoint);
+    if (i == state.trackedTrees.end()) {
+        auto accessor = state.storeFS->getMount(mountPoint);
+        if (!accessor)
+            return std::nullopt;
+        auto fileDeps = make_ref<eval_cache::FileDependencies>(ref(accessor), mountPoint.abs());
+        state.storeFS->remount(mountPoint, fileDeps->getAccessor());
+        /* Make sure that previous accesses don't bypass the tracking
+           accessor. */
+        state.rootFS->invalidateCache();
+        i = state.trackedTrees.emplace(mountPoint, fileDeps).first;
+    }
+
+    /* `flake.nix` has already been parsed, so it won't be read again
+       during evaluation. */
+    lockedFlake.flake.path.readFile();
+
+    auto attrs = input.attrs;
+    attrs.erase("narHash");
+
+    auto fingerprint = fmt(
+        "dirty;%s;%s;%s;%d",
+        fetchers::attrsToJSON(attrs).dump(),
+        lockedFlake.flake.lockedRef.subdir,
+        lockedFlake.lockFile,
+        lockedFlake.flake.forceDirty);
+
+    return {{hashString(HashAlgorithm::SHA256, fingerprint), i->second}};
+}
+
 ref<eval_cache::EvalCache> openEvalCache(EvalState & state, ref<const LockedFlake> lockedFlake)
 {
-    auto fingerprint = state.settings.useEvalCache && state.settings.pureEval
-                           ? lockedFlake->getFingerprint(*state.store, state.fetchSettings)
-                           : std::nullopt;
+    std::optional<Fingerprint> fingerprint;
+    std::shared_ptr<eval_cache::FileDependencies> fileDeps;
+    if (state.settings.useEvalCache && state.settings.pureEval) {
+        if (auto tracked = trackFileDependencies(state, *lockedFlake)) {
+            fingerprint = tracked->first;
+            fileDeps = tracked->second;
+        } else
+            fingerprint = lockedFlake->getFingerprint(*state.store, state.fetchSettings);
+    }
     auto rootLoader = [&state, lockedFlake]() {
         /* For testing whether the evaluation cache is
            complete. */
@@ -1030,7 +1181,9 @@ ref<eval_cache::EvalCache> openEvalCache(EvalState & state, ref<const LockedFlak
         auto search = state.evalCaches.find(fingerprint.value());
         if (search == state.evalCaches.end()) {
             search = state.evalCaches
-                         .emplace(fingerprint.value(), make_ref<eval_cache::EvalCache>(fingerprint, state, rootLoader))
+                         .emplace(
+                             fingerprint.value(),
+                             make_ref<eval_cache::EvalCache>(fingerprint, state, rootLoader, fileDeps))
                          .first;
         }
         return search->second;
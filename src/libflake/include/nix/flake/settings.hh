@@ -49,6 +49,21 @@ struct Settings : public Config
         {"commit-lockfile-summary"},
         true,
         Xp::Flakes};
+
+    Setting<unsigned int> lockFetchJobs{
+        this,
+        8,
+        "lock-fetch-jobs",
+        R"(
+          The maximum number of flake inputs that are fetched concurrently
+          when computing a lock file (e.g. by `nix flake lock` or `nix
+          flake update`). Inputs of the same flake are fetched in
+          parallel; the resulting lock file doesn't depend on this
+          setting. Set to `1` to fetch inputs one at a time.
+        )",
+        {},
+        true,
+        Xp::Flakes};
 };
 
 } // namespace nix::flake
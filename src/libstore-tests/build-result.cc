@@ -91,6 +91,7 @@ INSTANTIATE_TEST_SUITE_P(
                 .stopTime = 50,
                 .cpuUser = std::chrono::microseconds(500s),
                 .cpuSystem = std::chrono::microseconds(604s),
+                .memoryPeak = 1 << 30,
             },
         }));
 
@@ -0,0 +1,103 @@
+#include <gtest/gtest.h>
+
+#include "nix/store/log-file.hh"
+#include "nix/util/file-system.hh"
+
+namespace nix {
+
+TEST(lastLines, basic)
+{
+    ASSERT_EQ(lastLines("a\nb\nc\n", 0), "");
+    ASSERT_EQ(lastLines("a\nb\nc\n", 1), "c\n");
+    ASSERT_EQ(lastLines("a\nb\nc\n", 2), "b\nc\n");
+    ASSERT_EQ(lastLines("a\nb\nc\n", 3), "a\nb\nc\n");
+    ASSERT_EQ(lastLines("a\nb\nc\n", 4), "a\nb\nc\n");
+    ASSERT_EQ(lastLines("a\nb\nc", 2), "b\nc");
+    ASSERT_EQ(lastLines("", 2), "");
+    ASSERT_EQ(lastLines("\n\n", 1), "\n");
+    ASSERT_EQ(lastLines("a\nb", 0), "");
+}
+
+class BuildLogFileTest : public ::testing::Test
+{
+protected:
+    std::filesystem::path tmpDir = createTempDir();
+    AutoDelete delTmpDir{tmpDir};
+
+    std::filesystem::path writeCompressedLog(std::string_view log)
+    {
+        StringSink compressed;
+        auto sink = makeBuildLogCompressionSink(compressed);
+        (*sink)(log);
+        sink->finish();
+        auto path = tmpDir / "log";
+        path += compressedBuildLogExtension;
+        writeFile(path, compressed.s);
+        return path;
+    }
+};
+
+static std::string makeLog(size_t nrLines)
+{
+    std::string log;
+    for (size_t i = 0; i < nrLines; ++i)
+        log += fmt("line %d of a fairly chatty build\n", i);
+    return log;
+}
+
+TEST_F(BuildLogFileTest, roundTrip)
+{
+    auto log = makeLog(200000);
+    ASSERT_GT(log.size(), 3 * seekableZstdBytesPerFrame);
+
+    auto path = writeCompressedLog(log);
+    ASSERT_EQ(decompress("zstd", readFile(path)), log);
+    ASSERT_EQ(readBuildLogFile(path), log);
+}
+
+TEST_F(BuildLogFileTest, tail)
+{
+    auto log = makeLog(200000);
+    auto path = writeCompressedLog(log);
+
+    for (size_t n : {0, 1, 10, 30000, 100000, 199999, 200000, 300000})
+        ASSERT_EQ(readBuildLogFile(path, n), lastLines(log, n)) << "tail " << n;
+}
+
+TEST_F(BuildLogFileTest, tailWithoutTrailingNewline)
+{
+    auto log = makeLog(100000) + "no newline";
+    auto path = writeCompressedLog(log);
+
+    ASSERT_EQ(readBuildLogFile(path, 1), "no newline");
+    ASSERT_EQ(readBuildLogFile(path, 2), lastLines(log, 2));
+}
+
+TEST_F(BuildLogFileTest, empty)
+{
+    auto path = writeCompressedLog("");
+    ASSERT_EQ(readBuildLogFile(path), "");
+    ASSERT_EQ(readBuildLogFile(path, 10), "");
+}
+
+TEST_F(BuildLogFileTest, legacyFormats)
+{
+    auto log = makeLog(1000);
+
+    auto bz2Path = tmpDir / "log.bz2";
+    writeFile(bz2Path, compress(CompressionAlgo::bzip2, log));
+    ASSERT_EQ(readBuildLogFile(bz2Path), log);
+    ASSERT_EQ(readBuildLogFile(bz2Path, 5), lastLines(log, 5));
+
+    /* A zstd log without an index. */
+    auto zstdPath = tmpDir / "plain";
+    zstdPath += compressedBuildLogExtension;
+    writeFile(zstdPath, compress(CompressionAlgo::zstd, log));
+    ASSERT_EQ(readBuildLogFile(zstdPath, 5), lastLines(log, 5));
+
+    auto plainPath = tmpDir / "foo.drv";
+    writeFile(plainPath, log);
+    ASSERT_EQ(readBuildLogFile(plainPath, 5), lastLines(log, 5));
+}
+
+} // namespace nix
@@ -1,12 +1,17 @@
+#include "nix/store/dummy-store-impl.hh"
 #include "nix/store/machines.hh"
 #include "nix/util/file-system.hh"
+#include "nix/util/memory-source-accessor.hh"
 #include "nix/util/util.hh"
 
+#include "nix/store/tests/libstore.hh"
 #include "nix/util/tests/test-data.hh"
 
 #include <gtest/gtest.h>
 #include <gmock/gmock-matchers.h>
 
+#include <deque>
+
 using ::testing::Contains;
 using ::testing::ElementsAre;
 using ::testing::Eq;
@@ -211,4 +216,169 @@ TEST(machines, getMachinesWithCorrectFileReferenceToIncorrectFile)
         FormatError);
 }
 
+TEST(machines, chooseMachineByLoadAndSpeed)
+{
+    auto machines = Machine::parseConfig({}, "ssh://a - - 8 1; ssh://b - - 8 2; ssh://c - - 8 2");
+
+    EXPECT_EQ(chooseMachine({}), std::nullopt);
+
+    /* Lowest load relative to speed wins. */
+    EXPECT_EQ(chooseMachine({{&machines[0], 1}, {&machines[1], 4}}), 0u);
+    EXPECT_EQ(chooseMachine({{&machines[0], 3}, {&machines[1], 4}}), 1u);
+
+    /* Ties are broken by speed, then load. */
+    EXPECT_EQ(chooseMachine({{&machines[0], 1}, {&machines[1], 2}}), 1u);
+    EXPECT_EQ(chooseMachine({{&machines[0], 0}, {&machines[1], 0}}), 1u);
+    EXPECT_EQ(chooseMachine({{&machines[1], 0}, {&machines[2], 0}}), 0u);
+
+    /* Missing bytes are ignored unless asked for. */
+    EXPECT_EQ(chooseMachine({{&machines[1], 0, 1000}, {&machines[2], 0, 0}}), 0u);
+    EXPECT_EQ(chooseMachine({{&machines[1], 0, 1000}, {&machines[2], 0, 0}}, 100), 1u);
+}
+
+TEST(machines, chooseMachineByLocality)
+{
+    auto machines = Machine::parseConfig({}, "ssh://a - - 8 1; ssh://b - - 8 1");
+
+    /* A busy machine that has all the inputs beats an idle one that
+       would need 2.5 builds' worth of transfers... */
+    EXPECT_EQ(chooseMachine({{&machines[0], 2, 0}, {&machines[1], 0, 250}}, 100), 0u);
+
+    /* ...but not if it's even busier. */
+    EXPECT_EQ(chooseMachine({{&machines[0], 3, 0}, {&machines[1], 0, 250}}, 100), 1u);
+}
+
+class MachineSelectionSimulation : public ::testing::Test
+{
+protected:
+    ref<DummyStore> store = [] {
+        auto config = make_ref<DummyStoreConfig>(DummyStoreConfig::Params{});
+        config->readOnly = false;
+        return config->openDummyStore();
+    }();
+
+    StorePath addPath(std::string_view name, size_t size)
+    {
+        auto accessor = make_ref<MemorySourceAccessor>();
+        accessor->root = MemorySourceAccessor::File{MemorySourceAccessor::File::Regular{
+            .contents = std::string(size, 'x'),
+        }};
+        return store->addToStore(name, SourcePath{accessor});
+    }
+
+    struct SimulatedMachine
+    {
+        StorePathSet validPaths;
+        std::deque<size_t> running;
+    };
+
+    /**
+     * Assign a sequence of builds with the given input closures to
+     * `machines`, where each build takes `buildSteps` steps and
+     * one build is started per step. Return the total number of bytes
+     * copied to the machines.
+     */
+    uint64_t simulate(
+        const Machines & machines,
+        std::vector<SimulatedMachine> states,
+        const std::vector<StorePathSet> & builds,
+        size_t buildSteps,
+        uint64_t localityBytes)
+    {
+        uint64_t copied = 0;
+
+        for (size_t step = 0; step < builds.size(); ++step) {
+            std::vector<MachineCandidate> candidates;
+            std::vector<size_t> indices;
+            for (size_t i = 0; i < machines.size(); ++i) {
+                auto & state = states[i];
+                while (!state.running.empty() && state.running.front() + buildSteps <= step)
+                    state.running.pop_front();
+                if (state.running.size() >= machines[i].maxJobs)
+                    continue;
+                candidates.push_back({
+                    .machine = &machines[i],
+                    .load = state.running.size(),
+                    .missingBytes = estimateMissingBytes(*store, builds[step], state.validPaths),
+                });
+                indices.push_back(i);
+            }
+
+            auto best = chooseMachine(candidates, localityBytes);
+            /* The simulations below always have a free slot. */
+            EXPECT_TRUE(best);
+            if (!best)
+                continue;
+
+            auto & state = states[indices[*best]];
+            copied += candidates[*best].missingBytes;
+            state.validPaths.insert(builds[step].begin(), builds[step].end());
+            state.running.push_back(step);
+        }
+
+        return copied;
+    }
+
+public:
+    static void SetUpTestSuite()
+    {
+        initLibStore(false);
+    }
+};
+
+TEST_F(MachineSelectionSimulation, estimateMissingBytes)
+{
+    auto a = addPath("a", 1000);
+    auto b = addPath("b", 2000);
+
+    auto sizeA = store->queryPathInfo(a)->narSize;
+    auto sizeB = store->queryPathInfo(b)->narSize;
+
+    EXPECT_EQ(estimateMissingBytes(*store, {a, b}, {}), sizeA + sizeB);
+    EXPECT_EQ(estimateMissingBytes(*store, {a, b}, {a}), sizeB);
+    EXPECT_EQ(estimateMissingBytes(*store, {a, b}, {a, b}), 0u);
+}
+
+TEST_F(MachineSelectionSimulation, twoToolchains)
+{
+    /* Builds alternate between two large toolchains, each with its
+       own small source. */
+    auto toolchainA = addPath("toolchain-a", 1 << 20);
+    auto toolchainB = addPath("toolchain-b", 1 << 20);
+
+    std::vector<StorePathSet> builds;
+    for (int i = 0; i < 20; ++i)
+        builds.push_back({i % 2 ? toolchainA : toolchainB, addPath(fmt("src-%d", i), 1 << 10)});
+
+    auto machines = Machine::parseConfig({}, "ssh://a - - 4 1; ssh://b - - 4 1");
+
+    auto byLoad = simulate(machines, {{}, {}}, builds, 3, 0);
+    auto byLocality = simulate(machines, {{}, {}}, builds, 3, 1 << 20);
+
+    /* Selecting by load alone spreads both toolchains over both
+       machines; taking locality into account sends each toolchain to
+       one machine only. */
+    EXPECT_GE(byLoad, 4u << 20);
+    EXPECT_LT(byLocality, 3u << 20);
+}
+
+TEST_F(MachineSelectionSimulation, warmMachine)
+{
+    /* One machine already has the toolchain, and the other one is
+       faster. */
+    auto toolchain = addPath("toolchain", 1 << 20);
+
+    std::vector<StorePathSet> builds;
+    for (int i = 0; i < 4; ++i)
+        builds.push_back({toolchain, addPath(fmt("src-%d", i), 1 << 10)});
+
+    auto machines = Machine::parseConfig({}, "ssh://warm - - 4 1; ssh://fast - - 4 2");
+
+    /* Transfers are cheap: use the fast machine. */
+    EXPECT_GE(simulate(machines, {{.validPaths = {toolchain}}, {}}, builds, 10, 1 << 30), 1u << 20);
+
+    /* Transfers are expensive: stick to the warm machine. */
+    EXPECT_LT(simulate(machines, {{.validPaths = {toolchain}}, {}}, builds, 10, 1 << 10), 1u << 20);
+}
+
 } // namespace nix
@@ -0,0 +1,85 @@
+#include <benchmark/benchmark.h>
+
+#include "nix/store/path-references.hh"
+#include "nix/store/path.hh"
+#include "nix/util/archive.hh"
+#include "nix/util/file-system.hh"
+#include "nix/util/hash.hh"
+#include "nix/util/source-accessor.hh"
+
+#ifndef _WIN32
+
+namespace nix {
+
+/**
+ * Create a synthetic build output with `nrFiles` small files spread
+ * over a few hundred directories, some of which contain references.
+ */
+static std::filesystem::path makeSyntheticOutput(const std::filesystem::path & root, int nrFiles, StorePathSet & refs)
+{
+    auto ref = StorePath::random("dep");
+    refs.insert(ref);
+
+    auto out = root / "out";
+    for (int i = 0; i < nrFiles; ++i) {
+        auto dir = out / fmt("dir-%d", i % 256);
+        if (i < 256)
+            createDirs(dir);
+        writeFile(
+            dir / fmt("file-%d", i),
+            i % 16 == 0 ? fmt("#! /nix/store/%s/bin/sh\n", ref.to_string()) : std::string(1024, 'a' + i % 26));
+    }
+
+    return out;
+}
+
+/**
+ * What `registerOutputs()` used to do for an input-addressed output:
+ * one pass to scan for references, another to compute the NAR hash.
+ */
+static void BM_OutputScanSeparatePasses(benchmark::State & state)
+{
+    auto tmpRoot = createTempDir();
+    StorePathSet refs;
+    auto out = makeSyntheticOutput(tmpRoot, state.range(0), refs);
+
+    for (auto _ : state) {
+        NullSink blank;
+        auto references = scanForReferences(blank, out, refs);
+        auto narHash = hashPath(
+            {makeFSSourceAccessor(out), CanonPath::root}, FileSerialisationMethod::NixArchive, HashAlgorithm::SHA256);
+        benchmark::DoNotOptimize(references);
+        benchmark::DoNotOptimize(narHash);
+    }
+
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+    deletePath(tmpRoot);
+}
+
+/**
+ * Scanning for references and hashing in a single pass.
+ */
+static void BM_OutputScanFused(benchmark::State & state)
+{
+    auto tmpRoot = createTempDir();
+    StorePathSet refs;
+    auto out = makeSyntheticOutput(tmpRoot, state.range(0), refs);
+
+    for (auto _ : state) {
+        HashSink narSink{HashAlgorithm::SHA256};
+        auto references = scanForReferences(narSink, out, refs);
+        auto narHash = narSink.finish();
+        benchmark::DoNotOptimize(references);
+        benchmark::DoNotOptimize(narHash);
+    }
+
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+    deletePath(tmpRoot);
+}
+
+BENCHMARK(BM_OutputScanSeparatePasses)->Arg(1'000)->Arg(10'000)->Arg(100'000);
+BENCHMARK(BM_OutputScanFused)->Arg(1'000)->Arg(10'000)->Arg(100'000);
+
+} // namespace nix
+
+#endif
@@ -1,6 +1,8 @@
 #include "nix/store/references.hh"
 #include "nix/store/path-references.hh"
 #include "nix/util/memory-source-accessor.hh"
+#include "nix/util/archive.hh"
+#include "nix/util/file-system.hh"
 
 #include <gtest/gtest.h>
 
@@ -222,4 +224,48 @@ TEST(references, scanForReferencesDeep)
     }
 }
 
+#ifndef _WIN32
+
+TEST(references, rewritePathInPlace)
+{
+    std::string oldHash = "dc04vv14dak1c1r48qa0m23vr9jy8sm0";
+    std::string newHash = "zc3y5zy8gp47d8a6gb6gg8v2v8s8w8cj";
+    StringMap rewrites{{oldHash, newHash}};
+
+    auto tmpDir = createTempDir();
+    AutoDelete delTmpDir(tmpDir);
+    auto root = tmpDir / "out";
+
+    createDirs(root / ("dir-" + oldHash) / "sub");
+    writeFile(root / "self", "prefix /nix/store/" + oldHash + "-foo suffix", 0755);
+    writeFile(root / "other", std::string(100000, 'x'));
+    writeFile(root / ("dir-" + oldHash) / "sub" / "file", std::string(70000, 'y') + oldHash);
+    createSymlink("/nix/store/" + oldHash + "-foo/bin", root / "link");
+    createSymlink("other", root / "link2");
+
+    /* What rewriting the NAR would produce. */
+    StringSink expected;
+    {
+        RewritingSink rewritingSink{rewrites, expected};
+        dumpPath(root, rewritingSink);
+        rewritingSink.flush();
+    }
+
+    auto otherInode = lstat(root / "other").st_ino;
+
+    rewritePathInPlace(root, rewrites);
+
+    StringSink actual;
+    dumpPath(root, actual);
+    ASSERT_EQ(actual.s, expected.s);
+
+    /* Files without matches are left alone. */
+    ASSERT_EQ(lstat(root / "other").st_ino, otherInode);
+    ASSERT_EQ(readFile(root / "self"), "prefix /nix/store/" + newHash + "-foo suffix");
+    ASSERT_TRUE(lstat(root / "self").st_mode & S_IXUSR);
+    ASSERT_EQ(readLink(root / "link").string(), "/nix/store/" + newHash + "-foo/bin");
+}
+
+#endif
+
 } // namespace nix
@@ -0,0 +1,81 @@
+#include <benchmark/benchmark.h>
+
+#ifdef __linux__
+
+#  include "nix/store/build-sandbox.hh"
+#  include "nix/util/error.hh"
+
+namespace nix {
+
+/**
+ * Compiling the seccomp filter from scratch, as was done for every
+ * build.
+ */
+static void BM_SeccompFilterCompile(benchmark::State & state)
+{
+    try {
+        for (auto _ : state)
+            benchmark::DoNotOptimize(linux::compileSeccompFilter());
+    } catch (Error & e) {
+        state.SkipWithError(e.what());
+    }
+}
+
+/**
+ * Getting the filter once it has been compiled.
+ */
+static void BM_SeccompFilterCached(benchmark::State & state)
+{
+    try {
+        for (auto _ : state)
+            linux::prepareSeccompFilter();
+    } catch (Error & e) {
+        state.SkipWithError(e.what());
+    }
+}
+
+/**
+ * Creating a network namespace on demand. This needs
+ * `CAP_SYS_ADMIN`.
+ */
+static void BM_NetworkNamespaceCreate(benchmark::State & state)
+{
+    try {
+        for (auto _ : state)
+            benchmark::DoNotOptimize(linux::createNetworkNamespace());
+    } catch (Error & e) {
+        state.SkipWithError(e.what());
+    }
+}
+
+/**
+ * Getting a network namespace the way the builder does when the pool
+ * is enabled: from the pool if one is ready, otherwise on demand.
+ * The `hits` counter shows how often the pool kept up.
+ */
+static void BM_NetworkNamespacePooled(benchmark::State & state)
+{
+    size_t hits = 0;
+    try {
+        for (auto _ : state) {
+            auto fd = linux::takePooledNetworkNamespace(state.range(0));
+            if (fd)
+                hits++;
+            else
+                fd = linux::createNetworkNamespace();
+            benchmark::DoNotOptimize(fd);
+        }
+    } catch (Error & e) {
+        state.SkipWithError(e.what());
+    }
+    state.counters["hits"] = benchmark::Counter(hits, benchmark::Counter::kAvgIterations);
+}
+
+BENCHMARK(BM_SeccompFilterCompile);
+BENCHMARK(BM_SeccompFilterCached);
+BENCHMARK(BM_NetworkNamespaceCreate)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_NetworkNamespacePooled)->Arg(16)->Unit(benchmark::kMicrosecond);
+
+} // namespace nix
+
+#endif
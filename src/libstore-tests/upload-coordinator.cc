@@ -0,0 +1,162 @@
+#include <gtest/gtest.h>
+
+#include <thread>
+
+#include "nix/store/dummy-store-impl.hh"
+#include "nix/store/pathlocks.hh"
+#include "nix/store/upload-coordinator.hh"
+#include "nix/util/file-system.hh"
+#include "nix/util/memory-source-accessor.hh"
+
+#include "nix/store/tests/libstore.hh"
+
+namespace nix {
+
+class UploadCoordinatorTest : public ::testing::Test
+{
+protected:
+    /**
+     * The local store, and two builders.
+     */
+    ref<DummyStore> src = openWritableStore();
+    ref<DummyStore> builder1 = openWritableStore();
+    ref<DummyStore> builder2 = openWritableStore();
+
+    std::filesystem::path tmpDir = createTempDir();
+    AutoDelete delTmpDir{tmpDir};
+
+    static ref<DummyStore> openWritableStore()
+    {
+        auto config = make_ref<DummyStoreConfig>(DummyStoreConfig::Params{});
+        config->readOnly = false;
+        return config->openDummyStore();
+    }
+
+    StorePath addPath(std::string_view name, const StorePathSet & references = {})
+    {
+        auto accessor = make_ref<MemorySourceAccessor>();
+        accessor->root = MemorySourceAccessor::File{MemorySourceAccessor::File::Regular{
+            .contents = std::string(name),
+        }};
+        return src->addToStore(
+            name, SourcePath{accessor}, ContentAddressMethod::Raw::NixArchive, HashAlgorithm::SHA256, references);
+    }
+
+    /**
+     * Pretend that some other process is uploading `path`.
+     */
+    AutoCloseFD lockPath(const std::filesystem::path & lockDir, const StorePath & path)
+    {
+        createDirs(lockDir);
+        auto fd = openLockFile(lockDir / (std::string(path.hashPart()) + ".lock"), true);
+        EXPECT_TRUE(lockFile(fd.get(), ltWrite, false));
+        return fd;
+    }
+
+public:
+    static void SetUpTestSuite()
+    {
+        initLibStore(false);
+    }
+};
+
+TEST_F(UploadCoordinatorTest, copiesPaths)
+{
+    auto a = addPath("a");
+    auto b = addPath("b", {a});
+    auto c = addPath("c", {a, b});
+
+    copyPathsCoordinated(*src, *builder1, {a, b, c}, tmpDir / "builder1", NoCheckSigs);
+
+    EXPECT_TRUE(builder1->isValidPath(a));
+    EXPECT_TRUE(builder1->isValidPath(b));
+    EXPECT_TRUE(builder1->isValidPath(c));
+    EXPECT_FALSE(builder2->isValidPath(a));
+
+    /* Nothing is left locked. */
+    auto fd = lockPath(tmpDir / "builder1", a);
+}
+
+TEST_F(UploadCoordinatorTest, waitsForPathsInFlight)
+{
+    auto a = addPath("a");
+    auto b = addPath("b", {a});
+    auto x = addPath("x");
+
+    auto lockDir = tmpDir / "builder1";
+    auto lock = lockPath(lockDir, a);
+
+    std::thread uploader([&]() { copyPathsCoordinated(*src, *builder1, {a, b, x}, lockDir, NoCheckSigs); });
+
+    /* `x` doesn't depend on `a`, so it's uploaded right away, but `b`
+       has to wait for `a`. */
+    for (int i = 0; !builder1->isValidPath(x); ++i) {
+        ASSERT_LT(i, 1000);
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        builder1->invalidatePathInfoCacheFor(x);
+    }
+    EXPECT_FALSE(builder1->isValidPath(b));
+
+    /* Finish the upload of `a`. */
+    copyPaths(*src, *builder1, StorePathSet{a}, NoRepair, NoCheckSigs);
+    lock.close();
+
+    uploader.join();
+
+    EXPECT_TRUE(builder1->isValidPath(a));
+    EXPECT_TRUE(builder1->isValidPath(b));
+}
+
+TEST_F(UploadCoordinatorTest, uploadsPathIfOtherUploadFails)
+{
+    auto a = addPath("a");
+    auto b = addPath("b", {a});
+
+    auto lockDir = tmpDir / "builder1";
+    auto lock = lockPath(lockDir, a);
+
+    std::thread uploader([&]() { copyPathsCoordinated(*src, *builder1, {a, b}, lockDir, NoCheckSigs); });
+
+    /* Give up on uploading `a` without adding it. */
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    lock.close();
+
+    uploader.join();
+
+    EXPECT_TRUE(builder1->isValidPath(a));
+    EXPECT_TRUE(builder1->isValidPath(b));
+}
+
+TEST_F(UploadCoordinatorTest, givesUpWaitingAfterTimeout)
+{
+    auto a = addPath("a");
+    auto b = addPath("b", {a});
+
+    auto lockDir = tmpDir / "builder1";
+
+    /* Somebody hangs while uploading `a`. */
+    auto lock = lockPath(lockDir, a);
+
+    copyPathsCoordinated(*src, *builder1, {a, b}, lockDir, NoCheckSigs, NoSubstitute, std::chrono::seconds(1));
+
+    EXPECT_TRUE(builder1->isValidPath(a));
+    EXPECT_TRUE(builder1->isValidPath(b));
+}
+
+TEST_F(UploadCoordinatorTest, buildersAreIndependent)
+{
+    auto a = addPath("a");
+    auto b = addPath("b", {a});
+
+    /* An upload of `a` to the first builder doesn't hold up uploads to
+       the second one. */
+    auto lock = lockPath(tmpDir / "builder1", a);
+
+    copyPathsCoordinated(*src, *builder2, {a, b}, tmpDir / "builder2", NoCheckSigs);
+
+    EXPECT_TRUE(builder2->isValidPath(a));
+    EXPECT_TRUE(builder2->isValidPath(b));
+    EXPECT_FALSE(builder1->isValidPath(a));
+}
+
+} // namespace nix
@@ -10,6 +10,7 @@
 #include "nix/util/nar-accessor.hh"
 #include "nix/util/thread-pool.hh"
 #include "nix/util/callback.hh"
+#include "nix/util/file-system.hh"
 #include "nix/util/signals.hh"
 #include "nix/util/archive.hh"
 
@@ -147,13 +148,17 @@ ref<const ValidPathInfo> BinaryCacheStore::addToStoreCommon(
     HashSink fileHashSink{HashAlgorithm::SHA256};
     std::shared_ptr<NarAccessor> narAccessor;
     HashSink narHashSink{HashAlgorithm::SHA256};
+    bool seekable =
+        config.seekableCompression && config.writeNARListing && config.compression.get() == CompressionAlgo::zstd;
     {
         FdSink fileSink(fdTemp.get());
         TeeSink teeSinkCompressed{fileSink, fileHashSink};
         bool parallel = config.parallelCompression.overridden ? config.parallelCompression.get()
                                                               : config.compression.get() == CompressionAlgo::zstd;
-        auto compressionSink =
-            makeCompressionSink(config.compression, teeSinkCompressed, parallel, config.compressionLevel);
+        auto compressionSink = seekable ? makeSeekableZstdCompressionSink(
+                                              teeSinkCompressed, parallel, config.compressionLevel)
+                                        : makeCompressionSink(
+                                              config.compression, teeSinkCompressed, parallel, config.compressionLevel);
         TeeSink teeSinkUncompressed{*compressionSink, narHashSink};
         TeeSource teeSource{narSource, teeSinkUncompressed};
         narAccessor = makeNarAccessor(parseNarListing(teeSource));
@@ -207,6 +212,8 @@ ref<const ValidPathInfo> BinaryCacheStore::addToStoreCommon(
             {"version", 1},
             {"root", narAccessor->getListing()},
         };
+        if (seekable)
+            j["seekable"] = true;
 
         upsertFile(std::string(info.path.hashPart()) + ".ls", j.dump(), "application/json");
     }
@@ -560,6 +567,64 @@ void BinaryCacheStore::registerDrvOutput(const Realisation & info)
         "application/json");
 }
 
+std::string BinaryCacheStore::getFileRange(const std::string & path, uint64_t offset, uint64_t length)
+{
+    auto localPath = getLocalFilePath(path);
+    if (!localPath)
+        throw Unsupported("binary cache '%s' does not support reading parts of files", config.getHumanReadableURI());
+
+    auto fd = openFileReadonly(*localPath);
+    if (!fd)
+        throw NativeSysError("opening binary cache file %s", PathFmt(*localPath));
+
+    StringSink sink;
+    seekableGetNarBytes(fd.get())(offset, length, sink);
+    return std::move(sink.s);
+}
+
+std::shared_ptr<SourceAccessor> BinaryCacheStore::openSeekableNarAccessor(const StorePath & storePath)
+{
+    auto info = queryPathInfo(storePath).cast<const NarInfo>();
+
+    if (info->compression != "none" && info->compression != "zstd")
+        return nullptr;
+
+    try {
+        auto narPath = getLocalFilePath(info->url);
+        if (info->compression == "none" && !narPath)
+            return nullptr;
+
+        auto listing = getFile(std::string(storePath.hashPart()) + ".ls");
+        if (!listing)
+            return nullptr;
+        auto json = nlohmann::json::parse(*listing);
+
+        if (info->compression == "none")
+            return makeLazyNarAccessor(json.at("root").get<NarListing>(), mmapGetNarBytes(*narPath));
+
+        if (!json.value("seekable", false) || !info->fileSize)
+            return nullptr;
+
+        auto readRange = [store = ref<Store>(shared_from_this()).cast<BinaryCacheStore>(),
+                          url = info->url](uint64_t offset, uint64_t length) {
+            return store->getFileRange(url, offset, length);
+        };
+
+        auto seekTable = ZstdSeekTable::read(info->fileSize, readRange);
+        if (!seekTable)
+            return nullptr;
+
+        return makeLazyNarAccessor(
+            json.at("root").get<NarListing>(), makeSeekableZstdReader(std::move(*seekTable), readRange));
+    } catch (Error & e) {
+        debug("cannot access NAR of '%s' directly: %s", printStorePath(storePath), e.what());
+    } catch (nlohmann::json::exception & e) {
+        debug("cannot parse listing of '%s': %s", printStorePath(storePath), e.what());
+    }
+
+    return nullptr;
+}
+
 ref<RemoteFSAccessor> BinaryCacheStore::getRemoteFSAccessor(bool requireValidPath)
 {
     return make_ref<RemoteFSAccessor>(ref<Store>(shared_from_this()), requireValidPath, config.localNarCache);
@@ -160,6 +160,9 @@ void adl_serializer<BuildResult>::to_json(json & res, const BuildResult & br)
     if (br.cpuSystem.has_value()) {
         res["cpuSystem"] = br.cpuSystem->count();
     }
+    if (br.memoryPeak.has_value()) {
+        res["memoryPeak"] = *br.memoryPeak;
+    }
 
     // Handle success or failure variant
     std::visit(
@@ -196,6 +199,9 @@ BuildResult adl_serializer<BuildResult>::from_json(const json & _json)
     if (auto cpuSystem = optionalValueAt(json, "cpuSystem")) {
         br.cpuSystem = std::chrono::microseconds(getUnsigned(*cpuSystem));
     }
+    if (auto memoryPeak = optionalValueAt(json, "memoryPeak")) {
+        br.memoryPeak = getUnsigned(*memoryPeak);
+    }
 
     // Determine success or failure based on success field
     bool success = getBoolean(valueAt(json, "success"));
@@ -4,6 +4,7 @@
 #  include "nix/store/build/hook-instance.hh"
 #  include "nix/store/build/derivation-builder.hh"
 #endif
+#include "nix/util/finally.hh"
 #include "nix/util/fun.hh"
 #include "nix/util/processes.hh"
 #include "nix/util/environment-variables.hh"
@@ -14,6 +15,7 @@
 #include "nix/store/common-protocol.hh"
 #include "nix/store/common-protocol-impl.hh"
 #include "nix/store/local-store.hh" // TODO remove, along with remaining downcasts
+#include "nix/store/log-file.hh"
 #include "nix/store/outputs-query.hh"
 #include "nix/store/globals.hh"
 #include "nix/util/current-process.hh"
@@ -896,8 +898,7 @@ Goal::Co DerivationBuildingGoal::buildLocally(
     // Will continue here while waiting for a build user below
     while (true) {
 
-        unsigned int curBuilds = worker.getNrLocalBuilds();
-        if (curBuilds >= worker.settings.maxBuildJobs) {
+        if (!worker.localBuildSlotAvailable()) {
             outputLocks.unlock();
             co_await waitForBuildSlot();
             co_return tryToBuild(std::move(inputPaths));
@@ -1045,6 +1046,7 @@ Goal::Co DerivationBuildingGoal::buildLocally(
 
     SingleDrvOutputs builtOutputs;
     try {
+        Finally recordResources([&]() { worker.recordBuildResources(buildResult); });
         builtOutputs = builder->unprepareBuild();
     } catch (BuilderFailureError & e) {
         builder.reset();
@@ -1263,7 +1265,8 @@ LogFile::LogFile(Store & store, const StorePath & drvPath, const LogFileSettings
     auto dir = store.config.getLogDir() / LocalFSStore::drvsLogDir / baseName.substr(0, 2);
     createDirs(dir);
 
-    auto logFileName = dir / (baseName.substr(2) + (logSettings.compressLog ? ".bz2" : ""));
+    auto logFileName =
+        dir / (baseName.substr(2) + (logSettings.compressLog ? std::string(compressedBuildLogExtension) : ""));
 
     fd = openNewFileForWrite(
         logFileName,
@@ -1278,7 +1281,7 @@ LogFile::LogFile(Store & store, const StorePath & drvPath, const LogFileSettings
     fileSink = std::make_shared<FdSink>(fd.get());
 
     if (logSettings.compressLog)
-        sink = std::shared_ptr<CompressionSink>(makeCompressionSink(CompressionAlgo::bzip2, *fileSink));
+        sink = std::shared_ptr<CompressionSink>(makeBuildLogCompressionSink(*fileSink));
     else
         sink = fileSink;
 }
@@ -13,6 +13,9 @@
 #endif
 #include "nix/util/signals.hh"
 #include "nix/store/globals.hh"
+#ifdef __linux__
+#  include "nix/util/cgroup.hh"
+#endif
 
 namespace nix {
 
@@ -36,6 +39,9 @@ Worker::Worker(Store & store, Store & evalStore)
     if (!ioport)
         throw windows::WinError("CreateIoCompletionPort");
     wakerState->ioport = ioport.get();
+#endif
+#ifdef __linux__
+    epoll.add(wakerState->wakeupPipe.pipe.readSide.get(), 0);
 #endif
     nrLocalBuilds = 0;
     nrSubstitutions = 0;
@@ -187,6 +193,69 @@ size_t Worker::getNrLocalBuilds()
     return nrLocalBuilds;
 }
 
+bool Worker::localBuildSlotAvailable()
+{
+    if (nrLocalBuilds >= settings.maxBuildJobs)
+        return false;
+
+    /* Always allow at least one build, otherwise we could wait
+       forever. */
+    if (!settings.adaptiveBuildConcurrency || nrLocalBuilds == 0)
+        return true;
+
+    return !isSystemOverloaded();
+}
+
+bool Worker::isSystemOverloaded()
+{
+#ifdef __linux__
+    auto now = steady_time_point::clock::now();
+    if (lastLoadCheck != steady_time_point::min() && now < lastLoadCheck + std::chrono::seconds(1))
+        return systemOverloaded;
+    lastLoadCheck = now;
+
+    systemOverloaded = [&]() {
+        for (auto & [resource, limit] :
+             {std::pair{"cpu", settings.maxCpuPressure.get()},
+              std::pair{"memory", settings.maxMemoryPressure.get()},
+              std::pair{"io", settings.maxIoPressure.get()}}) {
+            auto pressure = linux::getPressureStats(std::filesystem::path("/proc/pressure") / resource);
+            if (pressure && pressure->someAvg10 > limit) {
+                debug(
+                    "not starting another build: %s pressure is %.2f%% (limit %d%%)",
+                    resource,
+                    pressure->someAvg10,
+                    limit);
+                return true;
+            }
+        }
+
+        if (recentBuildMemoryPeak) {
+            auto available = linux::getAvailableMemory();
+            if (available && *available < recentBuildMemoryPeak) {
+                debug(
+                    "not starting another build: %d bytes of memory available, but builds have used up to %d bytes",
+                    *available,
+                    recentBuildMemoryPeak);
+                return true;
+            }
+        }
+
+        return false;
+    }();
+
+    return systemOverloaded;
+#else
+    return false;
+#endif
+}
+
+void Worker::recordBuildResources(const BuildResult & result)
+{
+    if (result.memoryPeak)
+        recentBuildMemoryPeak = std::max(recentBuildMemoryPeak - recentBuildMemoryPeak / 4, *result.memoryPeak);
+}
+
 size_t Worker::getNrSubstitutions()
 {
     return nrSubstitutions;
@@ -197,12 +266,19 @@ void Worker::childStarted(
 {
     Child child;
     child.goal = goal;
-    child.goal2 = goal.get();
     child.channels = channels;
     child.timeStarted = child.lastOutput = steady_time_point::clock::now();
     child.inBuildSlot = inBuildSlot;
     child.respectTimeouts = respectTimeouts;
-    children.emplace_back(child);
+#ifdef __linux__
+    if (auto i = children.find(goal.get()); i != children.end())
+        unregisterChannels(goal.get(), i->second);
+#endif
+    auto & i = children.insert_or_assign(goal.get(), std::move(child)).first->second;
+#ifdef __linux__
+    registerChannels(goal.get(), i);
+#endif
+    scheduleTimers(goal.get(), i);
     if (inBuildSlot) {
         switch (goal->jobCategory()) {
         case JobCategory::Substitution:
@@ -226,12 +302,15 @@ void Worker::childTerminated(Goal * goal)
 
 void Worker::childTerminated(Goal * goal, JobCategory jobCategory)
 {
-    // FIXME: Inefficient. Make children a map from Goal -> Child instead.
-    auto i = std::find_if(children.begin(), children.end(), [&](const Child & child) { return child.goal2 == goal; });
+    auto i = children.find(goal);
     if (i == children.end())
         return;
 
-    if (i->inBuildSlot) {
+#ifdef __linux__
+    unregisterChannels(goal, i->second);
+#endif
+
+    if (i->second.inBuildSlot) {
         switch (jobCategory) {
         case JobCategory::Substitution:
             assert(nrSubstitutions > 0);
@@ -264,6 +343,50 @@ void Worker::childTerminated(Goal * goal, JobCategory jobCategory)
     }
 }
 
+#ifdef __linux__
+void Worker::registerChannels(Goal * goal, const Child & child)
+{
+    for (auto fd : child.channels) {
+        /* If the file descriptor is still registered, its previous
+           owner has closed it without calling `childTerminated()` yet,
+           and the kernel has dropped the old registration. */
+        if (auto i = epollChannels.find(fd); i != epollChannels.end()) {
+            if (auto j = children.find(i->second.goal); j != children.end() && i->second.goal != goal)
+                j->second.channels.erase(fd);
+            epoll.remove(fd);
+        }
+        auto generation = ++epollGeneration;
+        if (generation == 0)
+            generation = ++epollGeneration;
+        epoll.add(fd, ((uint64_t) fd << 32) | generation);
+        epollChannels.insert_or_assign(fd, EpollChannel{.generation = generation, .goal = goal});
+    }
+}
+
+void Worker::unregisterChannels(Goal * goal, const Child & child)
+{
+    for (auto fd : child.channels)
+        if (auto i = epollChannels.find(fd); i != epollChannels.end() && i->second.goal == goal) {
+            epoll.remove(fd);
+            epollChannels.erase(i);
+        }
+}
+#endif
+
+void Worker::scheduleTimers(Goal * goal, const Child & child)
+{
+    if (!child.respectTimeouts)
+        return;
+    if (0 != settings.maxSilentTime)
+        childTimers.schedule(
+            child.lastOutput + std::chrono::seconds(settings.maxSilentTime),
+            {.goal = goal, .timeStarted = child.timeStarted, .kind = ChildTimer::MaxSilentTime});
+    if (0 != settings.buildTimeout)
+        childTimers.schedule(
+            child.timeStarted + std::chrono::seconds(settings.buildTimeout),
+            {.goal = goal, .timeStarted = child.timeStarted, .kind = ChildTimer::BuildTimeout});
+}
+
 void Worker::waitForBuildSlot(GoalPtr goal)
 {
     goal->trace("wait for build slot");
@@ -272,11 +395,16 @@ void Worker::waitForBuildSlot(GoalPtr goal)
         if (goal->jobCategory() == JobCategory::Substitution)
             return getNrSubstitutions() < settings.maxSubstitutionJobs;
         else
-            return getNrLocalBuilds() < settings.maxBuildJobs;
+            return localBuildSlotAvailable();
     }();
 
     if (slotAvailable)
         wakeUp(goal); /* Can do it right away. */
+    else if (goal->jobCategory() == JobCategory::Build && getNrLocalBuilds() < settings.maxBuildJobs)
+        /* There is a free slot, but the system is too busy to use it.
+           Since the load can go down without any of our builds
+           finishing, poll. */
+        waitForAWhile(goal);
     else
         addToWeakGoals(goal->jobCategory() == JobCategory::Substitution ? wantingToSubstitute : wantingToBuild, goal);
 }
@@ -410,14 +538,8 @@ void Worker::waitForInput()
         // periodically wake up to see if we need to run the garbage collector. (See the `autoGC` call site above in
         // this file, also gated on having a local store. when we wake up, we intended to reach that call site.)
         nearest = before + std::chrono::seconds(10);
-    for (auto & i : children) {
-        if (!i.respectTimeouts)
-            continue;
-        if (0 != settings.maxSilentTime)
-            nearest = std::min(nearest, i.lastOutput + std::chrono::seconds(settings.maxSilentTime));
-        if (0 != settings.buildTimeout)
-            nearest = std::min(nearest, i.timeStarted + std::chrono::seconds(settings.buildTimeout));
-    }
+    if (auto deadline = childTimers.nextDeadline())
+        nearest = std::min(nearest, *deadline);
     if (nearest != steady_time_point::max()) {
         timeout = std::max(1L, (long) std::chrono::duration_cast<std::chrono::seconds>(nearest - before).count());
         useTimeout = true;
@@ -440,13 +562,61 @@ void Worker::waitForInput()
     if (useTimeout)
         vomit("sleeping %d seconds", timeout);
 
+#ifdef __linux__
+    /* Only the file descriptors that are ready are returned, so this
+       doesn't depend on the number of children. */
+    auto ready = epoll.wait(useTimeout ? std::optional{std::chrono::seconds(timeout)} : std::nullopt);
+
+    auto after = steady_time_point::clock::now();
+
+    bool wakeup = false;
+    std::vector<unsigned char> buffer(4096);
+
+    for (auto token : ready) {
+        checkInterrupt();
+
+        if (token == 0) {
+            wakeup = true;
+            continue;
+        }
+
+        Descriptor fd = token >> 32;
+        auto i = epollChannels.find(fd);
+        if (i == epollChannels.end() || i->second.generation != (uint32_t) token)
+            continue;
+
+        auto j = children.find(i->second.goal);
+        assert(j != children.end());
+
+        GoalPtr goal = j->second.goal.lock();
+        assert(goal);
+
+        ssize_t rd = ::read(fd, buffer.data(), buffer.size());
+        // FIXME: is there a cleaner way to handle pt close
+        // than EIO? Is this even standard?
+        if (rd == 0 || (rd == -1 && errno == EIO)) {
+            epoll.remove(fd);
+            epollChannels.erase(i);
+            j->second.channels.erase(fd);
+            debug("%1%: got EOF", goal->getName());
+            goal->handleEOF(fd);
+        } else if (rd == -1) {
+            if (errno != EINTR && errno != EAGAIN)
+                throw SysError("read failed");
+        } else {
+            printMsg(lvlVomit, "%1%: read %2% bytes", goal->getName(), rd);
+            j->second.lastOutput = after;
+            goal->handleChildOutput(fd, std::string_view((char *) buffer.data(), rd));
+        }
+    }
+#else
     MuxablePipePollState state;
 
-#ifndef _WIN32
+#  ifndef _WIN32
     /* Use select() to wait for the input side of any logger pipe to
        become `available'.  Note that `available' (i.e., non-blocking)
        includes EOF. */
-    for (auto & i : children) {
+    for (auto & [_, i] : children) {
         for (auto & j : i.channels) {
             state.pollStatus.push_back((struct pollfd) {.fd = j, .events = POLLIN});
             state.fdToPollStatus[j] = state.pollStatus.size() - 1;
@@ -463,12 +633,12 @@ void Worker::waitForInput()
 
         state.fdToPollStatus[wakeupPipeFd] = state.pollStatus.size() - 1;
     }
-#endif
+#  endif
 
     state.poll(
-#ifdef _WIN32
+#  ifdef _WIN32
         ioport.get(),
-#endif
+#  endif
         useTimeout ? (std::optional{timeout * 1000}) : std::nullopt);
 
     auto after = steady_time_point::clock::now();
@@ -481,34 +651,51 @@ void Worker::waitForInput()
 
         checkInterrupt();
 
-        GoalPtr goal = j->goal.lock();
+        GoalPtr goal = j->second.goal.lock();
         assert(goal);
 
         state.iterate(
-            j->channels,
+            j->second.channels,
             [&](Descriptor k, std::string_view data) {
                 printMsg(lvlVomit, "%1%: read %2% bytes", goal->getName(), data.size());
-                j->lastOutput = after;
+                j->second.lastOutput = after;
                 goal->handleChildOutput(k, data);
             },
             [&](Descriptor k) {
                 debug("%1%: got EOF", goal->getName());
                 goal->handleEOF(k);
             });
+    }
+#endif
 
-        if (goal->exitCode == Goal::ecBusy && 0 != settings.maxSilentTime && j->respectTimeouts
-            && after - j->lastOutput >= std::chrono::seconds(settings.maxSilentTime)) {
-            goal->timedOut(TimedOut(settings.maxSilentTime));
-        }
+    /* Check the timeouts that have expired. Since timers are never
+       cancelled, this has to look at the child's current state. */
+    for (auto & timer : childTimers.expire(after)) {
+        checkInterrupt();
+
+        auto j = children.find(timer.goal);
+        if (j == children.end() || j->second.timeStarted != timer.timeStarted)
+            continue;
+
+        GoalPtr goal = j->second.goal.lock();
+        if (!goal || goal->exitCode != Goal::ecBusy)
+            continue;
 
-        else if (
-            goal->exitCode == Goal::ecBusy && 0 != settings.buildTimeout && j->respectTimeouts
-            && after - j->timeStarted >= std::chrono::seconds(settings.buildTimeout)) {
+        if (timer.kind == ChildTimer::MaxSilentTime) {
+            if (after - j->second.lastOutput >= std::chrono::seconds(settings.maxSilentTime))
+                goal->timedOut(TimedOut(settings.maxSilentTime));
+            else
+                /* The child has produced output since the timer was
+                   scheduled. */
+                childTimers.schedule(j->second.lastOutput + std::chrono::seconds(settings.maxSilentTime), timer);
+        } else
             goal->timedOut(TimedOut(settings.buildTimeout));
-        }
     }
 
-#ifndef _WIN32
+#ifdef __linux__
+    if (wakeup)
+        wakerState->wakeAll(*this);
+#elif !defined(_WIN32)
     std::set<MuxablePipePollState::CommChannel> wakerChannels{wakerState->wakeupPipe.pipe.readSide.get()};
     state.iterate(
         wakerChannels,
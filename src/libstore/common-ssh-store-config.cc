@@ -18,6 +18,7 @@ SSHMaster CommonSSHStoreConfig::createSSHMaster(bool useMaster, Descriptor logFD
         useMaster,
         compress,
         logFD,
+        controlPersist,
     };
 }
 
@@ -576,9 +576,9 @@ struct curlFileTransfer : public FileTransfer
 
             /* Enable transparent decompression for downloads.
                Skip for uploads (Accept-Encoding is meaningless when sending data)
-               and when resuming from an offset (byte ranges don't work with
-               compressed content). */
-            if (writtenToSink == 0 && !request.data)
+               and when requesting or resuming from an offset (byte ranges
+               don't work with compressed content). */
+            if (writtenToSink == 0 && !request.data && !request.byteRange)
                 /* Empty string means to enable all supported (that libcurl has
                    been linked to support) encodings. */
                 curl_easy_setopt(req, CURLOPT_ACCEPT_ENCODING, "");
@@ -663,7 +663,12 @@ struct curlFileTransfer : public FileTransfer
             curl_easy_setopt(req, CURLOPT_NETRC_FILE, fileTransfer.settings.netrcFile.get().string().c_str());
             curl_easy_setopt(req, CURLOPT_NETRC, CURL_NETRC_OPTIONAL);
 
-            if (writtenToSink)
+            if (request.byteRange) {
+                auto [first, length] = *request.byteRange;
+                assert(length > 0);
+                curl_easy_setopt(
+                    req, CURLOPT_RANGE, fmt("%d-%d", first + writtenToSink, first + length - 1).c_str());
+            } else if (writtenToSink)
                 curl_easy_setopt(req, CURLOPT_RESUME_FROM_LARGE, writtenToSink);
 
             /* Note that the underlying strings get copied by libcurl, so the path -> string conversion is ok:
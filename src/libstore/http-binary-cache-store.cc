@@ -285,6 +285,29 @@ void HttpBinaryCacheStore::getFile(const std::string & path, Sink & sink)
     }
 }
 
+std::string HttpBinaryCacheStore::getFileRange(const std::string & path, uint64_t offset, uint64_t length)
+{
+    if (length == 0)
+        return "";
+    checkEnabled();
+    auto request(makeRequest(path));
+    request.byteRange = {offset, length};
+    try {
+        auto result = fileTransfer->download(std::move(request));
+        /* The server may have ignored the range and sent the whole
+           file. */
+        if (result.data.size() != length)
+            throw Unsupported("binary cache '%s' does not support range requests", config->getHumanReadableURI());
+        return std::move(result.data);
+    } catch (FileTransferError & e) {
+        if (e.error == FileTransfer::NotFound || e.error == FileTransfer::Forbidden)
+            throw NoSuchBinaryCacheFile(
+                "file '%s' does not exist in binary cache '%s'", path, config->getHumanReadableURI());
+        maybeDisable();
+        throw;
+    }
+}
+
 void HttpBinaryCacheStore::getFile(const std::string & path, Callback<std::optional<std::string>> callback) noexcept
 {
     auto callbackPtr = std::make_shared<decltype(callback)>(std::move(callback));
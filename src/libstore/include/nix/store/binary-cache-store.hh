@@ -64,6 +64,18 @@ struct BinaryCacheStoreConfig : virtual StoreConfig
           If not set explicitly, defaults to `true` when `compression` is `zstd` and `false` otherwise.
         )"};
 
+    Setting<bool> seekableCompression{
+        this,
+        false,
+        "seekable-compression",
+        R"(
+          Whether to append a seek table in the [zstd seekable format](https://github.com/facebook/zstd/blob/dev/contrib/seekable_format/zstd_seekable_compression_format.md) to compressed NARs.
+          This only has an effect if `compression` is `zstd` and `write-nar-listing` is enabled.
+          It allows commands such as `nix store cat` to fetch and decompress only the parts of a NAR they need, using HTTP range requests for remote binary caches.
+          NARs are then compressed in frames of 1 MiB, which slightly reduces the compression ratio.
+          Decoders that don't support the seekable format ignore the seek table.
+        )"};
+
     Setting<int> compressionLevel{
         this,
         -1,
@@ -165,6 +177,32 @@ public:
 
     std::optional<std::string> getFile(const std::string & path);
 
+    /**
+     * Return the location of `path` in the local file system, if this
+     * binary cache is stored there.
+     */
+    virtual std::optional<std::filesystem::path> getLocalFilePath(const std::string & path)
+    {
+        return std::nullopt;
+    }
+
+    /**
+     * Return the bytes `[offset, offset + length)` of `path`. The
+     * default implementation only works for binary caches in the
+     * local file system, and throws `Unsupported` otherwise.
+     */
+    virtual std::string getFileRange(const std::string & path, uint64_t offset, uint64_t length);
+
+    /**
+     * Return an accessor that reads the NAR of `storePath` directly
+     * from the binary cache, using its `.ls` listing to locate files,
+     * rather than fetching the whole NAR. This is possible for
+     * uncompressed NARs in a binary cache in the local file system,
+     * and for NARs written with `seekable-compression` in caches that
+     * support `getFileRange()`. Otherwise return null.
+     */
+    std::shared_ptr<SourceAccessor> openSeekableNarAccessor(const StorePath & storePath);
+
 public:
 
     virtual void init() override;
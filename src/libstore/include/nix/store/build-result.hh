@@ -190,6 +190,13 @@ struct BuildResult
      */
     std::optional<std::chrono::microseconds> cpuUser, cpuSystem;
 
+    /**
+     * The peak memory usage of the build in bytes. Only available for
+     * local builds that run in a cgroup (see the `use-cgroups`
+     * setting).
+     */
+    std::optional<uint64_t> memoryPeak;
+
     bool operator==(const BuildResult &) const noexcept;
     std::strong_ordering operator<=>(const BuildResult &) const noexcept;
 };
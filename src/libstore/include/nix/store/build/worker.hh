@@ -8,6 +8,10 @@
 #include "nix/store/build-result.hh"
 #include "nix/store/realisation.hh"
 #include "nix/util/muxable-pipe.hh"
+#include "nix/util/timer-wheel.hh"
+#ifdef __linux__
+#  include "nix/util/epoll.hh"
+#endif
 
 #include <functional>
 #include <future>
@@ -51,7 +55,6 @@ typedef std::chrono::time_point<std::chrono::steady_clock> steady_time_point;
 struct Child
 {
     WeakGoalPtr goal;
-    Goal * goal2; // ugly hackery
     std::set<MuxablePipePollState::CommChannel> channels;
     bool respectTimeouts;
     bool inBuildSlot;
@@ -62,6 +65,26 @@ struct Child
     steady_time_point timeStarted;
 };
 
+/**
+ * A pending timeout of a child. Timers are not cancelled when the
+ * child terminates or produces output, so they have to be checked
+ * against the current state of the child when they expire.
+ */
+struct ChildTimer
+{
+    enum Kind { MaxSilentTime, BuildTimeout };
+
+    Goal * goal;
+
+    /**
+     * Identifies the child, since goals may start several children
+     * over their lifetime.
+     */
+    steady_time_point timeStarted;
+
+    Kind kind;
+};
+
 #ifndef _WIN32 // TODO Enable building on Windows
 /* Forward definition. */
 struct HookInstance;
@@ -100,7 +123,44 @@ private:
     /**
      * Child processes currently running.
      */
-    std::list<Child> children;
+    std::map<Goal *, Child> children;
+
+    /**
+     * Timeouts (`max-silent-time` and `timeout`) of the children that
+     * respect them.
+     */
+    TimerWheel<ChildTimer> childTimers;
+
+#ifdef __linux__
+    /**
+     * The channels of all children and the wakeup pipe, registered
+     * with the kernel once rather than on every call to
+     * `waitForInput()`.
+     */
+    linux::Epoll epoll;
+
+    struct EpollChannel
+    {
+        uint32_t generation;
+        Goal * goal;
+    };
+
+    /**
+     * The child channels registered with `epoll`. The token of a
+     * registration is the file descriptor in the upper 32 bits and its
+     * generation in the lower 32 bits, so that we can ignore events
+     * for file descriptors that have been closed and reused. Token 0
+     * is the wakeup pipe.
+     */
+    std::map<Descriptor, EpollChannel> epollChannels;
+
+    uint32_t epollGeneration = 0;
+
+    void registerChannels(Goal * goal, const Child & child);
+    void unregisterChannels(Goal * goal, const Child & child);
+#endif
+
+    void scheduleTimers(Goal * goal, const Child & child);
 
     /**
      * Number of build slots occupied.  This includes local builds but does not
@@ -141,6 +201,25 @@ private:
      */
     steady_time_point lastWokenUp;
 
+    /**
+     * The peak memory usage (in bytes) of recent local builds, used by
+     * `adaptive-build-concurrency`. This is the largest peak seen so
+     * far, but it decays with every build that finishes, so that a
+     * single large build doesn't throttle all the builds after it.
+     */
+    uint64_t recentBuildMemoryPeak = 0;
+
+    /**
+     * When `localBuildSlotAvailable()` last checked whether the system
+     * is overloaded, and the outcome. Reading the pressure stall
+     * information is cheap but not free, and many goals may ask in a
+     * row.
+     */
+    steady_time_point lastLoadCheck = steady_time_point::min();
+    bool systemOverloaded = false;
+
+    bool isSystemOverloaded();
+
     /**
      * Cache for pathContentsGood().
      */
@@ -310,6 +389,19 @@ public:
      */
     size_t getNrLocalBuilds();
 
+    /**
+     * Whether a new local build may be started now. This takes into
+     * account `max-jobs` and, if `adaptive-build-concurrency` is
+     * enabled, the current load of the system.
+     */
+    bool localBuildSlotAvailable();
+
+    /**
+     * Record the resource usage of a finished local build, to inform
+     * future `localBuildSlotAvailable()` decisions.
+     */
+    void recordBuildResources(const BuildResult & result);
+
     /**
      * Return the number of substitution processes currently running.
      */
@@ -25,6 +25,17 @@ struct CommonSSHStoreConfig : virtual StoreConfig
 
     Setting<bool> compress{this, false, "compress", "Whether to enable SSH compression."};
 
+    Setting<unsigned int> controlPersist{
+        this,
+        0,
+        "control-persist",
+        R"(
+          If non-zero, share a single SSH master connection to the remote machine between all Nix processes
+          (using a control socket in `$XDG_CACHE_HOME/nix/ssh`), and keep it open for this many seconds after
+          the last connection using it is closed.
+          This avoids an SSH handshake for every new connection, e.g. for every remote build.
+        )"};
+
     Setting<std::string> remoteStore{
         this,
         "",
@@ -281,6 +281,14 @@ struct FileTransferRequest
     std::optional<UploadData> data;
     std::string mimeType;
 
+    /**
+     * If set, only download the bytes `[first, first + length)` of
+     * the resource, given as a `(first, length)` pair, using a byte
+     * range request. Servers may ignore this and return the entire
+     * resource.
+     */
+    std::optional<std::pair<uint64_t, uint64_t>> byteRange;
+
     /**
      * Callbacked invoked with a chunk of received data.
      * Can pause the transfer by returning PauseTransfer::Yes. No data must be consumed
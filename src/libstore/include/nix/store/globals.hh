@@ -37,8 +37,13 @@ struct LogFileSettings : public virtual Config
         "compress-build-log",
         R"(
           If set to `true` (the default), build logs written to
-          `/nix/var/log/nix/drvs` are compressed on the fly using bzip2.
+          `/nix/var/log/nix/drvs` are compressed on the fly using zstd.
           Otherwise, they are not compressed.
+
+          Compressed logs include an index that allows commands like
+          `nix log --tail` to read the end of a large log without
+          decompressing all of it. Logs compressed using bzip2 by older
+          versions of Nix can still be read.
         )",
         {"build-compress-log"}};
 };
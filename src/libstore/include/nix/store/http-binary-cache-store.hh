@@ -149,6 +149,8 @@ protected:
 
     void getFile(const std::string & path, Sink & sink) override;
 
+    std::string getFileRange(const std::string & path, uint64_t offset, uint64_t length) override;
+
     void getFile(const std::string & path, Callback<std::optional<std::string>> callback) noexcept override;
 
     std::optional<std::string> getNixCacheInfo() override;
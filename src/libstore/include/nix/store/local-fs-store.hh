@@ -127,6 +127,16 @@ struct alignas(8) /* Work around ASAN failures on i686-linux. */
     }
 
     std::optional<std::string> getBuildLogExact(const StorePath & path) override;
+
+    std::optional<std::string> getBuildLogTailExact(const StorePath & path, size_t nrLines) override;
+
+private:
+    /**
+     * Read the build log of the given derivation (or its last `tail`
+     * lines), trying the locations and formats used by various
+     * versions of Nix.
+     */
+    std::optional<std::string> readBuildLog(const StorePath & path, std::optional<size_t> tail);
 };
 
 } // namespace nix
@@ -250,6 +250,21 @@ struct LocalSettings : public virtual Config, public GCSettings, public AutoAllo
     Setting<size_t> narBufferSize{
         this, 32 * 1024 * 1024, "nar-buffer-size", "Maximum size of NARs before spilling them to disk."};
 
+    Setting<unsigned int> ingestThreads{
+        this,
+        0,
+        "ingest-threads",
+        R"(
+          The number of threads used to copy regular files when adding a
+          directory from the local file system to the Nix store (e.g. a
+          flake's `src = ./.`). Where the file system supports it, files
+          are copied using reflinks or `copy_file_range()`.
+
+          If set to `0` (the default), Nix uses the number of CPU cores.
+          If set to `1`, the directory is copied by serialising it to a
+          Nix archive and restoring it, as in previous versions.
+        )"};
+
     Setting<bool> allowSymlinkedStore{
         this,
         false,
@@ -436,6 +451,26 @@ struct LocalSettings : public virtual Config, public GCSettings, public AutoAllo
             description of the `size` option of `tmpfs` in mount(8). The default
             is `50%`.
         )"};
+
+    Setting<unsigned int> sandboxNetworkNamespacePoolSize{
+        this,
+        0,
+        "sandbox-netns-pool-size",
+        R"(
+            *Linux only*
+
+            The number of network namespaces (with the loopback interface
+            already up) that Nix creates ahead of time for sandboxed builds.
+            Creating and destroying a network namespace takes a significant
+            fraction of the sandbox setup time of small builds, so a pool
+            speeds up workloads with many tiny derivations. Each namespace is
+            used by a single build only. `0` disables the pool.
+
+            This requires Nix to run as root. Since the pre-created namespaces
+            are not owned by the builder's user namespace, builders cannot
+            reconfigure the network or use privileged network operations
+            (e.g. raw sockets or binding to ports below 1024).
+        )"};
 #endif
 
 #if defined(__linux__) || defined(__FreeBSD__)
@@ -297,6 +297,20 @@ public:
         const StorePathSet & references,
         RepairFlag repair) override;
 
+    /**
+     * Copies local directories into the store directly (and in
+     * parallel) rather than through a NAR, see
+     * `LocalSettings::ingestThreads`.
+     */
+    StorePath addToStore(
+        std::string_view name,
+        const SourcePath & path,
+        ContentAddressMethod method,
+        HashAlgorithm hashAlgo,
+        const StorePathSet & references,
+        PathFilter & filter,
+        RepairFlag repair) override;
+
     void addTempRoot(const StorePath & path) override;
 
 private:
@@ -0,0 +1,40 @@
+#pragma once
+///@file
+
+#include "nix/util/compression.hh"
+
+#include <filesystem>
+#include <optional>
+
+namespace nix {
+
+/**
+ * File name extension of build logs compressed with
+ * `makeBuildLogCompressionSink()`.
+ */
+constexpr std::string_view compressedBuildLogExtension = ".zst";
+
+/**
+ * Return a sink that compresses a build log with zstd in the seekable
+ * format. Before the seek table it stores an index of the number of
+ * lines in each frame, so that `readBuildLogFile()` can return the
+ * end of a large log without decompressing all of it. The output is
+ * readable by any zstd decoder.
+ */
+ref<CompressionSink> makeBuildLogCompressionSink(Sink & nextSink);
+
+/**
+ * Return the contents of the build log file `path`, which is
+ * decompressed according to its extension (`.zst`, or `.bz2` for logs
+ * written by older versions of Nix). If `tail` is set, return only
+ * the last `tail` lines.
+ */
+std::string readBuildLogFile(const std::filesystem::path & path, std::optional<size_t> tail = std::nullopt);
+
+/**
+ * Return the last `n` lines of `s`. A trailing newline does not start
+ * another line.
+ */
+std::string_view lastLines(std::string_view s, size_t n);
+
+} // namespace nix
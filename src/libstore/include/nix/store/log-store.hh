@@ -17,6 +17,19 @@ struct LogStore : public virtual Store
 
     virtual std::optional<std::string> getBuildLogExact(const StorePath & path) = 0;
 
+    /**
+     * Like `getBuildLog()`, but return only the last `nrLines` lines
+     * of the log.
+     */
+    std::optional<std::string> getBuildLogTail(const StorePath & path, size_t nrLines);
+
+    /**
+     * Return the last `nrLines` lines of the build log of the
+     * specified derivation. The default implementation fetches the
+     * entire log; stores that can do better override this.
+     */
+    virtual std::optional<std::string> getBuildLogTailExact(const StorePath & path, size_t nrLines);
+
     virtual void addBuildLog(const StorePath & path, std::string_view log) = 0;
 
     static LogStore & require(Store & store);
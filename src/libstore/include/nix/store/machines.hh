@@ -3,6 +3,7 @@
 
 #include "nix/util/ref.hh"
 #include "nix/store/store-reference.hh"
+#include "nix/store/path.hh"
 
 namespace nix {
 
@@ -79,4 +80,43 @@ struct Machine
     static Machines parseConfig(const StringSet & defaultSystems, const std::string & config);
 };
 
+/**
+ * A machine that has a free build slot.
+ */
+struct MachineCandidate
+{
+    const Machine * machine;
+
+    /**
+     * The number of builds currently running on the machine.
+     */
+    uint64_t load;
+
+    /**
+     * The estimated number of bytes of the inputs of the build that
+     * would have to be copied to the machine.
+     */
+    uint64_t missingBytes = 0;
+};
+
+/**
+ * Choose the machine to build on, and return its index in
+ * `candidates` (or `std::nullopt` if `candidates` is empty).
+ *
+ * Machines are ranked by `load / speedFactor`. If `localityBytes` is
+ * non-zero, every `localityBytes` bytes of missing inputs count as
+ * much as one build running on a machine with a speed factor of 1.
+ * Ties are broken in favour of faster, and then less loaded, machines.
+ */
+std::optional<size_t> chooseMachine(const std::vector<MachineCandidate> & candidates, uint64_t localityBytes = 0);
+
+/**
+ * Estimate how many bytes would have to be copied from `srcStore` to a
+ * machine to make `paths` valid there, given the subset `validPaths`
+ * of `paths` that is already valid on the machine. This is the total
+ * NAR size of the other paths. It doesn't compute the closure of
+ * `paths`.
+ */
+uint64_t estimateMissingBytes(Store & srcStore, const StorePathSet & paths, const StorePathSet & validPaths);
+
 } // namespace nix
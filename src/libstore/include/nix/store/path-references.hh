@@ -78,4 +78,25 @@ void scanForReferencesDeep(
 std::map<CanonPath, StorePathSet>
 scanForReferencesDeep(SourceAccessor & accessor, const CanonPath & rootPath, const StorePathSet & refs);
 
+/**
+ * Apply `rewrites` to the file system object at `path` in place. The
+ * result is the same as rewriting the NAR serialisation of `path`
+ * with a `RewritingSink` and restoring it: the contents of regular
+ * files, the targets of symlinks and the names of directory entries
+ * are rewritten.
+ *
+ * Unlike a NAR round trip, this only replaces the files that contain
+ * one of the strings to be rewritten, by writing a rewritten copy
+ * next to them and renaming it over the original. Files are never
+ * modified in place, so hard links to files outside of `path` are
+ * not affected. All other files are left alone.
+ *
+ * The metadata of replaced files is not canonical afterwards.
+ *
+ * @note The rewritten strings must have the same length as the
+ * originals, and matches that span multiple files or file names are
+ * not rewritten.
+ */
+void rewritePathInPlace(const std::filesystem::path & path, const StringMap & rewrites);
+
 } // namespace nix
@@ -27,6 +27,14 @@ private:
     const bool compress;
     const Descriptor logFD;
 
+    /**
+     * If non-zero, the master connection is shared with other Nix
+     * processes through a socket in the user's cache directory, and
+     * is kept open for this many seconds after the last connection
+     * using it is closed.
+     */
+    const unsigned int controlPersist;
+
     const ref<const AutoDelete> tmpDir;
 
     struct State
@@ -35,12 +43,27 @@ private:
         Pid sshMaster;
 #endif
         std::filesystem::path socketPath;
+
+        /**
+         * Whether we are using a master started by some other (possibly
+         * exited) process, or one that we've started with
+         * `ControlPersist`. Either way, we don't own it.
+         */
+        bool sharedMaster = false;
     };
 
     Sync<State> state_;
 
     void addCommonSSHOpts(OsStrings & args);
-    bool isMasterRunning();
+    bool isMasterRunning(const std::filesystem::path & socketPath = {});
+
+    /**
+     * The control socket path used when `controlPersist` is non-zero.
+     * It only depends on the SSH destination and the options that
+     * affect authentication, so that all Nix processes connecting to
+     * the same host share it.
+     */
+    std::filesystem::path getSharedSocketPath();
 
 #ifndef _WIN32 // TODO re-enable on Windows, once we can start processes.
     std::filesystem::path startMaster();
@@ -54,7 +77,8 @@ public:
         std::string_view sshPublicHostKey,
         bool useMaster,
         bool compress,
-        Descriptor logFD = INVALID_DESCRIPTOR);
+        Descriptor logFD = INVALID_DESCRIPTOR,
+        unsigned int controlPersist = 0);
 
     struct Connection
     {
@@ -70,6 +70,14 @@ struct MissingPaths
     StorePathSet unknown;
     uint64_t downloadSize{0};
     uint64_t narSize{0};
+
+    /**
+     * How much work it took to find the above, for diagnostics. These
+     * are not sent over the daemon protocol.
+     */
+    uint64_t nrDerivationsRead{0};
+    uint64_t nrSubstituterQueries{0};
+    uint64_t nrRealisationQueries{0};
 };
 
 /**
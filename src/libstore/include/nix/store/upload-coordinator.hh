@@ -0,0 +1,37 @@
+#pragma once
+///@file
+
+#include "nix/store/store-api.hh"
+
+#include <chrono>
+
+namespace nix {
+
+/**
+ * Like `copyPaths()`, but coordinate with other processes (or
+ * threads) copying paths to the same destination store, such as
+ * concurrent remote builds on the same machine.
+ *
+ * Each path is uploaded while holding a lock file in `lockDir` named
+ * after the path, so that `lockDir` must be specific to `dstStore`.
+ * Paths that are already being uploaded by somebody else are not sent
+ * again: we wait for them to become valid, uploading other paths in
+ * the meantime. A path whose references are still in flight elsewhere
+ * is only uploaded once they've arrived, so that paths are added in
+ * topological order. If an upload we're waiting for fails, we upload
+ * the path ourselves. If we've waited for the same path for
+ * `lockTimeout`, we give up on coordination and upload all remaining
+ * paths ourselves.
+ *
+ * Like `copyPaths()`, this doesn't compute the closure of `paths`.
+ */
+void copyPathsCoordinated(
+    Store & srcStore,
+    Store & dstStore,
+    const StorePathSet & paths,
+    const std::filesystem::path & lockDir,
+    CheckSigsFlag checkSigs = CheckSigs,
+    SubstituteFlag substitute = NoSubstitute,
+    std::chrono::seconds lockTimeout = std::chrono::minutes(15));
+
+} // namespace nix
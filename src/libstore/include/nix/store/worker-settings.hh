@@ -81,6 +81,88 @@ public:
         )",
         {"substitution-max-jobs"}};
 
+    Setting<unsigned int> maxSubstitutionQueries{
+        this,
+        1024,
+        "max-substitution-queries",
+        R"(
+          The maximum number of store paths and derivations that Nix
+          examines concurrently when determining which paths need to be
+          built or substituted (e.g. for `nix build --dry-run`, or
+          before starting a build). Each of them may involve reading a
+          derivation or querying the substituters. The minimum value is
+          `1` and lower values are interpreted as `1`.
+
+          Note that the number of simultaneous connections to HTTP
+          binary caches is separately limited by
+          [`http-connections`](#conf-http-connections).
+        )"};
+
+    Setting<bool> adaptiveBuildConcurrency{
+        this,
+        false,
+        "adaptive-build-concurrency",
+        R"(
+          *Linux only*
+
+          If set to `true`, Nix treats [`max-jobs`](#conf-max-jobs) as an
+          upper bound and only starts another local build if the system is
+          not overloaded. This is determined from the kernel's
+          [pressure stall information](https://docs.kernel.org/accounting/psi.html)
+          (see [`max-cpu-pressure`](#conf-max-cpu-pressure),
+          [`max-memory-pressure`](#conf-max-memory-pressure) and
+          [`max-io-pressure`](#conf-max-io-pressure)) and, if
+          [`use-cgroups`](#conf-use-cgroups) is enabled, from the peak memory
+          usage of previous builds: a new build is only started if the
+          available memory exceeds the largest peak seen so far. That peak
+          shrinks by a quarter whenever a build with a smaller peak
+          finishes, so one large build doesn't hold back all later ones.
+
+          Builds that are held back are retried every
+          [`build-poll-interval`](#conf-build-poll-interval) seconds. One
+          local build is always allowed to run.
+        )"};
+
+    Setting<unsigned int> maxCpuPressure{
+        this,
+        80,
+        "max-cpu-pressure",
+        R"(
+          *Linux only*
+
+          If [`adaptive-build-concurrency`](#conf-adaptive-build-concurrency)
+          is enabled, the percentage of time in the last 10 seconds during
+          which some tasks were waiting for a CPU (`some avg10` in
+          `/proc/pressure/cpu`) above which no new local builds are started.
+        )"};
+
+    Setting<unsigned int> maxMemoryPressure{
+        this,
+        10,
+        "max-memory-pressure",
+        R"(
+          *Linux only*
+
+          If [`adaptive-build-concurrency`](#conf-adaptive-build-concurrency)
+          is enabled, the percentage of time in the last 10 seconds during
+          which some tasks were stalled on memory (`some avg10` in
+          `/proc/pressure/memory`) above which no new local builds are
+          started.
+        )"};
+
+    Setting<unsigned int> maxIoPressure{
+        this,
+        50,
+        "max-io-pressure",
+        R"(
+          *Linux only*
+
+          If [`adaptive-build-concurrency`](#conf-adaptive-build-concurrency)
+          is enabled, the percentage of time in the last 10 seconds during
+          which some tasks were stalled on I/O (`some avg10` in
+          `/proc/pressure/io`) above which no new local builds are started.
+        )"};
+
     Setting<time_t> maxSilentTime{
         this,
         0,
@@ -251,6 +333,30 @@ public:
         {},
         false};
 
+    Setting<unsigned int> buildersControlPersist{
+        this,
+        0,
+        "builders-control-persist",
+        R"(
+          If non-zero, connections to [remote build machines](#conf-builders) that use the `ssh://` or `ssh-ng://` protocol share an SSH master connection across builds, which is kept open for this many seconds after the last build using it has finished.
+          This avoids an SSH handshake for every remote build, which can dominate the time spent on short builds.
+
+          This sets the `control-persist` store setting of the machine, unless the store URL in the machine specification sets it explicitly.
+        )"};
+
+    Setting<uint64_t> buildersLocalityBytes{
+        this,
+        0,
+        "builders-locality-bytes",
+        R"(
+          If non-zero, prefer [remote build machines](#conf-builders) that already have more of the inputs of a build, instead of selecting machines based only on their current load and speed factor.
+          Every `builders-locality-bytes` bytes of inputs that would have to be copied to a machine weigh as much as one build running on a machine with a speed factor of 1.
+          For example, with a value of `1073741824` (1 GiB), a machine that is missing 2 GiB of inputs is only chosen over an idle machine that has all of them if two more builds are running on the latter.
+
+          To estimate what they're missing, Nix queries the machines for the validity of the input closure of the build.
+          The results are shared between builds for a minute.
+        )"};
+
     Setting<bool> alwaysAllowSubstitutes{
         this,
         false,
@@ -0,0 +1,357 @@
+#include "store-config-private.hh"
+
+#include "nix/store/build-sandbox.hh"
+#include "nix/store/config.hh"
+#include "nix/util/finally.hh"
+#include "nix/util/logging.hh"
+#include "nix/util/processes.hh"
+#include "nix/util/sync.hh"
+#include "linux/fchmodat2-compat.hh"
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <net/if.h>
+#include <netinet/ip.h>
+#include <sched.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <linux/filter.h>
+#include <linux/seccomp.h>
+
+#if HAVE_SECCOMP
+#  include <seccomp.h>
+#endif
+
+namespace nix::linux {
+
+#if HAVE_SECCOMP
+
+static std::vector<sock_filter> buildSeccompFilter()
+{
+    scmp_filter_ctx ctx;
+
+    if (!(ctx = seccomp_init(SCMP_ACT_ALLOW)))
+        throw SysError("unable to initialize seccomp mode 2");
+
+    Finally cleanup([&]() { seccomp_release(ctx); });
+
+    constexpr std::string_view nativeSystem = NIX_LOCAL_SYSTEM;
+
+    if (nativeSystem == "x86_64-linux" && seccomp_arch_add(ctx, SCMP_ARCH_X86) != 0)
+        throw SysError("unable to add 32-bit seccomp architecture");
+
+    if (nativeSystem == "x86_64-linux" && seccomp_arch_add(ctx, SCMP_ARCH_X32) != 0)
+        throw SysError("unable to add X32 seccomp architecture");
+
+    if (nativeSystem == "aarch64-linux" && seccomp_arch_add(ctx, SCMP_ARCH_ARM) != 0)
+        printError(
+            "unable to add ARM seccomp architecture; this may result in spurious build failures if running 32-bit ARM processes");
+
+    if (nativeSystem == "mips64-linux" && seccomp_arch_add(ctx, SCMP_ARCH_MIPS) != 0)
+        printError("unable to add mips seccomp architecture");
+
+    if (nativeSystem == "mips64-linux" && seccomp_arch_add(ctx, SCMP_ARCH_MIPS64N32) != 0)
+        printError("unable to add mips64-*abin32 seccomp architecture");
+
+    if (nativeSystem == "mips64el-linux" && seccomp_arch_add(ctx, SCMP_ARCH_MIPSEL) != 0)
+        printError("unable to add mipsel seccomp architecture");
+
+    if (nativeSystem == "mips64el-linux" && seccomp_arch_add(ctx, SCMP_ARCH_MIPSEL64N32) != 0)
+        printError("unable to add mips64el-*abin32 seccomp architecture");
+
+    /* Prevent builders from creating setuid/setgid binaries. */
+    for (int perm : {S_ISUID, S_ISGID}) {
+        if (seccomp_rule_add(
+                ctx,
+                SCMP_ACT_ERRNO(EPERM),
+                SCMP_SYS(chmod),
+                1,
+                SCMP_A1(SCMP_CMP_MASKED_EQ, (scmp_datum_t) perm, (scmp_datum_t) perm))
+            != 0)
+            throw SysError("unable to add seccomp rule");
+
+        if (seccomp_rule_add(
+                ctx,
+                SCMP_ACT_ERRNO(EPERM),
+                SCMP_SYS(fchmod),
+                1,
+                SCMP_A1(SCMP_CMP_MASKED_EQ, (scmp_datum_t) perm, (scmp_datum_t) perm))
+            != 0)
+            throw SysError("unable to add seccomp rule");
+
+        if (seccomp_rule_add(
+                ctx,
+                SCMP_ACT_ERRNO(EPERM),
+                SCMP_SYS(fchmodat),
+                1,
+                SCMP_A2(SCMP_CMP_MASKED_EQ, (scmp_datum_t) perm, (scmp_datum_t) perm))
+            != 0)
+            throw SysError("unable to add seccomp rule");
+
+        if (seccomp_rule_add(
+                ctx,
+                SCMP_ACT_ERRNO(EPERM),
+                NIX_SYSCALL_FCHMODAT2,
+                1,
+                SCMP_A2(SCMP_CMP_MASKED_EQ, (scmp_datum_t) perm, (scmp_datum_t) perm))
+            != 0)
+            throw SysError("unable to add seccomp rule");
+    }
+
+    /* Prevent builders from using EAs or ACLs. Not all filesystems
+       support these, and they're not allowed in the Nix store because
+       they're not representable in the NAR serialisation. */
+    if (seccomp_rule_add(ctx, SCMP_ACT_ERRNO(ENOTSUP), SCMP_SYS(listxattr), 0) != 0
+        || seccomp_rule_add(ctx, SCMP_ACT_ERRNO(ENOTSUP), SCMP_SYS(llistxattr), 0) != 0
+        || seccomp_rule_add(ctx, SCMP_ACT_ERRNO(ENOTSUP), SCMP_SYS(flistxattr), 0) != 0
+        || seccomp_rule_add(ctx, SCMP_ACT_ERRNO(ENOTSUP), SCMP_SYS(getxattr), 0) != 0
+        || seccomp_rule_add(ctx, SCMP_ACT_ERRNO(ENOTSUP), SCMP_SYS(lgetxattr), 0) != 0
+        || seccomp_rule_add(ctx, SCMP_ACT_ERRNO(ENOTSUP), SCMP_SYS(fgetxattr), 0) != 0
+        || seccomp_rule_add(ctx, SCMP_ACT_ERRNO(ENOTSUP), SCMP_SYS(setxattr), 0) != 0
+        || seccomp_rule_add(ctx, SCMP_ACT_ERRNO(ENOTSUP), SCMP_SYS(lsetxattr), 0) != 0
+        || seccomp_rule_add(ctx, SCMP_ACT_ERRNO(ENOTSUP), SCMP_SYS(fsetxattr), 0) != 0)
+        throw SysError("unable to add seccomp rule");
+
+    /* The 'no new privileges' flag is set by the builder itself
+       (depending on `allow-new-privileges`) before loading the
+       filter, so don't let libseccomp set it. */
+    if (seccomp_attr_set(ctx, SCMP_FLTATR_CTL_NNP, 0) != 0)
+        throw SysError("unable to set 'no new privileges' seccomp attribute");
+
+    /* libseccomp can only export the BPF program to a file
+       descriptor. */
+    AutoCloseFD fd = memfd_create("nix-seccomp", MFD_CLOEXEC);
+    if (!fd)
+        throw SysError("creating memfd for seccomp BPF program");
+
+    if (auto res = seccomp_export_bpf(ctx, fd.get()); res != 0) {
+        errno = -res;
+        throw SysError("unable to export seccomp BPF program");
+    }
+
+    if (lseek(fd.get(), 0, SEEK_SET) == -1)
+        throw SysError("seeking seccomp BPF program");
+
+    auto bpf = drainFD(fd.get());
+    if (bpf.size() % sizeof(sock_filter) != 0)
+        throw Error("seccomp BPF program has unexpected size %d", bpf.size());
+
+    std::vector<sock_filter> filter(bpf.size() / sizeof(sock_filter));
+    std::ranges::copy(bpf, reinterpret_cast<char *>(filter.data()));
+    return filter;
+}
+
+/**
+ * The filter is the same for every build, so compile it only once.
+ * This is a function-local static so that concurrent first calls are
+ * safe.
+ */
+static const std::vector<sock_filter> & getSeccompFilter()
+{
+    static const std::vector<sock_filter> filter = buildSeccompFilter();
+    return filter;
+}
+
+#else
+
+[[noreturn]] static void throwSeccompUnsupported()
+{
+    throw Error(
+        "seccomp is not supported on this platform; "
+        "you can bypass this error by setting the option 'filter-syscalls' to false, but note that untrusted builds can then create setuid binaries!");
+}
+
+#endif
+
+void prepareSeccompFilter()
+{
+#if HAVE_SECCOMP
+    getSeccompFilter();
+#endif
+}
+
+void loadSeccompFilter()
+{
+#if HAVE_SECCOMP
+    auto & filter = getSeccompFilter();
+
+    struct sock_fprog prog = {
+        .len = (unsigned short) filter.size(),
+        .filter = const_cast<sock_filter *>(filter.data()),
+    };
+
+    if (prctl(PR_SET_SECCOMP, SECCOMP_MODE_FILTER, &prog) == -1)
+        throw SysError("unable to load seccomp BPF program");
+#else
+    throwSeccompUnsupported();
+#endif
+}
+
+size_t compileSeccompFilter()
+{
+#if HAVE_SECCOMP
+    return buildSeccompFilter().size();
+#else
+    throwSeccompUnsupported();
+#endif
+}
+
+void setUpLoopbackInterface()
+{
+    AutoCloseFD fd(socket(PF_INET, SOCK_DGRAM, IPPROTO_IP));
+    if (!fd)
+        throw SysError("cannot open IP socket");
+
+    using namespace std::string_view_literals;
+    struct ifreq ifr = {};
+    std::ranges::copy("lo"sv, ifr.ifr_name);
+    ifr.ifr_flags = IFF_UP | IFF_LOOPBACK | IFF_RUNNING;
+    if (ioctl(fd.get(), SIOCSIFFLAGS, &ifr) == -1)
+        throw SysError("cannot set loopback interface flags");
+}
+
+AutoCloseFD createNetworkNamespace()
+{
+    /* Do the unshare() in a child process, since we can't move the
+       calling thread back to its original namespace reliably. The
+       child keeps the namespace alive until we've opened it. */
+    Pipe ready, done;
+    ready.create();
+    done.create();
+
+    Pid child = startProcess([&]() {
+        ready.readSide.close();
+        done.writeSide.close();
+
+        if (unshare(CLONE_NEWNET) == -1)
+            throw SysError("creating network namespace");
+
+        setUpLoopbackInterface();
+
+        writeFull(ready.writeSide.get(), "1\n");
+
+        char c;
+        [[maybe_unused]] auto res = read(done.readSide.get(), &c, 1);
+        _exit(0);
+    });
+
+    ready.writeSide.close();
+    done.readSide.close();
+
+    if (readLine(ready.readSide.get(), true) != "1") {
+        child.wait();
+        throw Error("unable to create network namespace");
+    }
+
+    auto nsPath = fmt("/proc/%d/ns/net", (pid_t) child);
+    AutoCloseFD fd = open(nsPath.c_str(), O_RDONLY | O_CLOEXEC);
+    if (!fd)
+        throw SysError("opening '%s'", nsPath);
+
+    done.writeSide.close();
+    child.wait();
+
+    return fd;
+}
+
+namespace {
+
+/**
+ * A set of network namespaces created ahead of time by a background
+ * thread. Each namespace is handed out only once.
+ */
+struct NetworkNamespacePool
+{
+    struct State
+    {
+        std::deque<AutoCloseFD> namespaces;
+        size_t poolSize = 0;
+        bool disabled = false;
+        bool quit = false;
+        std::thread thread;
+    };
+
+    Sync<State> state_;
+
+    std::condition_variable wakeup;
+
+    ~NetworkNamespacePool()
+    {
+        std::thread thread;
+        {
+            auto state(state_.lock());
+            state->quit = true;
+            thread = std::move(state->thread);
+        }
+        wakeup.notify_all();
+        if (thread.joinable())
+            thread.join();
+    }
+
+    void refill()
+    {
+        while (true) {
+            {
+                auto state(state_.lock());
+                state.wait(wakeup, [&]() { return state->quit || state->namespaces.size() < state->poolSize; });
+                if (state->quit)
+                    return;
+            }
+
+            try {
+                auto fd = createNetworkNamespace();
+                state_.lock()->namespaces.push_back(std::move(fd));
+            } catch (Error & e) {
+                debug("disabling the network namespace pool: %s", e.msg());
+                auto state(state_.lock());
+                state->disabled = true;
+                state->namespaces.clear();
+                return;
+            }
+        }
+    }
+
+    std::optional<AutoCloseFD> take(size_t poolSize)
+    {
+        auto state(state_.lock());
+
+        if (state->disabled)
+            return std::nullopt;
+
+        state->poolSize = poolSize;
+
+        if (!state->thread.joinable())
+            state->thread = std::thread([this]() { refill(); });
+
+        std::optional<AutoCloseFD> fd;
+        if (!state->namespaces.empty()) {
+            fd = std::move(state->namespaces.front());
+            state->namespaces.pop_front();
+        }
+
+        wakeup.notify_one();
+
+        return fd;
+    }
+};
+
+} // namespace
+
+std::optional<AutoCloseFD> takePooledNetworkNamespace(size_t poolSize)
+{
+    if (poolSize == 0)
+        return std::nullopt;
+
+    static NetworkNamespacePool pool;
+    return pool.take(poolSize);
+}
+
+} // namespace nix::linux
@@ -0,0 +1,51 @@
+#pragma once
+///@file
+
+#include "nix/util/file-descriptor.hh"
+
+#include <optional>
+
+namespace nix::linux {
+
+/**
+ * Compile the seccomp filter applied to builders (see the
+ * `filter-syscalls` setting). This is done once per process, since
+ * the filter doesn't depend on the build and compiling it with
+ * libseccomp is relatively expensive. Must be called before forking
+ * the builder, so that `loadSeccompFilter()` doesn't have to allocate.
+ */
+void prepareSeccompFilter();
+
+/**
+ * Load the filter compiled by `prepareSeccompFilter()` into the
+ * current process.
+ */
+void loadSeccompFilter();
+
+/**
+ * Compile the seccomp filter without caching it. Only useful for
+ * measuring the cost of doing so.
+ */
+size_t compileSeccompFilter();
+
+/**
+ * Bring up the loopback interface of the current network namespace.
+ */
+void setUpLoopbackInterface();
+
+/**
+ * Create a network namespace with the loopback interface up, and
+ * return a file descriptor referring to it. This requires
+ * `CAP_SYS_ADMIN`.
+ */
+AutoCloseFD createNetworkNamespace();
+
+/**
+ * Return a fresh network namespace created by a background thread
+ * that keeps up to `poolSize` namespaces ready, or `std::nullopt` if
+ * none is available right now (or they cannot be created). A
+ * `poolSize` of 0 disables the pool.
+ */
+std::optional<AutoCloseFD> takePooledNetworkNamespace(size_t poolSize);
+
+} // namespace nix::linux
@@ -95,6 +95,11 @@ protected:
         }
     }
 
+    std::optional<std::filesystem::path> getLocalFilePath(const std::string & path) override
+    {
+        return checkBinaryCachePath(config->binaryCacheDir, path);
+    }
+
     StorePathSet queryAllValidPaths() override
     {
         StorePathSet paths;
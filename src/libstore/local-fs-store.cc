@@ -1,6 +1,6 @@
 #include "nix/store/store-api.hh"
 #include "nix/store/local-fs-store.hh"
-#include "nix/util/compression.hh"
+#include "nix/store/log-file.hh"
 #include "nix/store/derivations.hh"
 
 namespace nix {
@@ -145,7 +145,7 @@ std::shared_ptr<SourceAccessor> LocalFSStore::getFSAccessor(const StorePath & pa
 
 const std::filesystem::path LocalFSStore::drvsLogDir = "drvs";
 
-std::optional<std::string> LocalFSStore::getBuildLogExact(const StorePath & path)
+std::optional<std::string> LocalFSStore::readBuildLog(const StorePath & path, std::optional<size_t> tail)
 {
     auto baseName = path.to_string();
 
@@ -153,16 +153,18 @@ std::optional<std::string> LocalFSStore::getBuildLogExact(const StorePath & path
 
         auto logPath = config.logDir.get()
                        / (j == 0 ? drvsLogDir / baseName.substr(0, 2) / baseName.substr(2) : drvsLogDir / baseName);
-        auto logBz2Path = logPath;
-        logBz2Path += ".bz2";
 
         if (pathExists(logPath))
-            return readFile(logPath);
-
-        else if (pathExists(logBz2Path)) {
-            try {
-                return decompress("bzip2", readFile(logBz2Path));
-            } catch (Error &) {
+            return readBuildLogFile(logPath, tail);
+
+        for (std::string_view extension : {compressedBuildLogExtension, std::string_view(".bz2")}) {
+            auto compressedLogPath = logPath;
+            compressedLogPath += extension;
+            if (pathExists(compressedLogPath)) {
+                try {
+                    return readBuildLogFile(compressedLogPath, tail);
+                } catch (Error &) {
+                }
             }
         }
     }
@@ -170,4 +172,14 @@ std::optional<std::string> LocalFSStore::getBuildLogExact(const StorePath & path
     return std::nullopt;
 }
 
+std::optional<std::string> LocalFSStore::getBuildLogExact(const StorePath & path)
+{
+    return readBuildLog(path, std::nullopt);
+}
+
+std::optional<std::string> LocalFSStore::getBuildLogTailExact(const StorePath & path, size_t nrLines)
+{
+    return readBuildLog(path, nrLines);
+}
+
 } // namespace nix
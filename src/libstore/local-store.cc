@@ -11,6 +11,7 @@
 #include "nix/util/topo-sort.hh"
 #include "nix/util/finally.hh"
 #include "nix/util/compression.hh"
+#include "nix/store/log-file.hh"
 #include "nix/util/signals.hh"
 #include "nix/store/posix-fs-canonicalise.hh"
 #include "nix/util/posix-source-accessor.hh"
@@ -1293,6 +1294,85 @@ StorePath LocalStore::addToStoreFromDump(
     return dstPath;
 }
 
+StorePath LocalStore::addToStore(
+    std::string_view name,
+    const SourcePath & path,
+    ContentAddressMethod method,
+    HashAlgorithm hashAlgo,
+    const StorePathSet & references,
+    PathFilter & filter,
+    RepairFlag repair)
+{
+    const LocalSettings & localSettings = config->getLocalSettings();
+
+    if (method.getFileIngestionMethod() != FileIngestionMethod::NixArchive || localSettings.ingestThreads == 1
+        || !path.getPhysicalPath() || path.lstat().type != SourceAccessor::tDirectory)
+        return Store::addToStore(name, path, method, hashAlgo, references, filter, repair);
+
+    auto [tempDir, tempDirFd] = createTempDirInStore();
+    AutoDelete delTempDir(tempDir);
+    auto tempPath = tempDir / "x";
+
+    copyPathParallel(path, tempPath, filter, localSettings.ingestThreads, localSettings.fsyncStorePaths);
+
+    /* Hash the copy rather than the original, so that the hash
+       describes exactly what ends up in the store even if the source
+       changes underneath us. */
+    HashSink narSink{HashAlgorithm::SHA256};
+    HashSink caSink{hashAlgo};
+    TeeSink bothSinks{narSink, caSink};
+    dumpPath(tempPath, hashAlgo == HashAlgorithm::SHA256 ? static_cast<Sink &>(narSink) : bothSinks);
+    auto narHash = narSink.finish();
+
+    if (settings.warnLargePathThreshold && narHash.numBytesDigested >= settings.warnLargePathThreshold)
+        warn("copied large path '%s' to the store (%s)", path, renderSize(narHash.numBytesDigested));
+
+    auto desc = ContentAddressWithReferences::fromParts(
+        method,
+        hashAlgo == HashAlgorithm::SHA256 ? narHash.hash : caSink.finish().hash,
+        {
+            .others = references,
+            .self = false,
+        });
+
+    auto dstPath = makeFixedOutputPathFromCA(name, desc);
+
+    addTempRoot(dstPath);
+
+    if (repair || !isValidPath(dstPath)) {
+
+        auto realPath = toRealPath(dstPath);
+
+        PathLocks outputLock({realPath});
+
+        if (repair || !isValidPath(dstPath)) {
+
+            deletePath(realPath);
+
+            autoGC();
+
+            moveFile(tempPath, realPath);
+
+            canonicalisePathMetaData(realPath, {NIX_WHEN_SUPPORT_ACLS(localSettings.ignoredAcls)});
+
+            optimisePath(realPath, repair);
+
+            if (localSettings.fsyncStorePaths) {
+                recursiveSync(realPath);
+                syncParent(realPath);
+            }
+
+            auto info = ValidPathInfo::makeFromCA(*this, name, std::move(desc), narHash.hash);
+            info.narSize = narHash.numBytesDigested;
+            registerValidPath(info);
+        }
+
+        outputLock.setDeletion(true);
+    }
+
+    return dstPath;
+}
+
 /* Create a temporary directory in the store that won't be
    garbage-collected until the returned FD is closed. */
 std::pair<std::filesystem::path, AutoCloseFD> LocalStore::createTempDirInStore()
@@ -1608,10 +1688,12 @@ void LocalStore::addBuildLog(const StorePath & drvPath, std::string_view log)
 
     auto baseName = drvPath.to_string();
 
-    auto logPath =
-        config->logDir.get() / drvsLogDir / baseName.substr(0, 2) / (std::string(baseName.substr(2)) + ".bz2");
+    auto logPath = config->logDir.get() / drvsLogDir / baseName.substr(0, 2) / std::string(baseName.substr(2));
+    auto legacyLogPath = logPath;
+    legacyLogPath += ".bz2";
+    logPath += compressedBuildLogExtension;
 
-    if (pathExists(logPath))
+    if (pathExists(logPath) || pathExists(legacyLogPath))
         return;
 
     createDirs(logPath.parent_path());
@@ -1619,7 +1701,11 @@ void LocalStore::addBuildLog(const StorePath & drvPath, std::string_view log)
     auto tmpFile = logPath;
     tmpFile += ".tmp." + std::to_string(getpid());
 
-    writeFile(tmpFile, compress(CompressionAlgo::bzip2, log));
+    StringSink compressed;
+    auto sink = makeBuildLogCompressionSink(compressed);
+    (*sink)(log);
+    sink->finish();
+    writeFile(tmpFile, compressed.s);
 
     std::filesystem::rename(tmpFile, logPath);
 }
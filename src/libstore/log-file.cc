@@ -0,0 +1,166 @@
+#include "nix/store/log-file.hh"
+#include "nix/util/file-system.hh"
+#include "nix/util/logging.hh"
+#include "nix/util/nar-accessor.hh"
+#include "nix/util/util.hh"
+
+#include <algorithm>
+
+namespace nix {
+
+/**
+ * The line index stored in the trailer of a compressed build log: this
+ * tag, followed by the number of newlines in each (non-empty) frame as
+ * 32-bit little-endian integers.
+ */
+static constexpr std::string_view lineIndexTag = "nix-log-lines-1\n";
+
+namespace {
+
+struct BuildLogCompressionSink : CompressionSink
+{
+    /**
+     * The number of newlines in each frame. The seekable zstd sink
+     * cuts a frame after every `seekableZstdBytesPerFrame` bytes of
+     * input, so we know where the boundaries are.
+     */
+    std::vector<uint32_t> linesPerFrame;
+    uint64_t written = 0;
+
+    ref<CompressionSink> zstd;
+
+    BuildLogCompressionSink(Sink & nextSink)
+        : zstd(makeSeekableZstdCompressionSink(nextSink, false, -1, [this]() { return serialiseIndex(); }))
+    {
+    }
+
+    std::string serialiseIndex() const
+    {
+        std::string s(lineIndexTag);
+        for (auto n : linesPerFrame)
+            for (int i = 0; i < 4; ++i)
+                s.push_back(static_cast<char>((n >> (8 * i)) & 0xff));
+        return s;
+    }
+
+    void writeUnbuffered(std::string_view data) override
+    {
+        while (!data.empty()) {
+            auto frame = written / seekableZstdBytesPerFrame;
+            if (linesPerFrame.size() <= frame)
+                linesPerFrame.push_back(0);
+            auto chunk = data.substr(0, (frame + 1) * seekableZstdBytesPerFrame - written);
+            linesPerFrame.back() += std::ranges::count(chunk, '\n');
+            (*zstd)(chunk);
+            written += chunk.size();
+            data.remove_prefix(chunk.size());
+        }
+    }
+
+    void finish() override
+    {
+        flush();
+        zstd->finish();
+    }
+};
+
+} // namespace
+
+ref<CompressionSink> makeBuildLogCompressionSink(Sink & nextSink)
+{
+    return make_ref<BuildLogCompressionSink>(nextSink);
+}
+
+std::string_view lastLines(std::string_view s, size_t n)
+{
+    if (n == 0)
+        return {};
+    size_t pos = s.size();
+    if (pos > 0 && s[pos - 1] == '\n')
+        --pos;
+    for (; n > 0; --n) {
+        auto i = pos == 0 ? s.npos : s.rfind('\n', pos - 1);
+        if (i == s.npos)
+            return s;
+        pos = i;
+    }
+    return s.substr(pos + 1);
+}
+
+/**
+ * Return the last `tail` lines of an indexed compressed build log,
+ * decompressing only the frames that contain them. Return
+ * `std::nullopt` if the log has no index.
+ */
+static std::optional<std::string> readIndexedTail(Descriptor fd, size_t tail)
+{
+    auto getBytes = seekableGetNarBytes(fd);
+    auto readRange = [&](uint64_t offset, uint64_t length) {
+        StringSink sink;
+        getBytes(offset, length, sink);
+        return std::move(sink.s);
+    };
+
+    auto seekTable = ZstdSeekTable::read(getFileSize(fd), readRange);
+    if (!seekTable || seekTable->frames.empty())
+        return std::nullopt;
+
+    auto & trailer = seekTable->frames.back();
+    if (trailer.decompressedSize != 0)
+        return std::nullopt;
+    auto trailerFrame = readRange(trailer.compressedOffset, trailer.compressedSize);
+    auto index = parseZstdSkippableFrame(trailerFrame);
+    if (!index || !hasPrefix(*index, lineIndexTag))
+        return std::nullopt;
+    std::string counts(index->substr(lineIndexTag.size()));
+
+    std::vector<ZstdSeekTable::Frame> frames;
+    std::ranges::copy_if(
+        seekTable->frames, std::back_inserter(frames), [](auto & frame) { return frame.decompressedSize > 0; });
+    if (counts.size() != frames.size() * 4)
+        return std::nullopt;
+    if (frames.empty())
+        return "";
+
+    /* Go back until we have seen more than `tail` newlines, so that
+       the newline before the first requested line is included. */
+    uint64_t start = 0;
+    size_t newlines = 0;
+    for (size_t i = frames.size(); i-- > 0;) {
+        newlines += readLittleEndian<uint32_t>(reinterpret_cast<unsigned char *>(counts.data()) + 4 * i);
+        if (newlines > tail) {
+            start = frames[i].decompressedOffset;
+            break;
+        }
+    }
+
+    auto end = frames.back().decompressedOffset + frames.back().decompressedSize;
+    StringSink sink;
+    makeSeekableZstdReader(std::move(*seekTable), readRange)(start, end - start, sink);
+    return std::string(lastLines(sink.s, tail));
+}
+
+std::string readBuildLogFile(const std::filesystem::path & path, std::optional<size_t> tail)
+{
+    auto extension = path.extension();
+
+    if (extension == compressedBuildLogExtension && tail) {
+        AutoCloseFD fd = openFileReadonly(path);
+        if (!fd)
+            throw NativeSysError("opening build log %s", PathFmt(path));
+        try {
+            if (auto res = readIndexedTail(fd.get(), *tail))
+                return std::move(*res);
+        } catch (CompressionError & e) {
+            debug("cannot use the line index of build log %s: %s", PathFmt(path), e.msg());
+        }
+    }
+
+    auto log = extension == compressedBuildLogExtension ? decompress("zstd", readFile(path))
+               : extension == ".bz2"                    ? decompress("bzip2", readFile(path))
+                                                        : readFile(path);
+
+    return tail ? std::string(lastLines(log, *tail)) : log;
+}
+
+} // namespace nix
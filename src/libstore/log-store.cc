@@ -1,4 +1,5 @@
 #include "nix/store/log-store.hh"
+#include "nix/store/log-file.hh"
 
 namespace nix {
 
@@ -10,4 +11,20 @@ std::optional<std::string> LogStore::getBuildLog(const StorePath & path)
     return getBuildLogExact(maybePath.value());
 }
 
+std::optional<std::string> LogStore::getBuildLogTail(const StorePath & path, size_t nrLines)
+{
+    auto maybePath = getBuildDerivationPath(path);
+    if (!maybePath)
+        return std::nullopt;
+    return getBuildLogTailExact(maybePath.value(), nrLines);
+}
+
+std::optional<std::string> LogStore::getBuildLogTailExact(const StorePath & path, size_t nrLines)
+{
+    auto log = getBuildLogExact(path);
+    if (!log)
+        return std::nullopt;
+    return std::string(lastLines(*log, nrLines));
+}
+
 } // namespace nix
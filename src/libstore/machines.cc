@@ -1,6 +1,7 @@
 #include "nix/util/base-n.hh"
 #include "nix/store/machines.hh"
 #include "nix/store/store-open.hh"
+#include "nix/store/store-api.hh"
 
 #include <algorithm>
 
@@ -206,4 +207,47 @@ Machines Machine::parseConfig(const StringSet & defaultSystems, const std::strin
     return parseBuilderLines(defaultSystems, builderLines);
 }
 
+std::optional<size_t> chooseMachine(const std::vector<MachineCandidate> & candidates, uint64_t localityBytes)
+{
+    auto cost = [&](const MachineCandidate & c) {
+        double cost = c.load / c.machine->speedFactor;
+        if (localityBytes)
+            cost += double(c.missingBytes) / localityBytes;
+        return cost;
+    };
+
+    std::optional<size_t> best;
+
+    for (size_t i = 0; i < candidates.size(); ++i) {
+        auto & c = candidates[i];
+        if (!best) {
+            best = i;
+            continue;
+        }
+        auto & b = candidates[*best];
+        if (cost(c) < cost(b)) {
+            best = i;
+        } else if (cost(c) == cost(b)) {
+            if (c.machine->speedFactor > b.machine->speedFactor) {
+                best = i;
+            } else if (c.machine->speedFactor == b.machine->speedFactor) {
+                if (c.load < b.load) {
+                    best = i;
+                }
+            }
+        }
+    }
+
+    return best;
+}
+
+uint64_t estimateMissingBytes(Store & srcStore, const StorePathSet & paths, const StorePathSet & validPaths)
+{
+    uint64_t missingBytes = 0;
+    for (auto & path : paths)
+        if (!validPaths.contains(path))
+            missingBytes += srcStore.queryPathInfo(path)->narSize;
+    return missingBytes;
+}
+
 } // namespace nix
@@ -182,6 +182,26 @@ MissingPaths Store::queryMissing(const std::vector<DerivedPath> & targets)
 
     MissingPaths res;
 
+    /* Substituter lookups already done. Outputs of derivations are
+       looked up first when deciding whether to build the derivation,
+       and then again when traversing their references. */
+    std::map<StorePath, std::optional<SubstitutablePathInfo>> substituterAnswers;
+
+    auto querySubstitutable = [&](StorePath path, std::optional<ContentAddress> ca)
+        -> asio::awaitable<const std::optional<SubstitutablePathInfo> *> {
+        if (auto i = substituterAnswers.find(path); i != substituterAnswers.end())
+            co_return &i->second;
+        SubstitutablePathInfos infos;
+        if (settings.getWorkerSettings().useSubstitutes)
+            res.nrSubstituterQueries++;
+        co_await querySubstitutablePathInfosAsync(*this, {{path, std::move(ca)}}, infos);
+        auto info = infos.find(path);
+        co_return &substituterAnswers
+                       .insert_or_assign(
+                           path, info == infos.end() ? std::nullopt : std::optional{std::move(info->second)})
+                       .first->second;
+    };
+
     auto mustBuildDrv = [&](const StorePath & drvPath, const Derivation & drv, std::set<DerivedPath> & edges) {
         res.willBuild.insert(drvPath);
         for (const auto & [inputDrv, inputNode] : drv.inputDrvs.map)
@@ -226,6 +246,7 @@ MissingPaths Store::queryMissing(const std::vector<DerivedPath> & targets)
                         co_return;
 
                     auto drv = make_ref<Derivation>(derivationFromPath(drvPath));
+                    res.nrDerivationsRead++;
                     DerivationOptions<SingleDerivedPath> drvOptions;
                     try {
                         // FIXME: this is a lot of work just to get the value
@@ -251,8 +272,13 @@ MissingPaths Store::queryMissing(const std::vector<DerivedPath> & targets)
 
                             bool found = false;
                             for (auto & sub : getDefaultSubstituters()) {
-                                /* TODO: Asyncify this. */
-                                auto realisation = sub->queryRealisation({drvPath, outputName});
+                                res.nrRealisationQueries++;
+                                auto realisation =
+                                    co_await callbackToAwaitable<std::shared_ptr<const UnkeyedRealisation>>(
+                                        [&sub, id = DrvOutput{drvPath, outputName}](
+                                            Callback<std::shared_ptr<const UnkeyedRealisation>> cb) {
+                                            sub->queryRealisation(id, std::move(cb));
+                                        });
                                 if (!realisation)
                                     continue;
                                 found = true;
@@ -281,11 +307,10 @@ MissingPaths Store::queryMissing(const std::vector<DerivedPath> & targets)
                             if (mustBuild)
                                 co_return;
 
-                            SubstitutablePathInfos infos;
-                            co_await querySubstitutablePathInfosAsync(
-                                *this, {{outPath, cap ? std::optional{*cap} : std::nullopt}}, infos);
+                            auto info =
+                                co_await querySubstitutable(outPath, cap ? std::optional{*cap} : std::nullopt);
 
-                            if (infos.empty())
+                            if (!*info)
                                 mustBuild = true;
                             else
                                 substitutable.insert(outPath);
@@ -304,21 +329,18 @@ MissingPaths Store::queryMissing(const std::vector<DerivedPath> & targets)
                     if (isValidPath(bo.path))
                         co_return;
 
-                    SubstitutablePathInfos infos;
-                    co_await querySubstitutablePathInfosAsync(*this, {{bo.path, std::nullopt}}, infos);
+                    auto info = co_await querySubstitutable(bo.path, std::nullopt);
 
-                    if (infos.empty()) {
+                    if (!*info) {
                         res.unknown.insert(bo.path);
                         co_return;
                     }
 
-                    auto info = infos.find(bo.path);
-                    assert(info != infos.end());
                     res.willSubstitute.insert(bo.path);
-                    res.downloadSize += info->second.downloadSize;
-                    res.narSize += info->second.narSize;
+                    res.downloadSize += (*info)->downloadSize;
+                    res.narSize += (*info)->narSize;
 
-                    for (auto & ref : info->second.references)
+                    for (auto & ref : (*info)->references)
                         edges.insert(DerivedPath::Opaque{ref});
                 },
             },
@@ -329,7 +351,16 @@ MissingPaths Store::queryMissing(const std::vector<DerivedPath> & targets)
 
     std::set<DerivedPath> startElts(targets.begin(), targets.end());
     std::set<DerivedPath> visited;
-    computeClosure(std::move(startElts), visited, std::move(getEdges));
+    computeClosure(
+        std::move(startElts), visited, std::move(getEdges), settings.getWorkerSettings().maxSubstitutionQueries.get());
+
+    printMsg(
+        lvlTalkative,
+        "examined %d paths: read %d derivations, queried substituters for %d paths and %d realisations",
+        visited.size(),
+        res.nrDerivationsRead,
+        res.nrSubstituterQueries,
+        res.nrRealisationQueries);
 
     return res;
 }
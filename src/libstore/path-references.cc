@@ -3,6 +3,9 @@
 #include "nix/util/source-accessor.hh"
 #include "nix/util/canon-path.hh"
 #include "nix/util/logging.hh"
+#include "nix/util/file-system.hh"
+#include "nix/util/signals.hh"
+#include "nix/util/util.hh"
 
 #include <map>
 #include <cstdlib>
@@ -140,4 +143,119 @@ scanForReferencesDeep(SourceAccessor & accessor, const CanonPath & rootPath, con
     return results;
 }
 
+namespace {
+
+/**
+ * A sink that determines whether any of the strings to be rewritten
+ * occur in the data written to it.
+ */
+struct RewriteDetectionSink : Sink
+{
+    const StringMap & rewrites;
+    std::string::size_type maxRewriteSize = 0;
+    std::string tail;
+    bool found = false;
+
+    RewriteDetectionSink(const StringMap & rewrites)
+        : rewrites(rewrites)
+    {
+        for (auto & [from, _] : rewrites)
+            maxRewriteSize = std::max(maxRewriteSize, from.size());
+    }
+
+    bool search(std::string_view s)
+    {
+        for (auto & [from, _] : rewrites)
+            if (!from.empty() && s.find(from) != s.npos)
+                return true;
+        return false;
+    }
+
+    void operator()(std::string_view data) override
+    {
+        if (found || maxRewriteSize == 0)
+            return;
+
+        /* A match might span the previous and current fragment. */
+        auto s = tail;
+        s.append(data.substr(0, maxRewriteSize - 1));
+        if (search(s) || search(data)) {
+            found = true;
+            return;
+        }
+
+        if (data.size() >= maxRewriteSize - 1)
+            tail = data.substr(data.size() - (maxRewriteSize - 1));
+        else
+            tail = s.substr(s.size() - std::min(s.size(), maxRewriteSize - 1));
+    }
+};
+
+} // namespace
+
+void rewritePathInPlace(const std::filesystem::path & path, const StringMap & rewrites)
+{
+    if (rewrites.empty())
+        return;
+
+    [&](this const auto & self, const std::filesystem::path & path) -> void {
+        checkInterrupt();
+
+        auto st = lstat(path);
+
+        if (S_ISREG(st.st_mode)) {
+            RewriteDetectionSink detectionSink{rewrites};
+            readFile(path, detectionSink);
+            if (!detectionSink.found)
+                return;
+
+            debug("rewriting hashes in %s", PathFmt(path));
+
+            auto tmpPath = makeTempPath(path, ".rewrite");
+            {
+                auto fd = openNewFileForWrite(tmpPath, 0600, {});
+                if (!fd)
+                    throw NativeSysError("creating file %s", PathFmt(tmpPath));
+                FdSink fileSink{fd.get()};
+                RewritingSink rewritingSink{rewrites, fileSink};
+                readFile(path, rewritingSink);
+                rewritingSink.flush();
+                fileSink.flush();
+            }
+            chmod(tmpPath, st.st_mode & 07777);
+            std::filesystem::rename(tmpPath, path);
+        }
+
+        else if (S_ISLNK(st.st_mode)) {
+            auto target = readLink(path).string();
+            auto newTarget = rewriteStrings(target, rewrites);
+            if (newTarget != target)
+                replaceSymlink(newTarget, path);
+        }
+
+        else if (S_ISDIR(st.st_mode)) {
+            /* Collect the entries first, since we may rename them. */
+            std::vector<std::string> names;
+            for (auto & entry : DirectoryIterator{path})
+                names.push_back(entry.path().filename().string());
+
+            /* Canonical directories are read-only. */
+            bool madeWritable = chmodIfNeeded(path, (st.st_mode & 07777) | S_IWUSR, 07777);
+
+            for (auto & name : names) {
+                self(path / name);
+                auto newName = rewriteStrings(name, rewrites);
+                if (newName != name)
+                    std::filesystem::rename(path / name, path / newName);
+            }
+
+            if (madeWritable)
+                chmod(path, st.st_mode & 07777);
+        }
+
+        else
+            throw Error("file %s has an unsupported type", PathFmt(path));
+    }(path);
+}
+
 } // namespace nix
@@ -1,4 +1,5 @@
 #include "nix/store/remote-fs-accessor.hh"
+#include "nix/store/binary-cache-store.hh"
 
 namespace nix {
 
@@ -19,9 +20,17 @@ std::pair<ref<SourceAccessor>, CanonPath> RemoteFSAccessor::fetch(const CanonPat
 
 std::shared_ptr<SourceAccessor> RemoteFSAccessor::accessObject(const StorePath & storePath)
 {
+    auto open = [&]() -> std::shared_ptr<SourceAccessor> {
+        if (auto binaryCacheStore = dynamic_cast<BinaryCacheStore *>(&*store))
+            return binaryCacheStore->openSeekableNarAccessor(storePath);
+        return nullptr;
+    };
+
+    auto populate = [&](Sink & sink) { store->narFromPath(storePath, sink); };
+
     // Check if we already have the NAR hash for this store path
     if (auto * narHash = get(narHashes, storePath.hashPart()))
-        return narCache.getOrInsert(*narHash, [&](Sink & sink) { store->narFromPath(storePath, sink); });
+        return narCache.getOrInsert(*narHash, open, populate);
 
     // Query the path info to get the NAR hash
     auto info = store->queryPathInfo(storePath);
@@ -30,7 +39,7 @@ std::shared_ptr<SourceAccessor> RemoteFSAccessor::accessObject(const StorePath &
     narHashes.emplace(storePath.hashPart(), info->narHash);
 
     // Get or create the NAR accessor
-    return narCache.getOrInsert(info->narHash, [&](Sink & sink) { store->narFromPath(storePath, sink); });
+    return narCache.getOrInsert(info->narHash, open, populate);
 }
 
 std::optional<SourceAccessor::Stat> RemoteFSAccessor::maybeLstat(const CanonPath & path)
@@ -1,10 +1,15 @@
 #include "nix/store/ssh.hh"
+#include "nix/store/pathlocks.hh"
 #include "nix/util/current-process.hh"
 #include "nix/util/environment-variables.hh"
 #include "nix/util/os-string.hh"
 #include "nix/util/util.hh"
 #include "nix/util/exec.hh"
 #include "nix/util/base-n.hh"
+#include "nix/util/hash.hh"
+#include "nix/util/users.hh"
+
+#include <fcntl.h>
 
 namespace nix {
 
@@ -69,7 +74,8 @@ SSHMaster::SSHMaster(
     std::string_view sshPublicHostKey,
     bool useMaster,
     bool compress,
-    Descriptor logFD)
+    Descriptor logFD,
+    unsigned int controlPersist)
     : authority(authority)
     , hostnameAndUser([authority]() {
         std::ostringstream oss;
@@ -81,9 +87,10 @@ SSHMaster::SSHMaster(
     , fakeSSH(authority.to_string() == "localhost")
     , keyFile(std::move(keyFile))
     , sshPublicHostKey(parsePublicHostKey(authority.host, sshPublicHostKey))
-    , useMaster(useMaster && !fakeSSH)
+    , useMaster((useMaster || controlPersist > 0) && !fakeSSH)
     , compress(compress)
     , logFD(logFD)
+    , controlPersist(controlPersist)
     , tmpDir(make_ref<AutoDelete>(createTempDir("", "nix", 0700)))
 {
     checkValidAuthority(authority);
@@ -115,15 +122,35 @@ void SSHMaster::addCommonSSHOpts(OsStrings & args)
     args.push_back(OS_STR("-oLocalCommand=echo started"));
 }
 
-bool SSHMaster::isMasterRunning()
+bool SSHMaster::isMasterRunning(const std::filesystem::path & socketPath)
 {
     OsStrings args = {OS_STR("-O"), OS_STR("check"), string_to_os_string(hostnameAndUser)};
     addCommonSSHOpts(args);
+    if (!socketPath.empty())
+        args.insert(args.end(), {OS_STR("-S"), socketPath.native()});
 
     auto res = runProgram(RunOptions{.program = "ssh", .args = std::move(args), .mergeStderrToStdout = true});
     return res.first == 0;
 }
 
+std::filesystem::path SSHMaster::getSharedSocketPath()
+{
+    auto key = concatStringsSep(
+        "\n",
+        Strings{
+            hostnameAndUser,
+            authority.port ? std::to_string(*authority.port) : "",
+            keyFile ? keyFile->string() : "",
+            sshPublicHostKey,
+            getEnv("NIX_SSHOPTS").value_or(""),
+        });
+
+    /* Keep the name short, since the path of a Unix domain socket
+       is limited to about 100 bytes. */
+    return getCacheDir() / "ssh"
+           / hashString(HashAlgorithm::SHA256, key).to_string(HashFormat::Nix32, false).substr(0, 20);
+}
+
 Strings createSSHEnv()
 {
     // Copy the environment and set SHELL=/bin/sh
@@ -235,10 +262,25 @@ std::filesystem::path SSHMaster::startMaster()
 
     auto state(state_.lock());
 
-    if (state->sshMaster != INVALID_DESCRIPTOR)
+    if (state->sshMaster != INVALID_DESCRIPTOR || state->sharedMaster)
         return state->socketPath;
 
-    state->socketPath = tmpDir->path() / "ssh.sock";
+    AutoCloseFD lock;
+
+    if (controlPersist) {
+        /* Use a socket that outlives this process, so that the next
+           process connecting to this host (e.g. the next invocation
+           of the build hook) can skip the SSH handshake. Hold a lock
+           while checking for and starting the master, to prevent
+           concurrent processes from each starting their own. */
+        state->socketPath = getSharedSocketPath();
+        createDirs(state->socketPath.parent_path());
+        auto lockPath = state->socketPath;
+        lockPath += ".lock";
+        lock = openLockFile(lockPath, true);
+        lockFile(lock.get(), ltWrite, true);
+    } else
+        state->socketPath = tmpDir->path() / "ssh.sock";
 
     Pipe out;
     out.create();
@@ -248,7 +290,16 @@ std::filesystem::path SSHMaster::startMaster()
 
     auto suspension = logger->suspend();
 
-    if (isMasterRunning())
+    if (controlPersist) {
+        if (isMasterRunning(state->socketPath)) {
+            debug("reusing SSH master connection %s", PathFmt(state->socketPath));
+            state->sharedMaster = true;
+            return state->socketPath;
+        }
+        /* Remove a stale socket left behind by a master that didn't
+           exit cleanly, since ssh refuses to overwrite it. */
+        std::filesystem::remove(state->socketPath);
+    } else if (isMasterRunning())
         return state->socketPath;
 
     state->sshMaster = startProcess(
@@ -264,6 +315,40 @@ std::filesystem::path SSHMaster::startMaster()
             if (verbosity >= lvlChatty)
                 args.push_back("-v");
             addCommonSSHOpts(args);
+
+            if (controlPersist) {
+                /* The master must not keep our caller's file
+                   descriptors (such as the build hook's log pipe)
+                   open after we exit, so detach it completely. */
+                closeExtraFDs();
+                auto logPath = state->socketPath;
+                logPath += ".log";
+
+                /* That includes stdin and stderr. ssh writes its
+                   diagnostics to the log file given by `-E`. Stdout
+                   is the pipe from which we read the handshake below,
+                   which we close right after. */
+                AutoCloseFD devNull = open("/dev/null", O_RDWR | O_CLOEXEC);
+                if (!devNull)
+                    throw SysError("opening '/dev/null'");
+                if (dup2(devNull.get(), STDIN_FILENO) == -1)
+                    throw SysError("duping over stdin");
+                AutoCloseFD logFd = open(logPath.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+                if (!logFd)
+                    throw SysError("opening %s", PathFmt(logPath));
+                if (dup2(logFd.get(), STDERR_FILENO) == -1)
+                    throw SysError("duping over stderr");
+                args.insert(
+                    args.end(),
+                    {fmt("-oControlPersist=%ds", controlPersist), "-E", logPath.string()});
+                if (setsid() == -1)
+                    throw SysError("creating a new session");
+                if (auto pid = fork(); pid == -1)
+                    throw SysError("forking SSH master");
+                else if (pid != 0)
+                    _exit(0);
+            }
+
             auto env = createSSHEnv();
             nix::execvpe(args.begin()->c_str(), stringsToCharPtrs(args).data(), stringsToCharPtrs(env).data());
 
@@ -273,6 +358,12 @@ std::filesystem::path SSHMaster::startMaster()
 
     out.writeSide = INVALID_DESCRIPTOR;
 
+    if (controlPersist) {
+        /* The actual master is a grandchild that we don't own. */
+        state->sshMaster.wait();
+        state->sharedMaster = true;
+    }
+
     std::string reply;
     try {
         reply = readLine(out.readSide.get());
@@ -281,6 +372,7 @@ std::filesystem::path SSHMaster::startMaster()
 
     if (reply != "started") {
         printTalkative("SSH master stdout first line: %s", reply);
+        state->sharedMaster = false;
         throw Error("failed to start SSH master connection to '%s'", authority.host);
     }
 
@@ -1460,6 +1460,16 @@ SingleDrvOutputs DerivationBuilderImpl::registerOutputs()
          * `scratchOutputsInverse`.
          */
         StringSet otherOutputs;
+        /**
+         * Whether `refs` is the result of scanning the output, rather
+         * than empty because of `unsafeDiscardReferences`.
+         */
+        bool refsScanned;
+        /**
+         * The NAR hash of the output, computed while scanning for
+         * references. Only valid as long as the output isn't modified.
+         */
+        std::optional<HashResult> narHashAndSize;
     };
 
     /* inverse map of scratchOutputs for efficient lookup */
@@ -1531,14 +1541,18 @@ SingleDrvOutputs DerivationBuilderImpl::registerOutputs()
         }
 
         StorePathSet references;
+        std::optional<HashResult> narHashAndSize;
         if (discardReferences)
             debug("discarding references of output '%s'", outputName);
         else {
             debug("scanning for references for output '%s' in temp location %s", outputName, PathFmt(actualPath));
 
-            /* Pass blank Sink as we are not ready to hash data at this stage. */
-            NullSink blank;
-            references = scanForReferences(blank, actualPath, referenceablePaths);
+            /* Compute the NAR hash in the same pass, so that we don't
+               have to serialise the output again when registering it,
+               unless it gets rewritten in the meantime. */
+            HashSink narSink{HashAlgorithm::SHA256};
+            references = scanForReferences(narSink, actualPath, referenceablePaths);
+            narHashAndSize = narSink.finish();
         }
 
         StringSet referencedOutputs;
@@ -1551,6 +1565,8 @@ SingleDrvOutputs DerivationBuilderImpl::registerOutputs()
             PerhapsNeedToRegister{
                 .refs = references,
                 .otherOutputs = referencedOutputs,
+                .refsScanned = !discardReferences,
+                .narHashAndSize = std::move(narHashAndSize),
             });
         outputStats.insert_or_assign(outputName, std::move(st));
     }
@@ -1620,38 +1636,50 @@ SingleDrvOutputs DerivationBuilderImpl::registerOutputs()
         auto orifu = get(outputReferencesIfUnregistered, outputName);
         assert(orifu);
 
-        std::optional<StorePathSet> referencesOpt = std::visit(
+        auto * toRegister = std::visit(
             overloaded{
-                [&](const AlreadyRegistered & skippedFinalPath) -> std::optional<StorePathSet> {
+                [&](const AlreadyRegistered & skippedFinalPath) -> const PerhapsNeedToRegister * {
                     finish(skippedFinalPath.path);
-                    return std::nullopt;
+                    return nullptr;
                 },
-                [&](const PerhapsNeedToRegister & r) -> std::optional<StorePathSet> { return r.refs; },
+                [&](const PerhapsNeedToRegister & r) -> const PerhapsNeedToRegister * { return &r; },
             },
             *orifu);
 
-        if (!referencesOpt)
+        if (!toRegister)
             continue;
-        auto references = *referencesOpt;
+        auto references = toRegister->refs;
+
+        /* The NAR hash of `actualPath`, if known. This must be reset
+           whenever the contents of `actualPath` change. */
+        auto narHashAndSize = toRegister->narHashAndSize;
+
+        /* Whether `actualPath` still has canonical metadata. */
+        bool canonical = true;
+
+        auto getNarHash = [&]() -> HashResult {
+            if (!narHashAndSize)
+                narHashAndSize = hashPath(
+                    {makeFSSourceAccessor(actualPath), CanonPath::root},
+                    FileSerialisationMethod::NixArchive,
+                    HashAlgorithm::SHA256);
+            return *narHashAndSize;
+        };
 
         auto rewriteOutput = [&](const StringMap & rewrites) {
             /* Apply hash rewriting if necessary. */
             if (!rewrites.empty()) {
+                narHashAndSize.reset();
+
                 debug("rewriting hashes in %1%; cross fingers", PathFmt(actualPath));
 
-                /* FIXME: Is this actually streaming? */
-                auto source = sinkToSource([&](Sink & nextSink) {
-                    RewritingSink rsink(rewrites, nextSink);
-                    dumpPath(actualPath, rsink);
-                    rsink.flush();
-                });
-                std::filesystem::path tmpPath = actualPath.native() + ".tmp";
-                restorePath(tmpPath, *source);
-                deletePath(actualPath);
-                movePath(tmpPath, actualPath);
+                /* Only replace the files that actually contain one
+                   of the hashes, rather than copying the whole output
+                   through a NAR. */
+                rewritePathInPlace(actualPath, rewrites);
 
-                /* FIXME: set proper permissions in restorePath() so
-                   we don't have to do another traversal. */
+                /* The replaced files don't have canonical metadata.
+                   FIXME: only canonicalise those. */
                 canonicalisePathMetaData(
                     actualPath,
                     {
@@ -1661,6 +1689,7 @@ SingleDrvOutputs DerivationBuilderImpl::registerOutputs()
 #endif
                         NIX_WHEN_SUPPORT_ACLS(localSettings.ignoredAcls)},
                     inodesSeen);
+                canonical = true;
             }
         };
 
@@ -1715,8 +1744,17 @@ SingleDrvOutputs DerivationBuilderImpl::registerOutputs()
                 case FileIngestionMethod::NixArchive: {
                     HashModuloSink caSink{outputHash.hashAlgo, oldHashPart};
                     auto fim = outputHash.method.getFileIngestionMethod();
+                    /* If we don't know the NAR hash anymore, compute it
+                       in the same pass. */
+                    HashSink narSink{HashAlgorithm::SHA256};
+                    bool teeNar = !narHashAndSize && fim == FileIngestionMethod::NixArchive;
+                    TeeSink teeSink{caSink, narSink};
                     dumpPath(
-                        {makeFSSourceAccessor(actualPath), CanonPath::root}, caSink, (FileSerialisationMethod) fim);
+                        {makeFSSourceAccessor(actualPath), CanonPath::root},
+                        teeNar ? static_cast<Sink &>(teeSink) : caSink,
+                        (FileSerialisationMethod) fim);
+                    if (teeNar)
+                        narHashAndSize = narSink.finish();
                     return caSink.finish().hash;
                 }
                 case FileIngestionMethod::Git: {
@@ -1726,12 +1764,16 @@ SingleDrvOutputs DerivationBuilderImpl::registerOutputs()
                 assert(false);
             }();
 
+            auto refs = rewriteRefs();
+            /* If we scanned the output and found no self-references,
+               rewriting them below would not change anything. */
+            bool maybeSelfRefs = refs.self || !toRegister->refsScanned;
             auto newInfo0 = ValidPathInfo::makeFromCA(
                 store,
                 outputPathName(drv.name, outputName),
-                ContentAddressWithReferences::fromParts(outputHash.method, std::move(got), rewriteRefs()),
+                ContentAddressWithReferences::fromParts(outputHash.method, std::move(got), std::move(refs)),
                 Hash::dummy);
-            if (*scratchPath != newInfo0.path) {
+            if (*scratchPath != newInfo0.path && maybeSelfRefs) {
                 // If the path has some self-references, we need to rewrite
                 // them.
                 // (note that this doesn't invalidate the ca hash we calculated
@@ -1741,10 +1783,7 @@ SingleDrvOutputs DerivationBuilderImpl::registerOutputs()
             }
 
             {
-                HashResult narHashAndSize = hashPath(
-                    {makeFSSourceAccessor(actualPath), CanonPath::root},
-                    FileSerialisationMethod::NixArchive,
-                    HashAlgorithm::SHA256);
+                auto narHashAndSize = getNarHash();
                 newInfo0.narHash = narHashAndSize.hash;
                 newInfo0.narSize = narHashAndSize.numBytesDigested;
             }
@@ -1772,6 +1811,9 @@ SingleDrvOutputs DerivationBuilderImpl::registerOutputs()
                of thumb is that actualPath points to the current location of the stuff
                that we'll end up registering. */
             actualPath = std::move(tmpOutput);
+            /* The copy has the same NAR serialisation, but not the same
+               metadata. */
+            canonical = false;
         };
 
         ValidPathInfo newInfo = std::visit(
@@ -1786,10 +1828,7 @@ SingleDrvOutputs DerivationBuilderImpl::registerOutputs()
                         outputRewrites.insert_or_assign(
                             std::string{scratchPath->hashPart()}, std::string{requiredFinalPath.hashPart()});
                     rewriteOutput(outputRewrites);
-                    HashResult narHashAndSize = hashPath(
-                        {makeFSSourceAccessor(actualPath), CanonPath::root},
-                        FileSerialisationMethod::NixArchive,
-                        HashAlgorithm::SHA256);
+                    auto narHashAndSize = getNarHash();
                     ValidPathInfo newInfo0{requiredFinalPath, {store, narHashAndSize.hash}};
                     newInfo0.narSize = narHashAndSize.numBytesDigested;
                     auto refs = rewriteRefs();
@@ -1831,15 +1870,16 @@ SingleDrvOutputs DerivationBuilderImpl::registerOutputs()
 
         /* FIXME: set proper permissions in restorePath() so
             we don't have to do another traversal. */
-        canonicalisePathMetaData(
-            actualPath,
-            {
+        if (!canonical)
+            canonicalisePathMetaData(
+                actualPath,
+                {
 #ifndef _WIN32
-                // builder UIDs are already dealt with
-                .uidRange = std::nullopt,
+                    // builder UIDs are already dealt with
+                    .uidRange = std::nullopt,
 #endif
-                NIX_WHEN_SUPPORT_ACLS(localSettings.ignoredAcls)},
-            inodesSeen);
+                    NIX_WHEN_SUPPORT_ACLS(localSettings.ignoredAcls)},
+                inodesSeen);
 
         /* Calculate where we'll move the output files. In the checking case we
            will leave leave them where they are, for now, rather than move to
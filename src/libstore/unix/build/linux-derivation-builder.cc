@@ -4,12 +4,12 @@
 
 #  include "nix/store/globals.hh"
 #  include "nix/store/personality.hh"
+#  include "nix/store/build-sandbox.hh"
 #  include "nix/store/filetransfer.hh"
 #  include "nix/util/cgroup.hh"
 #  include "nix/util/linux-namespaces.hh"
 #  include "nix/util/logging.hh"
 #  include "nix/util/serialise.hh"
-#  include "linux/fchmodat2-compat.hh"
 
 #  include <algorithm>
 #  include <string_view>
@@ -25,10 +25,6 @@
 #  include <sys/syscall.h>
 #  include <sys/prctl.h>
 
-#  if HAVE_SECCOMP
-#    include <seccomp.h>
-#  endif
-
 #  if HAVE_LANDLOCK
 #    include <linux/landlock.h>
 #  endif
@@ -42,101 +38,7 @@ static void setupSeccomp(const LocalSettings & localSettings)
     if (!localSettings.filterSyscalls)
         return;
 
-#  if HAVE_SECCOMP
-    scmp_filter_ctx ctx;
-
-    if (!(ctx = seccomp_init(SCMP_ACT_ALLOW)))
-        throw SysError("unable to initialize seccomp mode 2");
-
-    Finally cleanup([&]() { seccomp_release(ctx); });
-
-    constexpr std::string_view nativeSystem = NIX_LOCAL_SYSTEM;
-
-    if (nativeSystem == "x86_64-linux" && seccomp_arch_add(ctx, SCMP_ARCH_X86) != 0)
-        throw SysError("unable to add 32-bit seccomp architecture");
-
-    if (nativeSystem == "x86_64-linux" && seccomp_arch_add(ctx, SCMP_ARCH_X32) != 0)
-        throw SysError("unable to add X32 seccomp architecture");
-
-    if (nativeSystem == "aarch64-linux" && seccomp_arch_add(ctx, SCMP_ARCH_ARM) != 0)
-        printError(
-            "unable to add ARM seccomp architecture; this may result in spurious build failures if running 32-bit ARM processes");
-
-    if (nativeSystem == "mips64-linux" && seccomp_arch_add(ctx, SCMP_ARCH_MIPS) != 0)
-        printError("unable to add mips seccomp architecture");
-
-    if (nativeSystem == "mips64-linux" && seccomp_arch_add(ctx, SCMP_ARCH_MIPS64N32) != 0)
-        printError("unable to add mips64-*abin32 seccomp architecture");
-
-    if (nativeSystem == "mips64el-linux" && seccomp_arch_add(ctx, SCMP_ARCH_MIPSEL) != 0)
-        printError("unable to add mipsel seccomp architecture");
-
-    if (nativeSystem == "mips64el-linux" && seccomp_arch_add(ctx, SCMP_ARCH_MIPSEL64N32) != 0)
-        printError("unable to add mips64el-*abin32 seccomp architecture");
-
-    /* Prevent builders from creating setuid/setgid binaries. */
-    for (int perm : {S_ISUID, S_ISGID}) {
-        if (seccomp_rule_add(
-                ctx,
-                SCMP_ACT_ERRNO(EPERM),
-                SCMP_SYS(chmod),
-                1,
-                SCMP_A1(SCMP_CMP_MASKED_EQ, (scmp_datum_t) perm, (scmp_datum_t) perm))
-            != 0)
-            throw SysError("unable to add seccomp rule");
-
-        if (seccomp_rule_add(
-                ctx,
-                SCMP_ACT_ERRNO(EPERM),
-                SCMP_SYS(fchmod),
-                1,
-                SCMP_A1(SCMP_CMP_MASKED_EQ, (scmp_datum_t) perm, (scmp_datum_t) perm))
-            != 0)
-            throw SysError("unable to add seccomp rule");
-
-        if (seccomp_rule_add(
-                ctx,
-                SCMP_ACT_ERRNO(EPERM),
-                SCMP_SYS(fchmodat),
-                1,
-                SCMP_A2(SCMP_CMP_MASKED_EQ, (scmp_datum_t) perm, (scmp_datum_t) perm))
-            != 0)
-            throw SysError("unable to add seccomp rule");
-
-        if (seccomp_rule_add(
-                ctx,
-                SCMP_ACT_ERRNO(EPERM),
-                NIX_SYSCALL_FCHMODAT2,
-                1,
-                SCMP_A2(SCMP_CMP_MASKED_EQ, (scmp_datum_t) perm, (scmp_datum_t) perm))
-            != 0)
-            throw SysError("unable to add seccomp rule");
-    }
-
-    /* Prevent builders from using EAs or ACLs. Not all filesystems
-       support these, and they're not allowed in the Nix store because
-       they're not representable in the NAR serialisation. */
-    if (seccomp_rule_add(ctx, SCMP_ACT_ERRNO(ENOTSUP), SCMP_SYS(listxattr), 0) != 0
-        || seccomp_rule_add(ctx, SCMP_ACT_ERRNO(ENOTSUP), SCMP_SYS(llistxattr), 0) != 0
-        || seccomp_rule_add(ctx, SCMP_ACT_ERRNO(ENOTSUP), SCMP_SYS(flistxattr), 0) != 0
-        || seccomp_rule_add(ctx, SCMP_ACT_ERRNO(ENOTSUP), SCMP_SYS(getxattr), 0) != 0
-        || seccomp_rule_add(ctx, SCMP_ACT_ERRNO(ENOTSUP), SCMP_SYS(lgetxattr), 0) != 0
-        || seccomp_rule_add(ctx, SCMP_ACT_ERRNO(ENOTSUP), SCMP_SYS(fgetxattr), 0) != 0
-        || seccomp_rule_add(ctx, SCMP_ACT_ERRNO(ENOTSUP), SCMP_SYS(setxattr), 0) != 0
-        || seccomp_rule_add(ctx, SCMP_ACT_ERRNO(ENOTSUP), SCMP_SYS(lsetxattr), 0) != 0
-        || seccomp_rule_add(ctx, SCMP_ACT_ERRNO(ENOTSUP), SCMP_SYS(fsetxattr), 0) != 0)
-        throw SysError("unable to add seccomp rule");
-
-    if (seccomp_attr_set(ctx, SCMP_FLTATR_CTL_NNP, localSettings.allowNewPrivileges ? 0 : 1) != 0)
-        throw SysError("unable to set 'no new privileges' seccomp attribute");
-
-    if (seccomp_load(ctx) != 0)
-        throw SysError("unable to load seccomp BPF program");
-#  else
-    throw Error(
-        "seccomp is not supported on this platform; "
-        "you can bypass this error by setting the option 'filter-syscalls' to false, but note that untrusted builds can then create setuid binaries!");
-#  endif
+    linux::loadSeccompFilter();
 }
 
 #  if HAVE_LANDLOCK && defined(LANDLOCK_SCOPE_ABSTRACT_UNIX_SOCKET)
@@ -246,6 +148,16 @@ struct LinuxDerivationBuilder : virtual DerivationBuilderImpl
 {
     using DerivationBuilderImpl::DerivationBuilderImpl;
 
+    void startChild() override
+    {
+        /* Compile the seccomp filter before forking, so that the
+           child doesn't have to. */
+        if (store.config->getLocalSettings().filterSyscalls)
+            linux::prepareSeccompFilter();
+
+        DerivationBuilderImpl::startChild();
+    }
+
     void enterChroot() override
     {
         auto & localSettings = store.config->getLocalSettings();
@@ -300,6 +212,12 @@ struct ChrootLinuxDerivationBuilder : ChrootDerivationBuilder, LinuxDerivationBu
      */
     bool usingUserNamespace = true;
 
+    /**
+     * Whether the builder runs in a network namespace taken from the
+     * pool (see `sandbox-netns-pool-size`) rather than a new one.
+     */
+    bool usingPooledNetworkNamespace = false;
+
     /**
      * The cgroup of the builder, if any.
      */
@@ -435,6 +353,16 @@ struct ChrootLinuxDerivationBuilder : ChrootDerivationBuilder, LinuxDerivationBu
 
         usingUserNamespace = userNamespacesSupported();
 
+        auto & localSettings = store.config->getLocalSettings();
+
+        if (localSettings.filterSyscalls)
+            linux::prepareSeccompFilter();
+
+        std::optional<AutoCloseFD> pooledNetworkNamespace;
+        if (derivationType.isSandboxed())
+            pooledNetworkNamespace = linux::takePooledNetworkNamespace(localSettings.sandboxNetworkNamespacePoolSize);
+        usingPooledNetworkNamespace = pooledNetworkNamespace.has_value();
+
         Pipe sendPid;
         sendPid.create();
 
@@ -459,7 +387,10 @@ struct ChrootLinuxDerivationBuilder : ChrootDerivationBuilder, LinuxDerivationBu
 
                 ProcessOptions options;
                 options.cloneFlags = CLONE_NEWPID | CLONE_NEWNS | CLONE_NEWIPC | CLONE_NEWUTS | CLONE_PARENT | SIGCHLD;
-                if (derivationType.isSandboxed())
+                if (pooledNetworkNamespace) {
+                    if (setns(pooledNetworkNamespace->get(), CLONE_NEWNET) == -1)
+                        throw SysError("entering pooled network namespace");
+                } else if (derivationType.isSandboxed())
                     options.cloneFlags |= CLONE_NEWNET;
                 if (usingUserNamespace)
                     options.cloneFlags |= CLONE_NEWUSER;
@@ -576,20 +507,12 @@ struct ChrootLinuxDerivationBuilder : ChrootDerivationBuilder, LinuxDerivationBu
 
         userNamespaceSync.readSide = -1;
 
-        if (derivationType.isSandboxed()) {
-
-            /* Initialise the loopback interface. */
-            AutoCloseFD fd(socket(PF_INET, SOCK_DGRAM, IPPROTO_IP));
-            if (!fd)
-                throw SysError("cannot open IP socket");
-
-            using namespace std::string_view_literals;
-            struct ifreq ifr = {};
-            std::ranges::copy("lo"sv, ifr.ifr_name);
-            ifr.ifr_flags = IFF_UP | IFF_LOOPBACK | IFF_RUNNING;
-            if (ioctl(fd.get(), SIOCSIFFLAGS, &ifr) == -1)
-                throw SysError("cannot set loopback interface flags");
-        }
+        /* Initialise the loopback interface. A pooled network
+           namespace already has it up (and we're not allowed to
+           configure it anyway, since it's not owned by our user
+           namespace). */
+        if (derivationType.isSandboxed() && !usingPooledNetworkNamespace)
+            linux::setUpLoopbackInterface();
 
         /* Set the hostname etc. to fixed values. */
         char hostname[] = "localhost";
@@ -830,6 +753,7 @@ struct ChrootLinuxDerivationBuilder : ChrootDerivationBuilder, LinuxDerivationBu
             if (getStats) {
                 buildResult.cpuUser = stats.cpuUser;
                 buildResult.cpuSystem = stats.cpuSystem;
+                buildResult.memoryPeak = stats.memoryPeak;
             }
             return;
         }
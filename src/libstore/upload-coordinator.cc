@@ -0,0 +1,136 @@
+#include "nix/store/upload-coordinator.hh"
+#include "nix/store/pathlocks.hh"
+#include "nix/util/file-system.hh"
+#include "nix/util/logging.hh"
+#include "nix/util/signals.hh"
+
+#include <thread>
+
+namespace nix {
+
+void copyPathsCoordinated(
+    Store & srcStore,
+    Store & dstStore,
+    const StorePathSet & paths,
+    const std::filesystem::path & lockDir,
+    CheckSigsFlag checkSigs,
+    SubstituteFlag substitute,
+    std::chrono::seconds lockTimeout)
+{
+    createDirs(lockDir);
+
+    auto lockPathFor = [&](const StorePath & path) { return lockDir / (std::string(path.hashPart()) + ".lock"); };
+
+    /* The paths that are not yet known to be valid in `dstStore`. */
+    StorePathSet remaining = paths;
+
+    auto removeValid = [&](const StorePathSet & candidates) {
+        /* Paths may have been added by somebody else since we last
+           asked, so don't trust cached negative results. */
+        for (auto & path : candidates)
+            dstStore.invalidatePathInfoCacheFor(path);
+        for (auto & path : dstStore.queryValidPaths(candidates, substitute))
+            remaining.erase(path);
+    };
+
+    removeValid(remaining);
+
+    while (!remaining.empty()) {
+        checkInterrupt();
+
+        /* Claim the paths that nobody else is uploading right now. */
+        std::map<StorePath, AutoCloseFD> claimed;
+        std::optional<StorePath> inFlight;
+        for (auto & path : remaining) {
+            auto fd = openLockFile(lockPathFor(path), true);
+            /* A non-empty lock file has been deleted by the previous
+               uploader (see below), so try again with a new one. */
+            if (!lockFile(fd.get(), ltWrite, false) || getFileSize(fd.get()) != 0) {
+                if (!inFlight)
+                    inFlight = path;
+                continue;
+            }
+            claimed.emplace(path, std::move(fd));
+        }
+
+        /* Somebody else may have finished uploading some of them
+           between our validity check and acquiring the locks. */
+        if (!claimed.empty()) {
+            StorePathSet claimedPaths;
+            for (auto & [path, _] : claimed)
+                claimedPaths.insert(path);
+            removeValid(claimedPaths);
+            std::erase_if(claimed, [&](auto & i) { return !remaining.contains(i.first); });
+        }
+
+        /* We can only upload a path after its references, so give up
+           the paths that (transitively) depend on a path that is being
+           uploaded by somebody else. */
+        for (bool changed = true; changed;) {
+            changed = false;
+            std::erase_if(claimed, [&](auto & i) {
+                for (auto & ref : srcStore.queryPathInfo(i.first)->references)
+                    if (ref != i.first && remaining.contains(ref) && !claimed.contains(ref)) {
+                        changed = true;
+                        return true;
+                    }
+                return false;
+            });
+        }
+
+        if (!claimed.empty()) {
+            StorePathSet toCopy;
+            for (auto & [path, _] : claimed)
+                toCopy.insert(path);
+
+            copyPaths(srcStore, dstStore, toCopy, NoRepair, checkSigs, substitute);
+
+            /* Don't check the validity of the paths we've copied:
+               `copyPaths()` may have copied them to a different path
+               (see `computeStorePathForDst`). */
+            for (auto & [path, fd] : claimed) {
+                remaining.erase(path);
+                deleteLockFile(lockPathFor(path), fd.get());
+            }
+
+            continue;
+        }
+
+        /* Everything we still need is being uploaded by somebody
+           else (or has become valid in the meantime). Wait for one of
+           those uploads to finish (or fail). */
+        if (remaining.empty())
+            break;
+        assert(inFlight);
+        auto & waitFor = *inFlight;
+        {
+            Activity act(
+                *logger,
+                lvlTalkative,
+                actUnknown,
+                fmt("waiting for another process to copy '%s' to '%s'",
+                    srcStore.printStorePath(waitFor),
+                    dstStore.config.getHumanReadableURI()));
+            auto fd = openLockFile(lockPathFor(waitFor), true);
+            /* Poll rather than block, so that a process that hangs
+               while holding the lock can't stall us forever. */
+            auto deadline = std::chrono::steady_clock::now() + lockTimeout;
+            while (!lockFile(fd.get(), ltWrite, false)) {
+                if (std::chrono::steady_clock::now() >= deadline) {
+                    printError(
+                        "somebody is hogging the upload lock for '%s' on '%s', continuing...",
+                        srcStore.printStorePath(waitFor),
+                        dstStore.config.getHumanReadableURI());
+                    copyPaths(srcStore, dstStore, remaining, NoRepair, checkSigs, substitute);
+                    return;
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+                checkInterrupt();
+            }
+        }
+
+        removeValid(remaining);
+    }
+}
+
+} // namespace nix
@@ -1,4 +1,5 @@
 #include "nix/util/closure.hh"
+#include "nix/util/fmt.hh"
 #include <gtest/gtest.h>
 
 namespace nix {
@@ -47,4 +48,40 @@ TEST(closure, properlyHandlesDirectExceptions)
     ASSERT_EQ(callCount, 2);
 }
 
+TEST(closure, limitsConcurrency)
+{
+    /* A wide graph: the root has 100 children, each with 10 children. */
+    auto getEdges = [](const std::string & node) -> std::set<std::string> {
+        std::set<std::string> res;
+        if (node == "root")
+            for (int i = 0; i < 100; ++i)
+                res.insert(fmt("%d", i));
+        else if (node.find('.') == std::string::npos)
+            for (int i = 0; i < 10; ++i)
+                res.insert(fmt("%s.%d", node, i));
+        return res;
+    };
+
+    for (std::size_t maxConcurrent : {1, 7, 1000}) {
+        set<string> closure;
+        std::size_t inFlight = 0, maxInFlight = 0;
+        computeClosure<string>(
+            {"root"},
+            closure,
+            [&](const std::string & node) -> asio::awaitable<std::set<std::string>> {
+                maxInFlight = std::max(maxInFlight, ++inFlight);
+                /* Let the other coroutines run. */
+                co_await asio::post(co_await asio::this_coro::executor, asio::use_awaitable);
+                --inFlight;
+                co_return getEdges(node);
+            },
+            maxConcurrent);
+
+        ASSERT_EQ(closure.size(), 1 + 100 + 1000);
+        ASSERT_LE(maxInFlight, maxConcurrent);
+        if (maxConcurrent == 7)
+            ASSERT_EQ(maxInFlight, maxConcurrent);
+    }
+}
+
 } // namespace nix
@@ -119,6 +119,179 @@ TEST(compress, zstdExactFrameBoundary)
     ASSERT_EQ(frameSize, compressed.size());
 }
 
+/* ----------------------------------------------------------------------------
+ * seekable zstd
+ * --------------------------------------------------------------------------*/
+
+static std::string seekableZstdCompress(std::string_view in)
+{
+    StringSink sink;
+    auto compressionSink = makeSeekableZstdCompressionSink(sink);
+    (*compressionSink)(in);
+    compressionSink->finish();
+    return std::move(sink.s);
+}
+
+static std::string makeTestData(size_t size)
+{
+    std::string str(size, 'x');
+    for (size_t i = 0; i < str.size(); i += 997)
+        str[i] = 'a' + (i / 997) % 26;
+    return str;
+}
+
+TEST(seekableZstd, decompressesAsRegularZstd)
+{
+    auto str = makeTestData(3 * seekableZstdBytesPerFrame + 12345);
+    ASSERT_EQ(decompress("zstd", seekableZstdCompress(str)), str);
+}
+
+TEST(seekableZstd, readSeekTable)
+{
+    auto str = makeTestData(3 * seekableZstdBytesPerFrame + 12345);
+    auto compressed = seekableZstdCompress(str);
+
+    auto seekTable = ZstdSeekTable::read(compressed.size(), [&](uint64_t offset, uint64_t length) {
+        return compressed.substr(offset, length);
+    });
+    ASSERT_TRUE(seekTable);
+    ASSERT_EQ(seekTable->frames.size(), 4u);
+    ASSERT_EQ(seekTable->frames[3].decompressedOffset, 3 * seekableZstdBytesPerFrame);
+    ASSERT_EQ(seekTable->frames[3].decompressedSize, 12345u);
+    ASSERT_EQ(
+        ZSTD_findFrameCompressedSize(compressed.data(), compressed.size()), seekTable->frames[0].compressedSize);
+}
+
+TEST(seekableZstd, noSeekTable)
+{
+    auto compressed = compress(CompressionAlgo::zstd, makeTestData(100000));
+    auto seekTable = ZstdSeekTable::read(compressed.size(), [&](uint64_t offset, uint64_t length) {
+        return compressed.substr(offset, length);
+    });
+    ASSERT_FALSE(seekTable);
+}
+
+TEST(seekableZstd, randomAccess)
+{
+    auto str = makeTestData(3 * seekableZstdBytesPerFrame + 12345);
+    auto compressed = seekableZstdCompress(str);
+
+    size_t bytesRead = 0;
+    auto readRange = [&](uint64_t offset, uint64_t length) {
+        bytesRead += length;
+        return compressed.substr(offset, length);
+    };
+
+    auto seekTable = ZstdSeekTable::read(compressed.size(), readRange);
+    ASSERT_TRUE(seekTable);
+    auto getBytes = makeSeekableZstdReader(*seekTable, readRange);
+
+    auto read = [&](uint64_t offset, uint64_t length) {
+        StringSink sink;
+        getBytes(offset, length, sink);
+        return std::move(sink.s);
+    };
+
+    bytesRead = 0;
+    ASSERT_EQ(read(10, 100), str.substr(10, 100));
+    /* Only the first frame should have been fetched. */
+    ASSERT_EQ(bytesRead, seekTable->frames[0].compressedSize);
+
+    /* Same frame again: served from the last decompressed frame. */
+    bytesRead = 0;
+    ASSERT_EQ(read(5000, 1000), str.substr(5000, 1000));
+    ASSERT_EQ(bytesRead, 0u);
+
+    /* Across frame boundaries. */
+    auto offset = seekableZstdBytesPerFrame - 10;
+    ASSERT_EQ(read(offset, 2 * seekableZstdBytesPerFrame), str.substr(offset, 2 * seekableZstdBytesPerFrame));
+    ASSERT_EQ(read(str.size() - 20, 20), str.substr(str.size() - 20, 20));
+    ASSERT_EQ(read(0, str.size()), str);
+    ASSERT_EQ(read(str.size(), 0), "");
+
+    ASSERT_THROW(read(str.size() - 20, 21), CompressionError);
+}
+
+TEST(seekableZstd, failedFrameIsNotReused)
+{
+    auto str = makeTestData(3 * seekableZstdBytesPerFrame + 12345);
+    auto compressed = seekableZstdCompress(str);
+
+    bool corrupt = false;
+    auto readRange = [&](uint64_t offset, uint64_t length) {
+        auto s = compressed.substr(offset, length);
+        if (corrupt)
+            std::fill(s.begin(), s.end(), 'x');
+        return s;
+    };
+
+    auto seekTable = ZstdSeekTable::read(compressed.size(), readRange);
+    ASSERT_TRUE(seekTable);
+    auto getBytes = makeSeekableZstdReader(*seekTable, readRange);
+
+    auto read = [&](uint64_t offset, uint64_t length) {
+        StringSink sink;
+        getBytes(offset, length, sink);
+        return std::move(sink.s);
+    };
+
+    ASSERT_EQ(read(10, 100), str.substr(10, 100));
+
+    /* A frame that fails to decompress must not leave its partial
+       output behind as the cached first frame. */
+    corrupt = true;
+    ASSERT_THROW(read(seekableZstdBytesPerFrame + 10, 100), CompressionError);
+    corrupt = false;
+
+    ASSERT_EQ(read(10, 100), str.substr(10, 100));
+    ASSERT_EQ(read(seekableZstdBytesPerFrame + 10, 100), str.substr(seekableZstdBytesPerFrame + 10, 100));
+}
+
+TEST(seekableZstd, emptyInput)
+{
+    auto compressed = seekableZstdCompress("");
+    ASSERT_EQ(decompress("zstd", compressed), "");
+
+    auto seekTable = ZstdSeekTable::read(compressed.size(), [&](uint64_t offset, uint64_t length) {
+        return compressed.substr(offset, length);
+    });
+    ASSERT_TRUE(seekTable);
+    ASSERT_EQ(seekTable->frames.size(), 1u);
+    ASSERT_EQ(seekTable->frames[0].decompressedSize, 0u);
+}
+
+TEST(seekableZstd, trailer)
+{
+    auto str = makeTestData(2 * seekableZstdBytesPerFrame + 12345);
+
+    StringSink sink;
+    auto compressionSink = makeSeekableZstdCompressionSink(sink, false, -1, []() { return std::string("index"); });
+    (*compressionSink)(str);
+    compressionSink->finish();
+    auto & compressed = sink.s;
+
+    /* Regular decoders skip the trailer. */
+    ASSERT_EQ(decompress("zstd", compressed), str);
+
+    auto readRange = [&](uint64_t offset, uint64_t length) { return compressed.substr(offset, length); };
+    auto seekTable = ZstdSeekTable::read(compressed.size(), readRange);
+    ASSERT_TRUE(seekTable);
+    ASSERT_EQ(seekTable->frames.size(), 4u);
+
+    auto & trailer = seekTable->frames.back();
+    ASSERT_EQ(trailer.decompressedOffset, str.size());
+    ASSERT_EQ(trailer.decompressedSize, 0u);
+    ASSERT_EQ(
+        parseZstdSkippableFrame(readRange(trailer.compressedOffset, trailer.compressedSize)),
+        std::optional<std::string_view>("index"));
+    ASSERT_FALSE(parseZstdSkippableFrame(readRange(0, seekTable->frames[0].compressedSize)));
+
+    /* The trailer doesn't get in the way of random access. */
+    StringSink tail;
+    makeSeekableZstdReader(*seekTable, readRange)(str.size() - 100, 100, tail);
+    ASSERT_EQ(tail.s, str.substr(str.size() - 100));
+}
+
 TEST(decompress, decompressInvalidInputThrowsCompressionError)
 {
     auto method = "bzip2";
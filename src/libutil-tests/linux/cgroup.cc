@@ -0,0 +1,51 @@
+#include <gtest/gtest.h>
+
+#include "nix/util/cgroup.hh"
+#include "nix/util/file-system.hh"
+
+namespace nix {
+
+/* ----------------------------------------------------------------------------
+ * getPressureStats
+ * --------------------------------------------------------------------------*/
+
+TEST(getPressureStats, parsesSomeAndFull)
+{
+    auto tmpDir = createTempDir();
+    AutoDelete delTmpDir(tmpDir);
+
+    auto file = tmpDir / "memory.pressure";
+    writeFile(
+        file,
+        "some avg10=12.50 avg60=3.00 avg300=0.75 total=123456\n"
+        "full avg10=1.25 avg60=0.00 avg300=0.00 total=42\n");
+
+    auto stats = linux::getPressureStats(file);
+    ASSERT_TRUE(stats);
+    ASSERT_DOUBLE_EQ(stats->someAvg10, 12.5);
+    ASSERT_DOUBLE_EQ(stats->fullAvg10, 1.25);
+}
+
+TEST(getPressureStats, cpuHasNoFullLine)
+{
+    auto tmpDir = createTempDir();
+    AutoDelete delTmpDir(tmpDir);
+
+    auto file = tmpDir / "cpu.pressure";
+    writeFile(file, "some avg10=80.00 avg60=60.00 avg300=20.00 total=1\n");
+
+    auto stats = linux::getPressureStats(file);
+    ASSERT_TRUE(stats);
+    ASSERT_DOUBLE_EQ(stats->someAvg10, 80);
+    ASSERT_DOUBLE_EQ(stats->fullAvg10, 0);
+}
+
+TEST(getPressureStats, missingFile)
+{
+    auto tmpDir = createTempDir();
+    AutoDelete delTmpDir(tmpDir);
+
+    ASSERT_FALSE(linux::getPressureStats(tmpDir / "io.pressure"));
+}
+
+} // namespace nix
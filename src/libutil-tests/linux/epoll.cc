@@ -0,0 +1,109 @@
+#include <gtest/gtest.h>
+
+#include <set>
+
+#include <unistd.h>
+
+#include "nix/util/epoll.hh"
+#include "nix/util/file-descriptor.hh"
+
+namespace nix {
+
+using namespace std::chrono_literals;
+
+TEST(Epoll, timesOut)
+{
+    linux::Epoll epoll;
+    Pipe pipe;
+    pipe.create();
+    epoll.add(pipe.readSide.get(), 1);
+    ASSERT_TRUE(epoll.wait(0ms).empty());
+    ASSERT_TRUE(epoll.wait(10ms).empty());
+}
+
+TEST(Epoll, reportsReadableAndHungUp)
+{
+    linux::Epoll epoll;
+    Pipe a, b;
+    a.create();
+    b.create();
+    epoll.add(a.readSide.get(), 1);
+    epoll.add(b.readSide.get(), 2);
+
+    writeFull(a.writeSide.get(), "x");
+    ASSERT_EQ(epoll.wait(), (std::vector<uint64_t>{1}));
+
+    /* Level-triggered: still ready until drained. */
+    ASSERT_EQ(epoll.wait(0ms), (std::vector<uint64_t>{1}));
+    char c;
+    ASSERT_EQ(read(a.readSide.get(), &c, 1), 1);
+    ASSERT_TRUE(epoll.wait(0ms).empty());
+
+    b.writeSide.close();
+    ASSERT_EQ(epoll.wait(), (std::vector<uint64_t>{2}));
+
+    epoll.remove(b.readSide.get());
+    ASSERT_TRUE(epoll.wait(0ms).empty());
+}
+
+TEST(Epoll, removeIsIdempotent)
+{
+    linux::Epoll epoll;
+    Pipe pipe;
+    pipe.create();
+    epoll.add(pipe.readSide.get(), 1);
+    epoll.remove(pipe.readSide.get());
+    epoll.remove(pipe.readSide.get());
+    pipe.readSide.close();
+    epoll.remove(pipe.readSide.get());
+}
+
+/**
+ * Simulate a worker with many children that are mostly silent: each
+ * round, only a few of them produce output, and we should only be told
+ * about those.
+ */
+TEST(Epoll, manyMostlySilentChildren)
+{
+    const size_t nrChildren = 500;
+
+    linux::Epoll epoll;
+    std::vector<Pipe> children(nrChildren);
+    for (size_t i = 0; i < nrChildren; ++i) {
+        children[i].create();
+        epoll.add(children[i].readSide.get(), i);
+    }
+
+    for (size_t round = 0; round < 200; ++round) {
+        std::set<uint64_t> active{(round * 7) % nrChildren, (round * 13 + 1) % nrChildren};
+        for (auto i : active)
+            writeFull(children[i].writeSide.get(), "output\n");
+
+        std::set<uint64_t> ready;
+        while (ready.size() < active.size())
+            for (auto token : epoll.wait(1s)) {
+                ASSERT_TRUE(active.contains(token));
+                ready.insert(token);
+            }
+
+        for (auto i : active) {
+            char buf[64];
+            ASSERT_GT(read(children[i].readSide.get(), buf, sizeof(buf)), 0);
+        }
+        ASSERT_TRUE(epoll.wait(0ms).empty());
+    }
+
+    /* All children exit. */
+    for (auto & child : children)
+        child.writeSide.close();
+
+    std::set<uint64_t> done;
+    while (done.size() < nrChildren)
+        for (auto token : epoll.wait(1s)) {
+            epoll.remove(children[token].readSide.get());
+            done.insert(token);
+        }
+    ASSERT_TRUE(epoll.wait(0ms).empty());
+}
+
+} // namespace nix
@@ -35,6 +35,7 @@ mkMesonExecutable (finalAttrs: {
     ./.version
     ./meson.build
     ./unix/meson.build
+    ./linux/meson.build
     # ./meson.options
     (fileset.fileFilter (file: file.hasExt "cc") ./.)
     (fileset.fileFilter (file: file.hasExt "hh") ./.)
@@ -0,0 +1,105 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+
+#include "nix/util/timer-wheel.hh"
+
+namespace nix {
+
+using namespace std::chrono_literals;
+
+using Wheel = TimerWheel<int>;
+
+static Wheel::TimePoint t0 = Wheel::Clock::now();
+
+static std::vector<int> sorted(std::vector<int> v)
+{
+    std::sort(v.begin(), v.end());
+    return v;
+}
+
+TEST(TimerWheel, empty)
+{
+    Wheel wheel(1s, 8, t0);
+    ASSERT_TRUE(wheel.empty());
+    ASSERT_EQ(wheel.nextDeadline(), std::nullopt);
+    ASSERT_TRUE(wheel.expire(t0 + 100s).empty());
+}
+
+TEST(TimerWheel, neverExpiresEarly)
+{
+    Wheel wheel(1s, 8, t0);
+    wheel.schedule(t0 + 2500ms, 1);
+    wheel.schedule(t0 + 3s, 2);
+
+    ASSERT_EQ(wheel.nextDeadline(), t0 + 3s);
+    ASSERT_TRUE(wheel.expire(t0 + 2999ms).empty());
+    ASSERT_EQ(sorted(wheel.expire(t0 + 3s)), (std::vector<int>{1, 2}));
+    ASSERT_TRUE(wheel.empty());
+}
+
+TEST(TimerWheel, pastDeadlinesExpireNext)
+{
+    Wheel wheel(1s, 8, t0);
+    ASSERT_TRUE(wheel.expire(t0 + 5s).empty());
+
+    wheel.schedule(t0 + 1s, 1);
+    ASSERT_EQ(wheel.nextDeadline(), t0 + 6s);
+    ASSERT_EQ(wheel.expire(t0 + 6s), (std::vector<int>{1}));
+}
+
+TEST(TimerWheel, deadlinesBeyondOneRotation)
+{
+    Wheel wheel(1s, 8, t0);
+    wheel.schedule(t0 + 20s, 1);
+    wheel.schedule(t0 + 4s, 2);
+
+    ASSERT_EQ(wheel.nextDeadline(), t0 + 4s);
+    ASSERT_EQ(wheel.expire(t0 + 4s), (std::vector<int>{2}));
+
+    /* The remaining timer shares a slot with earlier ticks, so we're
+       woken up at the end of each rotation. */
+    ASSERT_EQ(wheel.nextDeadline(), t0 + 12s);
+    ASSERT_TRUE(wheel.expire(t0 + 12s).empty());
+    ASSERT_EQ(wheel.nextDeadline(), t0 + 20s);
+    ASSERT_TRUE(wheel.expire(t0 + 19s).empty());
+    ASSERT_EQ(wheel.expire(t0 + 20s), (std::vector<int>{1}));
+    ASSERT_TRUE(wheel.empty());
+}
+
+TEST(TimerWheel, expireSkipsOverManyRotations)
+{
+    Wheel wheel(1s, 8, t0);
+    for (int i = 0; i < 100; ++i)
+        wheel.schedule(t0 + std::chrono::seconds(i), i);
+    ASSERT_EQ(wheel.size(), 100u);
+
+    auto expired = sorted(wheel.expire(t0 + 1000s));
+    ASSERT_EQ(expired.size(), 100u);
+    for (int i = 0; i < 100; ++i)
+        ASSERT_EQ(expired[i], i);
+    ASSERT_TRUE(wheel.empty());
+}
+
+TEST(TimerWheel, manyTimers)
+{
+    Wheel wheel(1s, 512, t0);
+    for (int i = 0; i < 10000; ++i)
+        wheel.schedule(t0 + std::chrono::milliseconds(i * 97 % 600000), i);
+
+    size_t total = 0;
+    for (auto now = t0; !wheel.empty(); now += 7s) {
+        auto next = wheel.nextDeadline();
+        ASSERT_TRUE(next);
+        for (auto i : wheel.expire(now)) {
+            /* Never early, and at most one step late. */
+            auto deadline = t0 + std::chrono::milliseconds(i * 97 % 600000);
+            ASSERT_LE(deadline, now);
+            ASSERT_GT(deadline + 7s + 1s, now);
+            ++total;
+        }
+    }
+    ASSERT_EQ(total, 10000u);
+}
+
+} // namespace nix
@@ -3,13 +3,21 @@
 
 #include <strings.h> // for strcasecmp
 
+#ifdef __linux__
+#  include <linux/fs.h>
+#  include <sys/ioctl.h>
+#  include <unistd.h>
+#endif
+
 #include "nix/util/archive.hh"
 #include "nix/util/alignment.hh"
 #include "nix/util/config-global.hh"
 #include "nix/util/posix-source-accessor.hh"
 #include "nix/util/source-path.hh"
 #include "nix/util/file-system.hh"
+#include "nix/util/file-system-at.hh"
 #include "nix/util/signals.hh"
+#include "nix/util/thread-pool.hh"
 
 namespace nix {
 
@@ -278,6 +286,140 @@ void restorePath(const std::filesystem::path & path, Source & source, bool start
     parseDump(sink, source);
 }
 
+/**
+ * Copy the contents of `from` to `to`, preferring a reflink or an
+ * in-kernel copy over reading the data into userspace.
+ */
+static void copyFileContents(Descriptor from, Descriptor to, const std::filesystem::path & fromPath)
+{
+#ifdef __linux__
+    if (ioctl(to, FICLONE, from) == 0)
+        return;
+
+    while (true) {
+        auto n = copy_file_range(from, nullptr, to, nullptr, 1 << 30, 0);
+        if (n == 0)
+            return;
+        if (n == -1) {
+            if (errno == EINTR)
+                continue;
+            /* Not supported between these file systems; continue
+               below from the current file offsets. */
+            if (errno == EXDEV || errno == EINVAL || errno == EOPNOTSUPP || errno == ENOSYS)
+                break;
+            throw SysError("copying %s", PathFmt(fromPath));
+        }
+        checkInterrupt();
+    }
+#endif
+
+    FdSink sink(to);
+    drainFD(from, sink);
+    sink.flush();
+}
+
+void copyPathParallel(
+    const SourcePath & path, const std::filesystem::path & dstPath, PathFilter & filter, size_t nrThreads, bool startFsync)
+{
+    auto copySequentially = [&]() {
+        auto source = sinkToSource([&](Sink & sink) { path.dumpPath(sink, filter); });
+        restorePath(dstPath, *source, startFsync);
+    };
+
+    /* Restoring with the case hack may rename entries, so go through
+       the NAR serialisation to get exactly the same result. Likewise
+       for anything that isn't a directory in the local file system,
+       where there is nothing to parallelise. */
+    if (archiveSettings.useCaseHack || nrThreads == 1 || !path.getPhysicalPath()
+        || path.lstat().type != SourceAccessor::tDirectory)
+        return copySequentially();
+
+    struct RegularFile
+    {
+        std::filesystem::path from, to;
+        bool isExecutable;
+    };
+
+    std::vector<RegularFile> files;
+
+    /* Set if a file turns out not to be in the local file system
+       (e.g. because the accessor overlays other accessors), in which
+       case we start over sequentially. */
+    bool notPhysical = false;
+
+    /* Create the directories and symlinks on this thread, since
+       neither `filter` nor the accessor need to be thread-safe. */
+    [&](this const auto & walk, const CanonPath & from, const std::filesystem::path & to) -> void {
+        checkInterrupt();
+
+        if (notPhysical)
+            return;
+
+        auto st = path.accessor->lstat(from);
+
+        switch (st.type) {
+        case SourceAccessor::tDirectory:
+            if (!std::filesystem::create_directory(to))
+                throw Error("path %s already exists", PathFmt(to));
+            for (auto & [name, _] : path.accessor->readDirectory(from))
+                if (filter((from / name).abs()))
+                    walk(from / name, to / name);
+            break;
+
+        case SourceAccessor::tRegular: {
+            auto physicalPath = path.accessor->getPhysicalPath(from);
+            if (!physicalPath) {
+                notPhysical = true;
+                return;
+            }
+            files.push_back({std::move(*physicalPath), to, st.isExecutable});
+            break;
+        }
+
+        case SourceAccessor::tSymlink:
+            createSymlink(path.accessor->readLink(from), to);
+            break;
+
+        default:
+            throw Error("file '%s' has an unsupported type", path.accessor->showPath(from));
+        }
+    }(path.path, dstPath);
+
+    if (notPhysical) {
+        debug("'%s' is not entirely in the local file system, copying it sequentially", path);
+        deletePath(dstPath);
+        return copySequentially();
+    }
+
+    ThreadPool pool(nrThreads);
+
+    for (auto & file : files)
+        pool.enqueue([&file, startFsync]() {
+            auto fromFd = openFileReadonly(file.from, FinalSymlink::DontFollow);
+            if (!fromFd)
+                throw NativeSysError("opening file %s", PathFmt(file.from));
+
+            auto toFd = openNewFileForWrite(file.to, 0666, {});
+            if (!toFd)
+                throw NativeSysError("creating file %s", PathFmt(file.to));
+
+#ifndef _WIN32
+            if (file.isExecutable) {
+                auto st = nix::fstat(toFd.get());
+                if (fchmod(toFd.get(), st.st_mode | (S_IXUSR | S_IXGRP | S_IXOTH)) == -1)
+                    throw SysError("making %s executable", PathFmt(file.to));
+            }
+#endif
+
+            copyFileContents(fromFd.get(), toFd.get(), file.from);
+
+            if (startFsync)
+                toFd.startFsync();
+        });
+
+    pool.process();
+}
+
 void copyNAR(Source & source, Sink & sink)
 {
     // FIXME: if 'source' is the output of dumpPath() followed by EOF,
@@ -3,9 +3,12 @@
 #include "nix/util/tarfile.hh"
 #include "nix/util/logging.hh"
 #include "nix/util/current-process.hh"
+#include "nix/util/sync.hh"
+#include "nix/util/util.hh"
 
 #include <archive.h>
 #include <archive_entry.h>
+#include <algorithm>
 #include <cstdio>
 #include <cstring>
 
@@ -325,6 +328,8 @@ struct BrotliCompressionSink : ChunkedCompressionSink
     }
 };
 
+static std::string makeZstdSkippableFrame(std::string_view data);
+
 /**
  * Zstd compression that cuts a new frame every `bytesPerFrame` of
  * uncompressed input.  The result is a concatenation of independent
@@ -355,11 +360,34 @@ struct ZstdMultiFrameCompressionSink : CompressionSink
      */
     std::vector<char> inbuf;
     bool emittedAnyFrame = false;
-    static constexpr uint64_t bytesPerFrame = 16 * 1024 * 1024;
+    static constexpr uint64_t defaultBytesPerFrame = 16 * 1024 * 1024;
+    const uint64_t bytesPerFrame;
+
+    /**
+     * Whether to append a seek table (see `ZstdSeekTable`) after the
+     * last frame.
+     */
+    bool seekable;
+    std::vector<ZstdSeekTable::Frame> frames;
+    uint64_t compressedSize = 0, decompressedSize = 0;
 
-    ZstdMultiFrameCompressionSink(Sink & nextSink, bool parallel, int level)
+    /**
+     * Contents of a skippable frame to write before the seek table.
+     */
+    std::function<std::string()> trailer;
+
+    ZstdMultiFrameCompressionSink(
+        Sink & nextSink,
+        bool parallel,
+        int level,
+        bool seekable = false,
+        uint64_t bytesPerFrame = defaultBytesPerFrame,
+        std::function<std::string()> trailer = {})
         : nextSink(nextSink)
         , outbuf(ZSTD_CStreamOutSize())
+        , bytesPerFrame(bytesPerFrame)
+        , seekable(seekable)
+        , trailer(std::move(trailer))
     {
         inbuf.reserve(bytesPerFrame);
         cctx.reset(ZSTD_createCCtx());
@@ -402,6 +430,7 @@ struct ZstdMultiFrameCompressionSink : CompressionSink
         checkZstd(ZSTD_CCtx_reset(cctx.get(), ZSTD_reset_session_only));
         checkZstd(ZSTD_CCtx_setPledgedSrcSize(cctx.get(), inbuf.size()));
 
+        uint64_t frameSize = 0;
         ZSTD_inBuffer in = {inbuf.data(), inbuf.size(), 0};
         for (;;) {
             checkInterrupt();
@@ -410,9 +439,21 @@ struct ZstdMultiFrameCompressionSink : CompressionSink
             checkZstd(remaining);
             if (out.pos > 0)
                 nextSink({outbuf.data(), out.pos});
+            frameSize += out.pos;
             if (remaining == 0)
                 break;
         }
+
+        if (seekable)
+            frames.push_back({
+                .compressedOffset = compressedSize,
+                .decompressedOffset = decompressedSize,
+                .compressedSize = static_cast<uint32_t>(frameSize),
+                .decompressedSize = static_cast<uint32_t>(inbuf.size()),
+            });
+        compressedSize += frameSize;
+        decompressedSize += inbuf.size();
+
         inbuf.clear();
         emittedAnyFrame = true;
     }
@@ -440,9 +481,211 @@ struct ZstdMultiFrameCompressionSink : CompressionSink
            decoder chokes on round-tripped empty input). */
         if (!inbuf.empty() || !emittedAnyFrame)
             emitFrame();
+        if (seekable) {
+            if (trailer) {
+                auto frame = makeZstdSkippableFrame(trailer());
+                nextSink(frame);
+                frames.push_back({
+                    .compressedOffset = compressedSize,
+                    .decompressedOffset = decompressedSize,
+                    .compressedSize = static_cast<uint32_t>(frame.size()),
+                    .decompressedSize = 0,
+                });
+                compressedSize += frame.size();
+            }
+            nextSink(ZstdSeekTable{.frames = std::move(frames)}.serialise());
+        }
     }
 };
 
+/* See https://github.com/facebook/zstd/blob/dev/contrib/seekable_format/zstd_seekable_compression_format.md */
+static constexpr uint32_t zstdSkippableMagic = 0x184D2A5E;
+/* Skippable frames may use any magic number from 0x184D2A50 to
+   0x184D2A5F. The seek table uses the last one, so use the first one
+   for trailers. */
+static constexpr uint32_t zstdTrailerMagic = 0x184D2A50;
+static constexpr uint32_t zstdSeekableMagic = 0x8F92EAB1;
+static constexpr size_t zstdSeekTableFooterSize = 9;
+static constexpr uint8_t zstdSeekTableChecksumFlag = 0x80;
+
+static void appendLittleEndian32(std::string & s, uint32_t n)
+{
+    for (int i = 0; i < 4; ++i)
+        s.push_back(static_cast<char>((n >> (8 * i)) & 0xff));
+}
+
+static std::string makeZstdSkippableFrame(std::string_view data)
+{
+    std::string s;
+    appendLittleEndian32(s, zstdTrailerMagic);
+    appendLittleEndian32(s, data.size());
+    s.append(data);
+    return s;
+}
+
+std::optional<std::string_view> parseZstdSkippableFrame(std::string_view frame)
+{
+    if (frame.size() < 8)
+        return std::nullopt;
+    unsigned char header[8];
+    std::memcpy(header, frame.data(), sizeof(header));
+    if (readLittleEndian<uint32_t>(header) != zstdTrailerMagic
+        || readLittleEndian<uint32_t>(header + 4) != frame.size() - 8)
+        return std::nullopt;
+    return frame.substr(8);
+}
+
+std::string ZstdSeekTable::serialise() const
+{
+    std::string s;
+    appendLittleEndian32(s, zstdSkippableMagic);
+    appendLittleEndian32(s, frames.size() * 8 + zstdSeekTableFooterSize);
+    for (auto & frame : frames) {
+        appendLittleEndian32(s, frame.compressedSize);
+        appendLittleEndian32(s, frame.decompressedSize);
+    }
+    appendLittleEndian32(s, frames.size());
+    s.push_back(0); // Seek_Table_Descriptor: no checksums
+    appendLittleEndian32(s, zstdSeekableMagic);
+    return s;
+}
+
+std::optional<ZstdSeekTable>
+ZstdSeekTable::read(uint64_t fileSize, fun<std::string(uint64_t offset, uint64_t length)> readRange)
+{
+    if (fileSize < 8 + zstdSeekTableFooterSize)
+        return std::nullopt;
+
+    auto footer = readRange(fileSize - zstdSeekTableFooterSize, zstdSeekTableFooterSize);
+    if (footer.size() != zstdSeekTableFooterSize)
+        throw CompressionError("short read of zstd seek table footer");
+    auto p = reinterpret_cast<unsigned char *>(footer.data());
+    if (readLittleEndian<uint32_t>(p + 5) != zstdSeekableMagic)
+        return std::nullopt;
+
+    uint64_t nrFrames = readLittleEndian<uint32_t>(p);
+    size_t entrySize = (p[4] & zstdSeekTableChecksumFlag) ? 12 : 8;
+    uint64_t tableSize = 8 + nrFrames * entrySize + zstdSeekTableFooterSize;
+    if (tableSize > fileSize)
+        throw CompressionError("zstd seek table is larger than the file");
+
+    auto table = readRange(fileSize - tableSize, tableSize - zstdSeekTableFooterSize);
+    if (table.size() != tableSize - zstdSeekTableFooterSize)
+        throw CompressionError("short read of zstd seek table");
+    p = reinterpret_cast<unsigned char *>(table.data());
+    if (readLittleEndian<uint32_t>(p) != zstdSkippableMagic
+        || readLittleEndian<uint32_t>(p + 4) != tableSize - 8)
+        throw CompressionError("invalid zstd seek table header");
+
+    ZstdSeekTable res;
+    res.frames.reserve(nrFrames);
+    uint64_t compressedOffset = 0, decompressedOffset = 0;
+    for (uint64_t i = 0; i < nrFrames; ++i) {
+        auto entry = p + 8 + i * entrySize;
+        ZstdSeekTable::Frame frame{
+            .compressedOffset = compressedOffset,
+            .decompressedOffset = decompressedOffset,
+            .compressedSize = readLittleEndian<uint32_t>(entry),
+            .decompressedSize = readLittleEndian<uint32_t>(entry + 4),
+        };
+        compressedOffset += frame.compressedSize;
+        decompressedOffset += frame.decompressedSize;
+        res.frames.push_back(frame);
+    }
+
+    if (compressedOffset + tableSize != fileSize)
+        throw CompressionError("zstd seek table does not match the file size");
+
+    return res;
+}
+
+fun<void(uint64_t, uint64_t, Sink &)>
+makeSeekableZstdReader(ZstdSeekTable seekTable, fun<std::string(uint64_t offset, uint64_t length)> readRange)
+{
+    struct State
+    {
+        ZstdSeekTable seekTable;
+        fun<std::string(uint64_t, uint64_t)> readRange;
+        std::unique_ptr<ZSTD_DCtx, decltype(&ZSTD_freeDCtx)> dctx{ZSTD_createDCtx(), ZSTD_freeDCtx};
+        /**
+         * The most recently decompressed frame, since consecutive
+         * small reads (e.g. of the files in a directory) tend to hit
+         * the same frame.
+         */
+        std::optional<size_t> lastFrame;
+        std::string lastFrameData;
+    };
+
+    auto state = std::make_shared<Sync<State>>(State{.seekTable = std::move(seekTable), .readRange = readRange});
+
+    return [state](uint64_t offset, uint64_t length, Sink & sink) {
+        auto st(state->lock());
+        auto & frames = st->seekTable.frames;
+
+        if (!st->dctx)
+            throw CompressionError("unable to initialise zstd decoder");
+
+        /* Find the first frame that contains `offset`. */
+        auto first = std::upper_bound(
+            frames.begin(), frames.end(), offset, [](uint64_t offset, const ZstdSeekTable::Frame & frame) {
+                return offset < frame.decompressedOffset + frame.decompressedSize;
+            });
+
+        /* Find the frames that overlap the requested range, so their
+           compressed data can be fetched in one go. */
+        auto last = first;
+        while (last != frames.end() && last->decompressedOffset < offset + length)
+            ++last;
+
+        if (length > 0
+            && (first == frames.end()
+                || (last - 1)->decompressedOffset + (last - 1)->decompressedSize < offset + length))
+            throw CompressionError("read beyond the end of seekable zstd data");
+
+        std::string compressed;
+        size_t firstIndex = first - frames.begin();
+        bool haveFirst = st->lastFrame == firstIndex;
+        if (last - first > (haveFirst ? 1 : 0)) {
+            auto start = haveFirst ? first + 1 : first;
+            compressed = st->readRange(
+                start->compressedOffset,
+                (last - 1)->compressedOffset + (last - 1)->compressedSize - start->compressedOffset);
+        }
+
+        size_t pos = 0;
+        for (auto frame = first; frame != last; ++frame) {
+            checkInterrupt();
+            size_t index = frame - frames.begin();
+
+            if (st->lastFrame != index) {
+                if (pos + frame->compressedSize > compressed.size())
+                    throw CompressionError("short read of seekable zstd data");
+                /* `lastFrameData` is about to be overwritten, so don't
+                   reuse it if decompression fails. */
+                st->lastFrame = std::nullopt;
+                st->lastFrameData.resize(frame->decompressedSize);
+                auto n = ZSTD_decompressDCtx(
+                    st->dctx.get(),
+                    st->lastFrameData.data(),
+                    st->lastFrameData.size(),
+                    compressed.data() + pos,
+                    frame->compressedSize);
+                if (ZSTD_isError(n))
+                    throw CompressionError("zstd error: %s", ZSTD_getErrorName(n));
+                if (n != frame->decompressedSize)
+                    throw CompressionError("zstd frame does not match the seek table");
+                pos += frame->compressedSize;
+                st->lastFrame = index;
+            }
+
+            auto begin = std::max(offset, frame->decompressedOffset) - frame->decompressedOffset;
+            auto end = std::min(offset + length, frame->decompressedOffset + frame->decompressedSize)
+                       - frame->decompressedOffset;
+            sink(std::string_view(st->lastFrameData).substr(begin, end - begin));
+        }
+    };
+}
+
 ref<CompressionSink> makeCompressionSink(CompressionAlgo method, Sink & nextSink, const bool parallel, int level)
 {
     switch (method) {
@@ -461,6 +704,13 @@ ref<CompressionSink> makeCompressionSink(CompressionAlgo method, Sink & nextSink
     unreachable();
 }
 
+ref<CompressionSink>
+makeSeekableZstdCompressionSink(Sink & nextSink, const bool parallel, int level, std::function<std::string()> trailer)
+{
+    return make_ref<ZstdMultiFrameCompressionSink>(
+        nextSink, parallel, level, true, seekableZstdBytesPerFrame, std::move(trailer));
+}
+
 std::string compress(CompressionAlgo method, std::string_view in, const bool parallel, int level)
 {
     StringSource source(in);
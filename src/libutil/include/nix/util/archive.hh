@@ -7,6 +7,8 @@
 
 namespace nix {
 
+struct SourcePath;
+
 /**
  * dumpPath creates a Nix archive of the specified path.
  *
@@ -73,6 +75,24 @@ void parseDump(FileSystemObjectSink & sink, Source & source);
 
 void restorePath(const std::filesystem::path & path, Source & source, bool startFsync = false);
 
+/**
+ * Copy `path` to `dstPath`, with the same result as `restorePath()`
+ * applied to the output of `dumpPath()` with the same `filter`.
+ *
+ * If `path` is a directory in the local file system, regular files
+ * are copied on up to `nrThreads` threads (0 meaning the number of
+ * cores), using reflinks or `copy_file_range()` where the file
+ * systems support it. `filter` is only called from the calling
+ * thread. If some of its files aren't in the local file system, it
+ * is copied sequentially instead.
+ */
+void copyPathParallel(
+    const SourcePath & path,
+    const std::filesystem::path & dstPath,
+    PathFilter & filter = defaultPathFilter,
+    size_t nrThreads = 0,
+    bool startFsync = false);
+
 /**
  * Read a NAR from 'source' and write it to 'sink'.
  */
@@ -17,6 +17,7 @@
 #include <boost/asio/bind_executor.hpp>
 #include <boost/asio/executor_work_guard.hpp>
 
+#include <algorithm>
 #include <queue>
 #include <set>
 
@@ -25,10 +26,27 @@ namespace nix {
 template<typename T>
 using GetEdgesAsync = fun<asio::awaitable<std::set<T>>(const T & elt)>;
 
+/**
+ * The default maximum number of `getEdges` calls that `computeClosure`
+ * runs concurrently.
+ */
+constexpr std::size_t defaultClosureConcurrency = 1024;
+
+/**
+ * Compute the closure of `startElts` under `getEdges`, adding it to
+ * `res`. At most `maxConcurrent` calls to `getEdges` are in flight at
+ * any time (but they are interleaved on a strand, not run in parallel).
+ */
 template<typename T, typename CompletionToken>
-auto computeClosure(std::set<T> startElts, std::set<T> & res, GetEdgesAsync<T> getEdges, CompletionToken token)
+auto computeClosure(
+    std::set<T> startElts,
+    std::set<T> & res,
+    GetEdgesAsync<T> getEdges,
+    std::size_t maxConcurrent,
+    CompletionToken token)
 {
-    auto initiator = [&res, startElts = std::move(startElts), getEdges = std::move(getEdges)](auto handler) {
+    auto initiator = [&res, startElts = std::move(startElts), getEdges = std::move(getEdges), maxConcurrent](
+                         auto handler) {
         auto executor = asio::make_strand(asio::get_associated_executor(handler));
 
         using Executor = decltype(executor);
@@ -56,7 +74,7 @@ auto computeClosure(std::set<T> startElts, std::set<T> & res, GetEdgesAsync<T> g
             /**
              * Maximum number of concurrent coroutines. Implements primitive rate limiting.
              */
-            std::size_t maxConcurrent = 1024;
+            std::size_t maxConcurrent;
             /**
              * Nodes to handle next.
              */
@@ -67,12 +85,18 @@ auto computeClosure(std::set<T> startElts, std::set<T> & res, GetEdgesAsync<T> g
              */
             std::exception_ptr error;
 
-            State(Executor executor_, GetEdgesAsync<T> getEdges, Handler handler, std::set<T> & res)
+            State(
+                Executor executor_,
+                GetEdgesAsync<T> getEdges,
+                Handler handler,
+                std::set<T> & res,
+                std::size_t maxConcurrent_)
                 : executor(executor_)
                 , getEdges(std::move(getEdges))
                 , handler(std::move(handler))
                 , res(res)
                 , workGuard(asio::make_work_guard(executor_))
+                , maxConcurrent(std::max<std::size_t>(maxConcurrent_, 1))
             {
             }
 
@@ -153,7 +177,7 @@ auto computeClosure(std::set<T> startElts, std::set<T> & res, GetEdgesAsync<T> g
             }
         };
 
-        auto state = make_ref<State>(executor, std::move(getEdges), std::move(handler), res);
+        auto state = make_ref<State>(executor, std::move(getEdges), std::move(handler), res, maxConcurrent);
         if (startElts.empty()) {
             /* No work to do. */
             state->complete(std::exception_ptr{});
@@ -167,7 +191,11 @@ auto computeClosure(std::set<T> startElts, std::set<T> & res, GetEdgesAsync<T> g
 }
 
 template<typename T>
-void computeClosure(std::set<T> startElts, std::set<T> & res, GetEdgesAsync<T> getEdges)
+void computeClosure(
+    std::set<T> startElts,
+    std::set<T> & res,
+    GetEdgesAsync<T> getEdges,
+    std::size_t maxConcurrent = defaultClosureConcurrency)
 {
     asio::io_context ctx;
     std::exception_ptr ex = nullptr;
@@ -175,6 +203,7 @@ void computeClosure(std::set<T> startElts, std::set<T> & res, GetEdgesAsync<T> g
         std::move(startElts),
         res,
         std::move(getEdges),
+        maxConcurrent,
         asio::bind_executor(ctx.get_executor(), [&](std::exception_ptr ex2) { ex = ex2; }));
     ctx.run();
     if (ex)
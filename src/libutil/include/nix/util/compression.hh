@@ -5,8 +5,12 @@
 #include "nix/util/types.hh"
 #include "nix/util/serialise.hh"
 #include "nix/util/compression-algo.hh"
+#include "nix/util/fun.hh"
 
+#include <functional>
+#include <optional>
 #include <string>
+#include <vector>
 
 namespace nix {
 
@@ -28,6 +32,77 @@ std::string compress(CompressionAlgo method, Source & in, const bool parallel =
 ref<CompressionSink>
 makeCompressionSink(CompressionAlgo method, Sink & nextSink, const bool parallel = false, int level = -1);
 
+/**
+ * The seek table of a zstd file in the [seekable
+ * format](https://github.com/facebook/zstd/blob/dev/contrib/seekable_format/zstd_seekable_compression_format.md).
+ * This is a skippable frame at the end of the file that records the
+ * size of every frame, allowing a reader to decompress only the
+ * frames that contain the bytes it needs. Decoders that don't know
+ * about it just skip it.
+ */
+struct ZstdSeekTable
+{
+    struct Frame
+    {
+        uint64_t compressedOffset;
+        uint64_t decompressedOffset;
+        uint32_t compressedSize;
+        uint32_t decompressedSize;
+    };
+
+    std::vector<Frame> frames;
+
+    /**
+     * Return the seek table as a skippable frame.
+     */
+    std::string serialise() const;
+
+    /**
+     * Read the seek table from the end of a file of size `fileSize`,
+     * using `readRange` to fetch bytes from it. Return `std::nullopt`
+     * if the file does not end in a seek table.
+     */
+    static std::optional<ZstdSeekTable>
+    read(uint64_t fileSize, fun<std::string(uint64_t offset, uint64_t length)> readRange);
+};
+
+/**
+ * Frame size used by `makeSeekableZstdCompressionSink()`. This is
+ * smaller than for regular zstd compression to make random access
+ * cheap, at a small cost in compression ratio.
+ */
+constexpr uint64_t seekableZstdBytesPerFrame = 1024 * 1024;
+
+/**
+ * Like `makeCompressionSink(CompressionAlgo::zstd, ...)`, but append
+ * a seek table to the output.
+ *
+ * If `trailer` is set, it is called after the last data frame has
+ * been written, and its result is stored in a skippable frame (see
+ * `parseZstdSkippableFrame()`) right before the seek table. That
+ * frame is listed in the seek table as decompressing to nothing. This
+ * allows storing an index over the data, since the frame boundaries
+ * are at multiples of `seekableZstdBytesPerFrame`.
+ */
+ref<CompressionSink> makeSeekableZstdCompressionSink(
+    Sink & nextSink, const bool parallel = false, int level = -1, std::function<std::string()> trailer = {});
+
+/**
+ * If `frame` is a zstd skippable frame written by
+ * `makeSeekableZstdCompressionSink()` for its `trailer`, return its
+ * contents.
+ */
+std::optional<std::string_view> parseZstdSkippableFrame(std::string_view frame);
+
+/**
+ * Return a function that writes the bytes `[offset, offset + length)`
+ * of the decompressed contents of a seekable zstd file to a sink. Only
+ * the frames overlapping that range are fetched (with a single call
+ * to `readRange`) and decompressed.
+ */
+fun<void(uint64_t, uint64_t, Sink &)>
+makeSeekableZstdReader(ZstdSeekTable seekTable, fun<std::string(uint64_t offset, uint64_t length)> readRange);
+
 MakeError(CompressionError, Error);
 
 } // namespace nix
@@ -6,8 +6,18 @@ namespace nix {
 
 struct MountedSourceAccessor : SourceAccessor
 {
+    /**
+     * Mount `accessor` on `mountPoint`, unless something is already
+     * mounted there.
+     */
     virtual void mount(CanonPath mountPoint, ref<SourceAccessor> accessor) = 0;
 
+    /**
+     * Mount `accessor` on `mountPoint`, replacing the accessor that is
+     * currently mounted there (if any).
+     */
+    virtual void remount(CanonPath mountPoint, ref<SourceAccessor> accessor) = 0;
+
     /**
      * Return the accessor mounted on `mountPoint`, or `nullptr` if
      * there is no such mount point.
@@ -50,6 +50,14 @@ GetNarBytes seekableGetNarBytes(const std::filesystem::path & path);
 
 GetNarBytes seekableGetNarBytes(Descriptor fd);
 
+/**
+ * A GetNarBytes function for an uncompressed NAR file that is
+ * memory-mapped rather than read, so reading a file from the NAR only
+ * touches the pages that contain it. Falls back to
+ * `seekableGetNarBytes()` where memory mapping is not available.
+ */
+GetNarBytes mmapGetNarBytes(const std::filesystem::path & path);
+
 /**
  * Creates a NAR accessor from a given listing and a `GetNarBytes` getter.
  */
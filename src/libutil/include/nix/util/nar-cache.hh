@@ -2,13 +2,13 @@
 
 #include "nix/util/fun.hh"
 #include "nix/util/hash.hh"
+#include "nix/util/lru-cache.hh"
 #include "nix/util/nar-accessor.hh"
 #include "nix/util/ref.hh"
 #include "nix/util/source-accessor.hh"
 
 #include <filesystem>
 #include <functional>
-#include <map>
 #include <optional>
 
 namespace nix {
@@ -24,16 +24,18 @@ class NarCache
     std::optional<std::filesystem::path> cacheDir;
 
     /**
-     * Map from NAR hash to NAR accessor.
+     * Map from NAR hash to NAR accessor. Bounded, since accessors
+     * that were populated in memory hold the entire NAR.
      */
-    std::map<Hash, ref<SourceAccessor>> nars;
+    LRUCache<Hash, ref<SourceAccessor>> nars;
 
 public:
 
     /**
-     * Create a NAR cache with an optional cache directory for disk storage.
+     * Create a NAR cache with an optional cache directory for disk
+     * storage, keeping at most `maxAccessors` accessors in memory.
      */
-    NarCache(std::optional<std::filesystem::path> cacheDir = {});
+    NarCache(std::optional<std::filesystem::path> cacheDir = {}, size_t maxAccessors = 32);
 
     /**
      * Lookup or create a NAR accessor, optionally using disk cache.
@@ -43,6 +45,14 @@ public:
      * @return The cached or newly created accessor
      */
     ref<SourceAccessor> getOrInsert(const Hash & narHash, fun<void(Sink &)> populate);
+
+    /**
+     * Like the above, but first try `open` to get an accessor that
+     * reads the NAR in place (e.g. from a local binary cache). If it
+     * returns null, the NAR is obtained via `populate`.
+     */
+    ref<SourceAccessor>
+    getOrInsert(const Hash & narHash, fun<std::shared_ptr<SourceAccessor>()> open, fun<void(Sink &)> populate);
 };
 
 } // namespace nix
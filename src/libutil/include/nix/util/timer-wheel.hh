@@ -0,0 +1,162 @@
+#pragma once
+///@file
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+namespace nix {
+
+/**
+ * A hashed timer wheel: a set of timers, each carrying a value of type
+ * `T`, kept in a ring of `nrSlots` buckets that each cover `resolution`
+ * of time. Scheduling a timer takes constant time, and expiring timers
+ * takes time proportional to the number of expired timers plus the
+ * number of slots passed (at most `nrSlots`), regardless of the number
+ * of pending timers.
+ *
+ * Timers never expire early, but may expire up to `resolution` late.
+ * There is no way to cancel a timer: users are expected to check
+ * whether an expired timer is still relevant (and possibly schedule it
+ * again).
+ */
+template<typename T>
+class TimerWheel
+{
+public:
+
+    using Clock = std::chrono::steady_clock;
+    using TimePoint = Clock::time_point;
+
+private:
+
+    struct Timer
+    {
+        /**
+         * The tick at (or after) which this timer expires.
+         */
+        int64_t tick;
+        T value;
+    };
+
+    TimePoint epoch;
+    Clock::duration resolution;
+    std::vector<std::vector<Timer>> slots;
+
+    /**
+     * The last tick processed by `expire()`.
+     */
+    int64_t current = 0;
+
+    size_t count = 0;
+
+    int64_t tickOf(TimePoint time, bool roundUp) const
+    {
+        auto d = time - epoch;
+        auto tick = d / resolution;
+        if (roundUp && d % resolution > Clock::duration::zero())
+            ++tick;
+        return tick;
+    }
+
+    TimePoint timeOf(int64_t tick) const
+    {
+        return epoch + tick * resolution;
+    }
+
+    std::vector<Timer> & slotOf(int64_t tick)
+    {
+        auto n = (int64_t) slots.size();
+        return slots[((tick % n) + n) % n];
+    }
+
+    const std::vector<Timer> & slotOf(int64_t tick) const
+    {
+        return const_cast<TimerWheel *>(this)->slotOf(tick);
+    }
+
+public:
+
+    TimerWheel(Clock::duration resolution = std::chrono::seconds(1), size_t nrSlots = 512, TimePoint now = Clock::now())
+        : epoch(now)
+        , resolution(resolution)
+        , slots(nrSlots)
+    {
+    }
+
+    /**
+     * Schedule a timer that expires at `deadline`.
+     */
+    void schedule(TimePoint deadline, T value)
+    {
+        auto tick = tickOf(deadline, true);
+        /* Timers that are already due go into the next slot to be
+           processed. */
+        slotOf(std::max(tick, current + 1)).push_back(Timer{.tick = tick, .value = std::move(value)});
+        ++count;
+    }
+
+    /**
+     * Remove and return the values of all timers that have expired
+     * at time `now`.
+     */
+    std::vector<T> expire(TimePoint now)
+    {
+        std::vector<T> expired;
+
+        auto nowTick = tickOf(now, false);
+        if (nowTick <= current)
+            return expired;
+
+        /* Visit every slot at most once. */
+        auto nrTicks = std::min<int64_t>(nowTick - current, slots.size());
+        for (int64_t tick = current + 1; tick <= current + nrTicks; ++tick) {
+            auto & slot = slotOf(tick);
+            std::erase_if(slot, [&](Timer & timer) {
+                if (timer.tick > nowTick)
+                    return false;
+                expired.push_back(std::move(timer.value));
+                return true;
+            });
+        }
+
+        count -= expired.size();
+        current = nowTick;
+
+        return expired;
+    }
+
+    /**
+     * Return the time at which `expire()` should be called next, or
+     * `std::nullopt` if there are no timers. This is the earliest
+     * deadline (rounded up to the resolution) if it is within one
+     * rotation of the wheel, and the end of the rotation otherwise.
+     */
+    std::optional<TimePoint> nextDeadline() const
+    {
+        if (count == 0)
+            return std::nullopt;
+
+        auto end = current + (int64_t) slots.size();
+        for (int64_t tick = current + 1; tick <= end; ++tick)
+            for (auto & timer : slotOf(tick))
+                if (timer.tick <= tick)
+                    return timeOf(tick);
+
+        return timeOf(end);
+    }
+
+    size_t size() const
+    {
+        return count;
+    }
+
+    bool empty() const
+    {
+        return count == 0;
+    }
+};
+
+} // namespace nix
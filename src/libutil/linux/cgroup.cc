@@ -73,9 +73,75 @@ CgroupStats getCgroupStats(const std::filesystem::path & cgroup)
         }
     }
 
+    auto memoryPeakPath = cgroup / "memory.peak";
+
+    if (pathExists(memoryPeakPath))
+        stats.memoryPeak = string2Int<uint64_t>(trim(readFile(memoryPeakPath)));
+
+    return stats;
+}
+
+std::optional<PressureStats> getPressureStats(const std::filesystem::path & file)
+{
+    if (!pathExists(file))
+        return std::nullopt;
+
+    /* The file may exist but be unreadable, e.g. with EOPNOTSUPP if
+       the kernel was booted with `psi=0`. */
+    std::string contents;
+    try {
+        contents = readFile(file);
+    } catch (SysError & e) {
+        debug("cannot read pressure stall information from %s: %s", PathFmt(file), e.msg());
+        return std::nullopt;
+    }
+
+    PressureStats stats;
+
+    /* The format is e.g.
+
+         some avg10=1.23 avg60=0.50 avg300=0.10 total=123456
+         full avg10=0.00 avg60=0.00 avg300=0.00 total=0
+     */
+    for (auto & line : tokenizeString<std::vector<std::string>>(contents, "\n")) {
+        auto fields = tokenizeString<std::vector<std::string>>(line, " ");
+        if (fields.size() < 2 || !hasPrefix(fields[1], "avg10="))
+            continue;
+        auto avg10 = string2Float<double>(fields[1].substr(6));
+        if (!avg10)
+            continue;
+        if (fields[0] == "some")
+            stats.someAvg10 = *avg10;
+        else if (fields[0] == "full")
+            stats.fullAvg10 = *avg10;
+    }
+
     return stats;
 }
 
+std::optional<uint64_t> getAvailableMemory()
+{
+    std::filesystem::path meminfoPath = "/proc/meminfo";
+
+    if (!pathExists(meminfoPath))
+        return std::nullopt;
+
+    for (auto & line : tokenizeString<std::vector<std::string>>(readFile(meminfoPath), "\n")) {
+        std::string_view prefix = "MemAvailable:";
+        if (!hasPrefix(line, prefix))
+            continue;
+        /* The value is in kibibytes, e.g. "MemAvailable:   1234 kB". */
+        auto fields = tokenizeString<std::vector<std::string>>(line.substr(prefix.size()), " ");
+        if (fields.empty())
+            return std::nullopt;
+        if (auto n = string2Int<uint64_t>(fields[0]))
+            return *n * 1024;
+        return std::nullopt;
+    }
+
+    return std::nullopt;
+}
+
 static CgroupStats destroyCgroup(const std::filesystem::path & cgroup, bool returnStats)
 {
     if (!pathExists(cgroup))
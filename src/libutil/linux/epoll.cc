@@ -0,0 +1,52 @@
+#include "nix/util/epoll.hh"
+#include "nix/util/error.hh"
+
+#include <algorithm>
+#include <climits>
+
+#include <sys/epoll.h>
+
+namespace nix::linux {
+
+Epoll::Epoll()
+    : epollFd(epoll_create1(EPOLL_CLOEXEC))
+{
+    if (!epollFd)
+        throw SysError("creating epoll instance");
+}
+
+void Epoll::add(Descriptor fd, uint64_t token)
+{
+    struct epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.u64 = token;
+    if (epoll_ctl(epollFd.get(), EPOLL_CTL_ADD, fd, &event) == -1)
+        throw SysError("adding file descriptor %d to epoll instance", fd);
+}
+
+void Epoll::remove(Descriptor fd)
+{
+    if (epoll_ctl(epollFd.get(), EPOLL_CTL_DEL, fd, nullptr) == -1 && errno != EBADF && errno != ENOENT)
+        throw SysError("removing file descriptor %d from epoll instance", fd);
+}
+
+std::vector<uint64_t> Epoll::wait(std::optional<std::chrono::milliseconds> timeout)
+{
+    struct epoll_event events[128];
+
+    int n = epoll_wait(
+        epollFd.get(), events, std::size(events), timeout ? (int) std::clamp<int64_t>(timeout->count(), 0, INT_MAX) : -1);
+    if (n == -1) {
+        if (errno == EINTR)
+            return {};
+        throw SysError("waiting for input");
+    }
+
+    std::vector<uint64_t> tokens;
+    tokens.reserve(n);
+    for (int i = 0; i < n; ++i)
+        tokens.push_back(events[i].data.u64);
+    return tokens;
+}
+
+} // namespace nix::linux
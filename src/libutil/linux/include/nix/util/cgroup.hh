@@ -17,6 +17,11 @@ StringMap getCgroups(const std::filesystem::path & cgroupFile);
 struct CgroupStats
 {
     std::optional<std::chrono::microseconds> cpuUser, cpuSystem;
+
+    /**
+     * The maximum memory usage of the cgroup in bytes (`memory.peak`).
+     */
+    std::optional<uint64_t> memoryPeak;
 };
 
 /**
@@ -32,6 +37,29 @@ CgroupStats getCgroupStats(const std::filesystem::path & cgroup);
  */
 CgroupStats destroyCgroup(const std::filesystem::path & cgroup);
 
+/**
+ * Pressure stall information, as found in `/proc/pressure/{cpu,memory,io}`
+ * and in the `*.pressure` files of a cgroup. The values are the
+ * percentage of wall time during the last 10 seconds in which some
+ * (or all) non-idle tasks were stalled on the resource.
+ */
+struct PressureStats
+{
+    double someAvg10 = 0, fullAvg10 = 0;
+};
+
+/**
+ * Parse a pressure stall information file, returning `std::nullopt`
+ * if it doesn't exist (e.g. because the kernel doesn't support PSI).
+ */
+std::optional<PressureStats> getPressureStats(const std::filesystem::path & file);
+
+/**
+ * Return the amount of memory available for starting new processes
+ * without swapping (`MemAvailable` in `/proc/meminfo`), in bytes.
+ */
+std::optional<uint64_t> getAvailableMemory();
+
 CanonPath getCurrentCgroup();
 
 /**
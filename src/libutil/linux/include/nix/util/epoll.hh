@@ -0,0 +1,53 @@
+#pragma once
+///@file
+
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+#include "nix/util/file-descriptor.hh"
+
+namespace nix::linux {
+
+/**
+ * A persistent set of file descriptors to wait for readability, using
+ * epoll(7). Unlike poll(2), the set is registered with the kernel once,
+ * so waiting costs time proportional to the number of ready file
+ * descriptors rather than the number of registered ones.
+ *
+ * Each file descriptor is registered with a caller-chosen token that
+ * is returned by `wait()` when the file descriptor is ready. Since a
+ * file descriptor that is closed is implicitly removed from the set,
+ * and its number may be reused, tokens should be unique so that
+ * callers can recognise events for registrations they've forgotten
+ * about.
+ */
+class Epoll
+{
+    AutoCloseFD epollFd;
+
+public:
+
+    Epoll();
+
+    /**
+     * Wait for `fd` to become readable (or hung up).
+     */
+    void add(Descriptor fd, uint64_t token);
+
+    /**
+     * Stop waiting for `fd`. It's not an error if `fd` has already
+     * been closed or isn't registered.
+     */
+    void remove(Descriptor fd);
+
+    /**
+     * Wait until at least one registered file descriptor is ready, or
+     * until `timeout` has passed (if set), or until interrupted by a
+     * signal. Return the tokens of the ready file descriptors.
+     */
+    std::vector<uint64_t> wait(std::optional<std::chrono::milliseconds> timeout = std::nullopt);
+};
+
+} // namespace nix::linux
@@ -89,6 +89,11 @@ struct MountedSourceAccessorImpl : MountedSourceAccessor
         mounts.emplace(std::move(mountPoint), std::move(accessor));
     }
 
+    void remount(CanonPath mountPoint, ref<SourceAccessor> accessor) override
+    {
+        mounts.insert_or_assign(std::move(mountPoint), std::move(accessor));
+    }
+
     std::shared_ptr<SourceAccessor> getMount(CanonPath mountPoint) override
     {
         if (auto res = getConcurrent(mounts, mountPoint))
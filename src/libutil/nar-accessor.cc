@@ -1,6 +1,13 @@
 #include "nix/util/nar-accessor.hh"
 #include "nix/util/file-descriptor.hh"
 #include "nix/util/error.hh"
+#include "nix/util/file-system.hh"
+#include "nix/util/file-system-at.hh"
+#include "nix/util/signals.hh"
+
+#ifndef _WIN32
+#  include <sys/mman.h>
+#endif
 
 namespace nix {
 
@@ -172,4 +179,50 @@ GetNarBytes seekableGetNarBytes(Descriptor fd)
     };
 }
 
+GetNarBytes mmapGetNarBytes(const std::filesystem::path & path)
+{
+#ifndef _WIN32
+    auto fd = openFileReadonly(path);
+    if (!fd)
+        throw NativeSysError("opening NAR file %s", PathFmt(path));
+
+    auto size = nix::fstat(fd.get()).st_size;
+    if (size == 0)
+        throw Error("NAR file %s is empty", PathFmt(path));
+
+    struct Mapping
+    {
+        const char * data;
+        size_t size;
+
+        ~Mapping()
+        {
+            munmap(const_cast<char *>(data), size);
+        }
+    };
+
+    auto p = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd.get(), 0);
+    if (p == MAP_FAILED)
+        throw SysError("memory-mapping NAR file %s", PathFmt(path));
+
+    auto mapping = std::make_shared<Mapping>(static_cast<const char *>(p), static_cast<size_t>(size));
+
+    return [mapping](uint64_t offset, uint64_t length, Sink & sink) {
+        if (offset > mapping->size || length > mapping->size - offset)
+            throw Error(
+                "reading invalid NAR bytes range: requested %1% bytes at offset %2%, but NAR has size %3%",
+                length,
+                offset,
+                mapping->size);
+        constexpr uint64_t chunkSize = 1 << 20;
+        for (uint64_t pos = 0; pos < length; pos += chunkSize) {
+            checkInterrupt();
+            sink({mapping->data + offset + pos, static_cast<size_t>(std::min(chunkSize, length - pos))});
+        }
+    };
+#else
+    return seekableGetNarBytes(path);
+#endif
+}
+
 } // namespace nix
@@ -8,24 +8,34 @@
 
 namespace nix {
 
-NarCache::NarCache(std::optional<std::filesystem::path> cacheDir_)
+NarCache::NarCache(std::optional<std::filesystem::path> cacheDir_, size_t maxAccessors)
     : cacheDir(std::move(cacheDir_))
+    , nars(maxAccessors)
 {
     if (cacheDir)
         createDirs(*cacheDir);
 }
 
 ref<SourceAccessor> NarCache::getOrInsert(const Hash & narHash, fun<void(Sink &)> populate)
+{
+    return getOrInsert(narHash, []() -> std::shared_ptr<SourceAccessor> { return nullptr; }, populate);
+}
+
+ref<SourceAccessor>
+NarCache::getOrInsert(const Hash & narHash, fun<std::shared_ptr<SourceAccessor>()> open, fun<void(Sink &)> populate)
 {
     // Check in-memory cache first
-    if (auto * accessor = get(nars, narHash))
+    if (auto * accessor = nars.getOrNullptr(narHash))
         return *accessor;
 
     auto cacheAccessor = [&](ref<SourceAccessor> accessor) {
-        nars.emplace(narHash, accessor);
+        nars.upsert(narHash, accessor);
         return accessor;
     };
 
+    if (auto accessor = open())
+        return cacheAccessor(ref(accessor));
+
     auto getNar = [&]() {
         StringSink sink;
         populate(sink);
@@ -47,7 +57,7 @@ ref<SourceAccessor> NarCache::getOrInsert(const Hash & narHash, fun<void(Sink &)
             try {
                 return cacheAccessor(makeLazyNarAccessor(
                     nlohmann::json::parse(nix::readFile(listingFile)).template get<NarListing>(),
-                    seekableGetNarBytes(cacheFile)));
+                    mmapGetNarBytes(cacheFile)));
             } catch (SystemError &) {
             }
 
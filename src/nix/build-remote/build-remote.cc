@@ -6,6 +6,8 @@
 #include <memory>
 #include <tuple>
 
+#include <fcntl.h>
+
 #ifdef __APPLE__
 #  include <sys/time.h>
 #endif
@@ -18,6 +20,7 @@
 #include "nix/util/serialise.hh"
 #include "nix/store/build-result.hh"
 #include "nix/store/store-open.hh"
+#include "nix/store/upload-coordinator.hh"
 #include "nix/util/strings.hh"
 #include "nix/store/derivations.hh"
 #include "nix/store/local-store.hh"
@@ -27,8 +30,6 @@
 
 namespace nix {
 
-static void handleAlarm(int sig) {}
-
 std::string escapeUri(std::string uri)
 {
     std::replace(uri.begin(), uri.end(), '/', '_');
@@ -50,6 +51,141 @@ static bool allSupportedLocally(Store & store, const StringSet & requiredFeature
     return true;
 }
 
+/**
+ * Open the store of a build machine.
+ */
+static ref<Store> openMachineStore(const Machine & m)
+{
+    auto storeRef = m.completeStoreReference();
+    if (auto * generic = std::get_if<StoreReference::Specified>(&storeRef.variant);
+        generic && (generic->scheme == "ssh" || generic->scheme == "ssh-ng"))
+        storeRef.params.try_emplace(
+            "control-persist", std::to_string(settings.getWorkerSettings().buildersControlPersist.get()));
+    return openStore(std::move(storeRef));
+}
+
+/**
+ * How long (in seconds) the results of validity queries against a
+ * build machine are reused to estimate the inputs it's missing.
+ */
+static constexpr time_t validPathsCacheTtl = 60;
+
+/**
+ * The file in which build hook processes share the paths that are
+ * known to be valid or invalid on `m`. The first line is the time at
+ * which the file was created; every other line is a hash part,
+ * prefixed by `+` (valid) or `-` (invalid).
+ */
+static std::filesystem::path validPathsCacheFile(const Machine & m)
+{
+    return currentLoad / "valid-paths"
+           / hashString(HashAlgorithm::SHA256, m.storeUri.render()).to_string(HashFormat::Nix32, false);
+}
+
+/**
+ * @return `std::nullopt` if there is no cache for `m`, or it has
+ * expired.
+ */
+static std::optional<std::map<std::string, bool>> readValidPathsCache(const Machine & m)
+{
+    auto file = validPathsCacheFile(m);
+    if (!pathExists(file))
+        return std::nullopt;
+
+    auto lines = tokenizeString<std::vector<std::string>>(readFile(file), "\n");
+    if (lines.empty())
+        return std::nullopt;
+    auto created = string2Int<time_t>(lines[0]);
+    if (!created || time(nullptr) - *created >= validPathsCacheTtl)
+        return std::nullopt;
+
+    std::map<std::string, bool> known;
+    for (size_t i = 1; i < lines.size(); ++i)
+        if (lines[i].size() > 1)
+            known.insert_or_assign(lines[i].substr(1), lines[i][0] == '+');
+    return known;
+}
+
+/**
+ * Record the validity of some paths on `m`. If `fresh`, start a new
+ * cache file, otherwise append to the existing one.
+ */
+static void writeValidPathsCache(const Machine & m, const StorePathSet & valid, const StorePathSet & invalid, bool fresh)
+{
+    std::string s;
+    for (auto & path : valid)
+        s += "+" + std::string(path.hashPart()) + "\n";
+    for (auto & path : invalid)
+        s += "-" + std::string(path.hashPart()) + "\n";
+
+    auto file = validPathsCacheFile(m);
+    if (fresh) {
+        createDirs(file.parent_path());
+        auto tmpFile = file;
+        tmpFile += fmt(".tmp-%d", getpid());
+        writeFile(tmpFile, fmt("%d\n", time(nullptr)) + s);
+        std::filesystem::rename(tmpFile, file);
+    } else {
+        AutoCloseFD fd = open(file.c_str(), O_WRONLY | O_APPEND | O_CLOEXEC);
+        if (fd)
+            writeFull(fd.get(), s);
+    }
+}
+
+/**
+ * Return the subset of `paths` that is valid on `m`, querying the
+ * machine only for paths that aren't in the cache.
+ */
+static StorePathSet queryValidPathsCached(const Machine & m, const StorePathSet & paths)
+{
+    auto known = readValidPathsCache(m);
+
+    StorePathSet valid, unknown;
+    for (auto & path : paths) {
+        if (known) {
+            if (auto i = known->find(std::string(path.hashPart())); i != known->end()) {
+                if (i->second)
+                    valid.insert(path);
+                continue;
+            }
+        }
+        unknown.insert(path);
+    }
+
+    if (!unknown.empty()) {
+        auto newlyValid = openMachineStore(m)->queryValidPaths(unknown);
+        StorePathSet invalid;
+        for (auto & path : unknown)
+            if (!newlyValid.contains(path))
+                invalid.insert(path);
+        writeValidPathsCache(m, newlyValid, invalid, !known);
+        valid.insert(newlyValid.begin(), newlyValid.end());
+    }
+
+    return valid;
+}
+
+/**
+ * Return the closure of the inputs of `drvPath`, i.e. what has to be
+ * copied to a machine that builds it.
+ */
+static StorePathSet getInputClosure(Store & store, const StorePath & drvPath)
+{
+    auto drv = store.readDerivation(drvPath);
+
+    StorePathSet inputs = drv.inputSrcs;
+    for (auto & [inputDrv, node] : drv.inputDrvs.map) {
+        auto outputs = store.queryPartialDerivationOutputMap(inputDrv);
+        for (auto & outputName : node.value)
+            if (auto i = get(outputs, outputName); i && *i)
+                inputs.insert(**i);
+    }
+
+    StorePathSet closure;
+    store.computeFSClosure(inputs, closure);
+    return closure;
+}
+
 static int main_build_remote(int argc, char ** argv)
 {
     {
@@ -120,6 +256,7 @@ static int main_build_remote(int argc, char ** argv)
 
         std::optional<StorePath> drvPath;
         std::string storeUri;
+        const Machine * acceptedMachine = nullptr;
 
         while (true) {
 
@@ -148,6 +285,35 @@ static int main_build_remote(int argc, char ** argv)
             /* Error ignored here, will be caught later */
             mkdir(currentLoad.c_str(), 0777);
 
+            auto suitable = [&](const Machine & m) {
+                return m.enabled && m.systemSupported(neededSystem) && m.allSupported(requiredFeatures)
+                       && m.mandatoryMet(requiredFeatures);
+            };
+
+            /* Estimate how much of the input closure each suitable
+               machine is missing. */
+            auto localityBytes = settings.getWorkerSettings().buildersLocalityBytes.get();
+            std::map<const Machine *, uint64_t> missingBytes;
+            if (localityBytes && std::ranges::count_if(machines, suitable) > 1) {
+                try {
+                    auto closure = getInputClosure(*store, *drvPath);
+                    for (auto & m : machines) {
+                        if (!suitable(m))
+                            continue;
+                        StorePathSet valid;
+                        try {
+                            valid = queryValidPathsCached(m, closure);
+                        } catch (Error & e) {
+                            debug("cannot query valid paths on '%s': %s", m.storeUri.render(), e.msg());
+                        }
+                        missingBytes[&m] = estimateMissingBytes(*store, closure, valid);
+                        debug("remote machine '%s' is missing %d bytes of inputs", m.storeUri.render(), missingBytes[&m]);
+                    }
+                } catch (Error & e) {
+                    debug("cannot determine the inputs of '%s': %s", store->printStorePath(*drvPath), e.msg());
+                }
+            }
+
             while (true) {
                 bestSlotLock = -1;
                 AutoCloseFD lock = openLockFile(currentLoad / "main-lock", true);
@@ -155,13 +321,13 @@ static int main_build_remote(int argc, char ** argv)
 
                 bool rightType = false;
 
-                Machine * bestMachine = nullptr;
-                uint64_t bestLoad = 0;
+                std::vector<MachineCandidate> candidates;
+                std::vector<Machine *> candidateMachines;
+                std::vector<AutoCloseFD> freeSlots;
                 for (auto & m : machines) {
                     debug("considering building on remote machine '%s'", m.storeUri.render());
 
-                    if (m.enabled && m.systemSupported(neededSystem) && m.allSupported(requiredFeatures)
-                        && m.mandatoryMet(requiredFeatures)) {
+                    if (suitable(m)) {
                         rightType = true;
                         AutoCloseFD free;
                         uint64_t load = 0;
@@ -178,28 +344,23 @@ static int main_build_remote(int argc, char ** argv)
                         if (!free) {
                             continue;
                         }
-                        bool best = false;
-                        if (!bestSlotLock) {
-                            best = true;
-                        } else if (load / m.speedFactor < bestLoad / bestMachine->speedFactor) {
-                            best = true;
-                        } else if (load / m.speedFactor == bestLoad / bestMachine->speedFactor) {
-                            if (m.speedFactor > bestMachine->speedFactor) {
-                                best = true;
-                            } else if (m.speedFactor == bestMachine->speedFactor) {
-                                if (load < bestLoad) {
-                                    best = true;
-                                }
-                            }
-                        }
-                        if (best) {
-                            bestLoad = load;
-                            bestSlotLock = std::move(free);
-                            bestMachine = &m;
-                        }
+                        auto missing = missingBytes.find(&m);
+                        candidates.push_back({
+                            .machine = &m,
+                            .load = load,
+                            .missingBytes = missing != missingBytes.end() ? missing->second : 0,
+                        });
+                        candidateMachines.push_back(&m);
+                        freeSlots.push_back(std::move(free));
                     }
                 }
 
+                Machine * bestMachine = nullptr;
+                if (auto best = chooseMachine(candidates, localityBytes)) {
+                    bestMachine = candidateMachines[*best];
+                    bestSlotLock = std::move(freeSlots[*best]);
+                }
+
                 if (!bestSlotLock) {
                     if (rightType && !canBuildLocally)
                         std::cerr << "# postpone\n";
@@ -250,7 +411,7 @@ static int main_build_remote(int argc, char ** argv)
 
                     Activity act(*logger, lvlTalkative, actUnknown, fmt("connecting to '%s'", storeUri));
 
-                    sshStore = bestMachine->openStore();
+                    sshStore = openMachineStore(*bestMachine);
                     sshStore->connect();
                 } catch (std::exception & e) {
                     auto msg = chomp(drainFD(5, {.block = false}));
@@ -259,6 +420,7 @@ static int main_build_remote(int argc, char ** argv)
                     continue;
                 }
 
+                acceptedMachine = bestMachine;
                 goto connected;
             }
         }
@@ -273,42 +435,23 @@ static int main_build_remote(int argc, char ** argv)
         auto inputs = readStrings<StringSet>(source);
         auto wantedOutputs = readStrings<StringSet>(source);
 
-        AutoCloseFD uploadLock;
-        {
-            auto setUpdateLock = [&](auto && fileName) {
-                uploadLock = openLockFile(currentLoad / (escapeUri(fileName) + ".upload-lock"), true);
-            };
-            try {
-                setUpdateLock(storeUri);
-            } catch (SystemError & e) {
-                if (!e.is(std::errc::filename_too_long))
-                    throw;
-                // Try again hashing the store URL so we have a shorter path
-                auto h = hashString(HashAlgorithm::MD5, storeUri);
-                setUpdateLock(h.to_string(HashFormat::Base64, false));
-            }
-        }
-
-        {
-            Activity act(*logger, lvlTalkative, actUnknown, fmt("waiting for the upload lock to '%s'", storeUri));
-
-            auto old = signal(SIGALRM, handleAlarm);
-            alarm(15 * 60);
-            if (!lockFile(uploadLock.get(), ltWrite, true))
-                printError("somebody is hogging the upload lock for '%s', continuing...");
-            alarm(0);
-            signal(SIGALRM, old);
-        }
-
         auto substitute = settings.getWorkerSettings().buildersUseSubstitutes ? Substitute : NoSubstitute;
 
         {
             Activity act(*logger, lvlTalkative, actUnknown, fmt("copying dependencies to '%s'", storeUri));
-            copyPaths(*store, *sshStore, store->parseStorePathSet(inputs), NoRepair, NoCheckSigs, substitute);
+            /* Coordinate with concurrent builds on the same machine,
+               so that paths needed by several of them are sent only
+               once. */
+            auto lockDir = currentLoad / "uploads"
+                           / hashString(HashAlgorithm::SHA256, storeUri).to_string(HashFormat::Nix32, false);
+            auto inputPaths = store->parseStorePathSet(inputs);
+            copyPathsCoordinated(*store, *sshStore, inputPaths, lockDir, NoCheckSigs, substitute);
+            /* Let the next build know that this machine now has these
+               paths. */
+            if (settings.getWorkerSettings().buildersLocalityBytes)
+                writeValidPathsCache(*acceptedMachine, inputPaths, {}, false);
         }
 
-        uploadLock = -1;
-
         auto drv = store->readDerivation(*drvPath);
 
         std::optional<BuildResult> optResult;
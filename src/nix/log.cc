@@ -7,6 +7,18 @@ namespace nix {
 
 struct CmdLog : InstallableCommand
 {
+    std::optional<size_t> tail;
+
+    CmdLog()
+    {
+        addFlag({
+            .longName = "tail",
+            .description = "Only show the last *n* lines of the log.",
+            .labels = {"n"},
+            .handler = {&tail},
+        });
+    }
+
     std::string description() override
     {
         return "show the build log of the specified packages or paths, if available";
@@ -40,7 +52,7 @@ struct CmdLog : InstallableCommand
         auto path = resolveDerivedPath(*store, *oneUp);
 
         RunPager pager;
-        auto log = fetchBuildLog(store, path, installable->what());
+        auto log = fetchBuildLog(store, path, installable->what(), tail);
         logger->stop();
         writeFull(getStandardOutput(), log);
     }
@@ -23,6 +23,7 @@
 #include "nix/expr/eval-inline.hh"
 #include "nix/expr/get-drvs.hh"
 #include "nix/cmd/common-eval-args.hh"
+#include "nix/fetchers/cache.hh"
 #include "nix/expr/attr-path.hh"
 #include "nix/cmd/legacy.hh"
 #include "nix/util/users.hh"
@@ -675,6 +676,9 @@ static void main_nix_build(int argc, char ** argv)
 
         restoreProcessContext();
 
+        if (auto cache = fetchSettings.getCacheIfOpen())
+            cache->flush();
+
         logger->stop();
 
         execvp(shell->c_str(), argPtrs.data());
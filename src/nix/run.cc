@@ -10,6 +10,8 @@
 #include "nix/expr/eval.hh"
 #include "nix/util/util.hh"
 #include "nix/store/globals.hh"
+#include "nix/cmd/common-eval-args.hh"
+#include "nix/fetchers/cache.hh"
 
 #include <filesystem>
 
@@ -43,6 +45,11 @@ void execProgramInStore(
     std::optional<std::string_view> system,
     std::optional<StringMap> env)
 {
+    /* The fetcher cache's destructor won't run after exec(), so write
+       its pending entries now. */
+    if (auto cache = fetchSettings.getCacheIfOpen())
+        cache->flush();
+
     logger->stop();
 
     char ** envp;
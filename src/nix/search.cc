@@ -25,6 +25,140 @@ std::string wrap(std::string prefix, std::string s)
     return concatStrings(prefix, s, ANSI_NORMAL);
 }
 
+/**
+ * Return strings that every match of the POSIX extended regular
+ * expression `re` must contain (ignoring case). This is conservative:
+ * e.g. for an alternation at the top level, nothing is returned.
+ */
+static std::vector<std::string> requiredLiterals(std::string_view re)
+{
+    std::vector<std::string> literals;
+    std::string literal;
+
+    auto flush = [&]() {
+        if (!literal.empty())
+            literals.push_back(std::move(literal));
+        literal.clear();
+    };
+
+    /* Return the position after the bracket expression starting at
+       `i`, or `std::nullopt` if we can't parse it. */
+    auto skipBracket = [&](size_t i) -> std::optional<size_t> {
+        i++;
+        if (i < re.size() && re[i] == '^')
+            i++;
+        if (i < re.size() && re[i] == ']')
+            i++;
+        while (i < re.size() && re[i] != ']') {
+            if (re[i] == '\\')
+                return std::nullopt;
+            if (re[i] == '[' && i + 1 < re.size() && (re[i + 1] == ':' || re[i + 1] == '=' || re[i + 1] == '.')) {
+                auto end = re.find(std::string{re[i + 1], ']'}, i + 2);
+                if (end == re.npos)
+                    return std::nullopt;
+                i = end + 2;
+            } else
+                i++;
+        }
+        if (i == re.size())
+            return std::nullopt;
+        return i + 1;
+    };
+
+    size_t i = 0;
+    while (i < re.size()) {
+        std::optional<char> c;
+
+        switch (re[i]) {
+        case '|':
+            return {};
+        case '(': {
+            size_t depth = 0;
+            do {
+                if (re[i] == '\\')
+                    i += 2;
+                else if (re[i] == '[') {
+                    auto end = skipBracket(i);
+                    if (!end)
+                        return {};
+                    i = *end;
+                } else {
+                    if (re[i] == '(')
+                        depth++;
+                    else if (re[i] == ')')
+                        depth--;
+                    i++;
+                }
+            } while (depth > 0 && i < re.size());
+            if (depth > 0)
+                return {};
+            break;
+        }
+        case '[': {
+            auto end = skipBracket(i);
+            if (!end)
+                return {};
+            i = *end;
+            break;
+        }
+        case '\\':
+            if (i + 1 == re.size() || std::string_view("^.[$()|*+?{\\").find(re[i + 1]) == std::string_view::npos)
+                return {};
+            c = re[i + 1];
+            i += 2;
+            break;
+        case '.':
+        case '^':
+        case '$':
+            i++;
+            break;
+        case '*':
+        case '+':
+        case '?':
+        case '{':
+            return {};
+        default:
+            /* Only ASCII characters are matched case-insensitively in
+               the same way as by the search index. */
+            if (re[i] & 0x80)
+                i++;
+            else
+                c = re[i++];
+        }
+
+        /* Handle the quantifiers applying to this atom. */
+        bool optional = false, repeated = false;
+        while (i < re.size()) {
+            if (re[i] == '*' || re[i] == '?') {
+                optional = true;
+                i++;
+            } else if (re[i] == '+') {
+                repeated = true;
+                i++;
+            } else if (re[i] == '{') {
+                auto end = re.find('}', i);
+                if (end == re.npos || i + 1 == end || !isdigit(re[i + 1]))
+                    return {};
+                auto min = re.substr(i + 1, end - i - 1);
+                if (min.substr(0, min.find(',')).find_first_not_of('0') == min.npos)
+                    optional = true;
+                repeated = true;
+                i = end + 1;
+            } else
+                break;
+        }
+
+        if (c && !optional)
+            literal.push_back(*c);
+        if (!c || optional || repeated)
+            flush();
+    }
+
+    flush();
+
+    return literals;
+}
+
 struct CmdSearch : InstallableValueCommand, MixJSON
 {
     std::vector<std::string> res;
@@ -89,6 +223,64 @@ struct CmdSearch : InstallableValueCommand, MixJSON
 
         uint64_t results = 0;
 
+        auto report = [&](const eval_cache::SearchIndexEntry & entry) {
+            std::vector<std::smatch> attrPathMatches;
+            std::vector<std::smatch> descriptionMatches;
+            std::vector<std::smatch> nameMatches;
+            bool found = false;
+
+            for (auto & regex : excludeRegexes) {
+                if (std::regex_search(entry.attrPath, regex) || std::regex_search(entry.pname, regex)
+                    || std::regex_search(entry.description, regex))
+                    return;
+            }
+
+            for (auto & regex : regexes) {
+                found = false;
+                auto addAll = [&found](std::sregex_iterator it, std::vector<std::smatch> & vec) {
+                    const auto end = std::sregex_iterator();
+                    while (it != end) {
+                        vec.push_back(*it++);
+                        found = true;
+                    }
+                };
+
+                addAll(std::sregex_iterator(entry.attrPath.begin(), entry.attrPath.end(), regex), attrPathMatches);
+                addAll(std::sregex_iterator(entry.pname.begin(), entry.pname.end(), regex), nameMatches);
+                addAll(
+                    std::sregex_iterator(entry.description.begin(), entry.description.end(), regex),
+                    descriptionMatches);
+
+                if (!found)
+                    break;
+            }
+
+            if (found) {
+                results++;
+                if (json) {
+                    (*jsonOut)[entry.attrPath] = {
+                        {"pname", entry.pname},
+                        {"version", entry.version},
+                        {"description", entry.description},
+                    };
+                } else {
+                    if (results > 1)
+                        logger->cout("");
+                    logger->cout(
+                        "* %s%s",
+                        wrap("\e[0;1m", hiliteMatches(entry.attrPath, attrPathMatches, ANSI_GREEN, "\e[0;1m")),
+                        optionalBracket(" (", entry.version, ")"));
+                    if (entry.description != "")
+                        logger->cout(
+                            "  %s", hiliteMatches(entry.description, descriptionMatches, ANSI_GREEN, ANSI_NORMAL));
+                }
+            }
+        };
+
+        /* The packages found while traversing the installable, to be
+           stored in the search index. */
+        std::vector<eval_cache::SearchIndexEntry> entries;
+
         std::function<void(eval_cache::AttrCursor & cursor, const AttrPath & attrPath, bool initialRecurse)> visit;
 
         visit = [&](eval_cache::AttrCursor & cursor, const AttrPath & attrPath, bool initialRecurse) {
@@ -114,55 +306,13 @@ struct CmdSearch : InstallableValueCommand, MixJSON
                     auto description = aDescription ? aDescription->getString() : "";
                     std::replace(description.begin(), description.end(), '\n', ' ');
 
-                    std::vector<std::smatch> attrPathMatches;
-                    std::vector<std::smatch> descriptionMatches;
-                    std::vector<std::smatch> nameMatches;
-                    bool found = false;
-
-                    for (auto & regex : excludeRegexes) {
-                        if (std::regex_search(attrPathStr, regex) || std::regex_search(name.name, regex)
-                            || std::regex_search(description, regex))
-                            return;
-                    }
-
-                    for (auto & regex : regexes) {
-                        found = false;
-                        auto addAll = [&found](std::sregex_iterator it, std::vector<std::smatch> & vec) {
-                            const auto end = std::sregex_iterator();
-                            while (it != end) {
-                                vec.push_back(*it++);
-                                found = true;
-                            }
-                        };
-
-                        addAll(std::sregex_iterator(attrPathStr.begin(), attrPathStr.end(), regex), attrPathMatches);
-                        addAll(std::sregex_iterator(name.name.begin(), name.name.end(), regex), nameMatches);
-                        addAll(std::sregex_iterator(description.begin(), description.end(), regex), descriptionMatches);
-
-                        if (!found)
-                            break;
-                    }
-
-                    if (found) {
-                        results++;
-                        if (json) {
-                            (*jsonOut)[attrPathStr] = {
-                                {"pname", name.name},
-                                {"version", name.version},
-                                {"description", description},
-                            };
-                        } else {
-                            if (results > 1)
-                                logger->cout("");
-                            logger->cout(
-                                "* %s%s",
-                                wrap("\e[0;1m", hiliteMatches(attrPathStr, attrPathMatches, ANSI_GREEN, "\e[0;1m")),
-                                optionalBracket(" (", name.version, ")"));
-                            if (description != "")
-                                logger->cout(
-                                    "  %s", hiliteMatches(description, descriptionMatches, ANSI_GREEN, ANSI_NORMAL));
-                        }
-                    }
+                    entries.push_back({
+                        .attrPath = attrPathStr,
+                        .pname = name.name,
+                        .version = name.version,
+                        .description = description,
+                    });
+                    report(entries.back());
                 }
 
                 else if (
@@ -185,8 +335,25 @@ struct CmdSearch : InstallableValueCommand, MixJSON
             }
         };
 
-        for (auto & cursor : installable->getCursors(*state))
+        /* The strings that every match must contain, used to look up
+           candidates in the search index. */
+        std::vector<std::string> literals;
+        for (auto & re : res)
+            for (auto & literal : requiredLiterals(re))
+                literals.push_back(literal);
+
+        for (auto & cursor : installable->getCursors(*state)) {
+            if (auto indexed = cursor->querySearchIndex(literals)) {
+                debug("using the search index for '%s'", cursor->getAttrPathStr());
+                for (auto & entry : *indexed)
+                    report(entry);
+                continue;
+            }
+
+            entries.clear();
             visit(*cursor, cursor->getAttrPath(), true);
+            cursor->putSearchIndex(entries);
+        }
 
         if (json)
             printJSON(*jsonOut);
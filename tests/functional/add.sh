@@ -70,6 +70,35 @@ test_add_symlink() {
 }
 test_add_symlink
 
+# Copying a directory in parallel gives the same result as going through a NAR
+test_parallel_ingest() {
+    local dir="$TEST_ROOT/ingest" serial parallel
+    mkdir -p "$dir/a/b" "$dir/empty"
+    for i in $(seq 1 50); do
+        echo "$i" > "$dir/a/file-$i"
+    done
+    head -c 1000000 /dev/urandom > "$dir/a/b/big"
+    touch "$dir/a/b/zero"
+    echo 'echo hi' > "$dir/a/script" && chmod +x "$dir/a/script"
+    ln -s a/script "$dir/link"
+
+    serial=$(nix-store --option ingest-threads 1 --add "$dir")
+    nix-store --delete "$serial"
+    parallel=$(nix-store --option ingest-threads 4 --add "$dir")
+    [[ "$serial" == "$parallel" ]]
+    nix-store --verify-path "$parallel"
+    [[ -x "$parallel/a/script" ]]
+    [[ "$(readlink "$parallel/link")" == a/script ]]
+
+    parallel=$(nix store add --option ingest-threads 4 --hash-algo sha1 --mode nar "$dir")
+    nix-store --delete "$parallel"
+    serial=$(nix store add --option ingest-threads 1 --hash-algo sha1 --mode nar "$dir")
+    [[ "$serial" == "$parallel" ]]
+
+    rm -r "$dir"
+}
+test_parallel_ingest
+
 #### New style commands
 
 clearStoreIfPossible
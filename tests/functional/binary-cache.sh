@@ -278,6 +278,37 @@ diff -u \
     <(jq -S < "$cacheDir/$(basename "$outPath" | cut -c1-32).ls") \
     <(echo '{"version":1,"root":{"type":"directory","entries":{"bar":{"type":"regular","size":4,"narOffset":232},"link":{"type":"symlink","target":"xyzzy"}}}}' | jq -S)
 
+# Uncompressed NARs with a listing are read in place, without
+# populating the local NAR cache.
+clearCache
+narCache=$TEST_ROOT/nar-cache
+rm -rf "$narCache"
+
+nix copy --to "file://$cacheDir?write-nar-listing=1&compression=none" "$outPath"
+
+[[ $(nix store cat --store "file://$cacheDir?local-nar-cache=$narCache" "$outPath/bar") = foo ]]
+[[ $(nix store ls --store "file://$cacheDir?local-nar-cache=$narCache" "$outPath") = $'bar\nlink' ]]
+(( $(find "$narCache" -type f | wc -l) == 0 ))
+
+# NARs with a zstd seek table are read via range requests, both from
+# the file system and over HTTP.
+clearCache
+rm -rf "$narCache"
+
+nix copy --to "file://$cacheDir?write-nar-listing=1&compression=zstd&seekable-compression=true" "$outPath"
+
+jq -e .seekable < "$cacheDir/$(basename "$outPath" | cut -c1-32).ls"
+
+for forceHttp in 0 1; do
+    [[ $(_NIX_FORCE_HTTP=$forceHttp nix store cat --store "file://$cacheDir?local-nar-cache=$narCache" "$outPath/bar") = foo ]]
+    [[ $(_NIX_FORCE_HTTP=$forceHttp nix store ls --store "file://$cacheDir?local-nar-cache=$narCache" "$outPath") = $'bar\nlink' ]]
+done
+(( $(find "$narCache" -type f | wc -l) == 0 ))
+
+# Decoders that don't know about the seek table skip it.
+nix store dump-path --store "file://$cacheDir" "$outPath" > "$TEST_ROOT/seekable.nar"
+[[ $(nix nar cat "$TEST_ROOT/seekable.nar" /bar) = foo ]]
+
 
 # Test debug info index generation.
 clearCache
@@ -0,0 +1,27 @@
+#!/usr/bin/env bash
+
+source common.sh
+
+statsFile="$TEST_ROOT/stats.json"
+
+evalWithStats() {
+    NIX_SHOW_STATS=1 NIX_SHOW_STATS_PATH="$statsFile" \
+        nix-instantiate --eval --expr 'builtins.length (builtins.genList (x: [ x ]) 200000)' >/dev/null
+}
+
+evalWithStats
+if [[ $(jq 'has("gc")' < "$statsFile") != true ]]; then
+    skipTest "Nix is built without the Boehm garbage collector"
+fi
+
+# With a small initial heap, we get some collections.
+NIX_CONFIG=$'gc-initial-heap-size = 1048576\ngc-free-space-divisor = 1\ngc-markers = 2' evalWithStats
+jq -e '.gc.initialHeapSize <= 8388608' < "$statsFile"
+jq -e '.gc.cycles > 0 and (.gc.collections | length) > 0' < "$statsFile"
+jq -e '.gc.heapGrowths > 0' < "$statsFile"
+jq -e '.gc.pauseMax > 0 and .gc.pauseTotal >= .gc.pauseMax' < "$statsFile"
+jq -e 'all(.gc.collections[]; .time >= 0 and .heapSize > 0)' < "$statsFile"
+
+# Incremental mode.
+NIX_CONFIG=$'gc-initial-heap-size = 1048576\ngc-incremental = true' evalWithStats
+jq -e '.time | has("gcNonIncremental")' < "$statsFile"
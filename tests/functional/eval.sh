@@ -90,3 +90,11 @@ out="$(expectStderr 0 nix eval --option foobar baz --expr '""' --raw)"
 # Test flag alias
 out="$(nix eval --expr '{}' --build-cores 1)"
 [[ "$(echo "$out" | wc -l)" = 1 ]]
+
+# Test the evaluation arena.
+arenaExpr='builtins.length (builtins.filter (s: s != "") (builtins.genList (i: toString i) 100000))'
+[[ "$(nix eval --option eval-arena true --expr "$arenaExpr")" = 100000 ]]
+# If the arena is too small, fall back to garbage collection or fail.
+[[ "$(nix eval --option eval-arena true --option eval-arena-size 4000000 --expr "$arenaExpr")" = 100000 ]]
+expectStderr 1 nix eval --option eval-arena true --option eval-arena-size 4000000 --option eval-arena-fallback false --expr "$arenaExpr" \
+  | grepQuiet "increase 'eval-arena-size'"
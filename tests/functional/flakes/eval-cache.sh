@@ -48,3 +48,138 @@ nix build --no-link "$flake1Dir#stack-depth"
 expect 1 nix build "$flake1Dir#ifd" --option allow-import-from-derivation false 2>&1 \
   | grepQuiet 'error: cannot build .* during evaluation because the option '\''allow-import-from-derivation'\'' is disabled'
 nix build --no-link "$flake1Dir#ifd"
+
+# With uncommitted changes, cached attributes stay valid as long as the
+# files they depend on haven't changed.
+flake2Dir="$TEST_ROOT/eval-cache-dirty-flake"
+
+createGitRepo "$flake2Dir" ""
+cp "${config_nix}" "$flake2Dir/"
+echo '"echo a > $out"' > "$flake2Dir/a.nix"
+echo '"echo b > $out"' > "$flake2Dir/b.nix"
+echo foo > "$flake2Dir/unrelated.txt"
+
+cat >"$flake2Dir/flake.nix" <<EOF
+{
+  outputs = { self }: let inherit (import ./config.nix) mkDerivation; in {
+    a = mkDerivation { name = "a"; buildCommand = import ./a.nix; };
+    b = mkDerivation { name = "b"; buildCommand = import ./b.nix; };
+    src = mkDerivation { name = "src"; buildCommand = "cp -r \${self} \$out"; };
+  };
+}
+EOF
+
+git -C "$flake2Dir" add flake.nix config.nix a.nix b.nix unrelated.txt
+git -C "$flake2Dir" commit -m "Init"
+nix flake lock "$flake2Dir"
+git -C "$flake2Dir" add flake.lock
+git -C "$flake2Dir" commit -m "Add lock file"
+
+echo bar > "$flake2Dir/unrelated.txt"
+
+nix build --no-link "$flake2Dir#a"
+nix build --no-link "$flake2Dir#b"
+nix build --no-link "$flake2Dir#src"
+
+# Changing a file that nothing has read doesn't invalidate anything,
+# except for attributes that depend on the store path of the tree.
+echo baz > "$flake2Dir/unrelated.txt"
+NIX_ALLOW_EVAL=0 nix build --no-link "$flake2Dir#a"
+NIX_ALLOW_EVAL=0 nix build --no-link "$flake2Dir#b"
+expect 1 env NIX_ALLOW_EVAL=0 nix build --no-link "$flake2Dir#src" 2>&1 | grepQuiet 'not everything is cached'
+
+# Changing b.nix invalidates b, but not a, which was computed before
+# b.nix was read.
+echo '"echo b2 > $out"' > "$flake2Dir/b.nix"
+NIX_ALLOW_EVAL=0 nix build --no-link "$flake2Dir#a"
+expect 1 env NIX_ALLOW_EVAL=0 nix build --no-link "$flake2Dir#b" 2>&1 | grepQuiet 'not everything is cached'
+[[ $(cat "$(nix build --no-link --print-out-paths "$flake2Dir#b")") = b2 ]]
+
+# The same applies to files in relative path inputs.
+flake4Dir="$TEST_ROOT/eval-cache-relative-input"
+
+createGitRepo "$flake4Dir" ""
+mkdir -p "$flake4Dir/sub"
+cp "${config_nix}" "$flake4Dir/"
+echo '"echo a > $out"' > "$flake4Dir/sub/a.nix"
+echo foo > "$flake4Dir/sub/unrelated.txt"
+
+cat >"$flake4Dir/sub/flake.nix" <<EOF
+{
+  outputs = { self }: { a = import ./a.nix; };
+}
+EOF
+
+cat >"$flake4Dir/flake.nix" <<EOF
+{
+  inputs.sub.url = "path:./sub";
+  outputs = { self, sub }: let inherit (import ./config.nix) mkDerivation; in {
+    a = mkDerivation { name = "a"; buildCommand = sub.a; };
+    src = mkDerivation { name = "src"; buildCommand = "cp -r \${sub} \$out"; };
+  };
+}
+EOF
+
+git -C "$flake4Dir" add flake.nix config.nix sub/flake.nix sub/a.nix sub/unrelated.txt
+git -C "$flake4Dir" commit -m "Init"
+nix flake lock "$flake4Dir"
+git -C "$flake4Dir" add flake.lock
+git -C "$flake4Dir" commit -m "Add lock file"
+
+echo bar > "$flake4Dir/sub/unrelated.txt"
+
+nix build --no-link "$flake4Dir#a"
+nix build --no-link "$flake4Dir#src"
+
+# The store path of the relative input depends on the entire tree.
+echo baz > "$flake4Dir/sub/unrelated.txt"
+NIX_ALLOW_EVAL=0 nix build --no-link "$flake4Dir#a"
+expect 1 env NIX_ALLOW_EVAL=0 nix build --no-link "$flake4Dir#src" 2>&1 | grepQuiet 'not everything is cached'
+
+echo '"echo a2 > $out"' > "$flake4Dir/sub/a.nix"
+expect 1 env NIX_ALLOW_EVAL=0 nix build --no-link "$flake4Dir#a" 2>&1 | grepQuiet 'not everything is cached'
+[[ $(cat "$(nix build --no-link --print-out-paths "$flake4Dir#a")") = a2 ]]
+
+# `nix search` stores a search index in the evaluation cache, which
+# is used by subsequent searches.
+flake3Dir="$TEST_ROOT/eval-cache-search-flake"
+
+createGitRepo "$flake3Dir" ""
+cp "${config_nix}" "$flake3Dir/"
+
+cat >"$flake3Dir/flake.nix" <<EOF
+{
+  outputs = { self }: let inherit (import ./config.nix) mkDerivation; in {
+    legacyPackages.$system = {
+      hello = mkDerivation { name = "hello-1.0"; buildCommand = ""; meta.description = "A friendly greeting"; };
+      firefox = mkDerivation { name = "firefox-2.0"; buildCommand = ""; meta.description = "Web browser"; };
+      broken = throw "broken";
+      nested = {
+        recurseForDerivations = true;
+        fire = mkDerivation { name = "fire-3.0"; buildCommand = ""; };
+      };
+    };
+  };
+}
+EOF
+
+git -C "$flake3Dir" add flake.nix config.nix
+git -C "$flake3Dir" commit -m "Init"
+nix flake lock "$flake3Dir"
+git -C "$flake3Dir" add flake.lock
+git -C "$flake3Dir" commit -m "Add lock file"
+
+[[ $(nix search --json "$flake3Dir" fire | jq -c 'keys') == "[\"legacyPackages.$system.firefox\",\"legacyPackages.$system.nested.fire\"]" ]]
+nix search --debug "$flake3Dir" fire 2>&1 | grepQuiet "using the search index"
+[[ $(NIX_ALLOW_EVAL=0 nix search --json "$flake3Dir" fire | jq -c 'keys') == "[\"legacyPackages.$system.firefox\",\"legacyPackages.$system.nested.fire\"]" ]]
+[[ $(nix search --json "$flake3Dir" 'FIREFOX|greet' | jq -c 'keys') == "[\"legacyPackages.$system.firefox\",\"legacyPackages.$system.hello\"]" ]]
+[[ $(nix search --json "$flake3Dir" 'fire(fox)?' -e 'web' | jq -c 'keys') == "[\"legacyPackages.$system.nested.fire\"]" ]]
+[[ $(nix search --json "$flake3Dir" ^ | jq -r ".\"legacyPackages.$system.hello\".version") = 1.0 ]]
+expect 1 nix search "$flake3Dir" nosuchpackage
+
+# With uncommitted changes, changing a file that the search index
+# depends on invalidates it.
+sed -i 's/Web browser/Web browser from Mozilla/' "$flake3Dir/flake.nix"
+[[ $(nix search --json "$flake3Dir" mozilla | jq -c 'keys') == "[\"legacyPackages.$system.firefox\"]" ]]
+sed -i 's/Web browser from Mozilla/Web browser by Mozilla/' "$flake3Dir/flake.nix"
+[[ $(nix search --json "$flake3Dir" 'by mozilla' | jq -c 'keys') == "[\"legacyPackages.$system.firefox\"]" ]]
@@ -0,0 +1,70 @@
+#!/usr/bin/env bash
+
+source ./common.sh
+
+requireGit
+
+# A flake with many git+file:// and path: inputs, some of which are
+# flakes with inputs of their own. Locking it with and without
+# concurrent fetching must produce the same lock file.
+
+rootDir=$TEST_ROOT/parallel-lock
+nrInputs=20
+
+inputsNix=
+for i in $(seq 1 "$nrInputs"); do
+    dep=$rootDir/dep$i
+    createGitRepo "$dep"
+    if (( i % 2 == 0 )); then
+        mkdir -p "$rootDir/leaf$i"
+        cat > "$rootDir/leaf$i/flake.nix" <<EOF
+{
+  outputs = { ... }: { value = "leaf$i"; };
+}
+EOF
+        cat > "$dep/flake.nix" <<EOF
+{
+  inputs.leaf.url = "path:$rootDir/leaf$i";
+  outputs = { leaf, ... }: { value = $i; };
+}
+EOF
+        inputsNix+="dep$i.url = \"git+file://$dep\";"$'\n'
+    else
+        echo "$i" > "$dep/data"
+        inputsNix+="dep$i = { url = \"git+file://$dep\"; flake = false; };"$'\n'
+    fi
+    git -C "$dep" add .
+    git -C "$dep" commit -m "Initial"
+done
+
+topDir=$rootDir/top
+createGitRepo "$topDir"
+cat > "$topDir/flake.nix" <<EOF
+{
+  inputs = {
+    $inputsNix
+  };
+  outputs = inputs: { nrInputs = builtins.length (builtins.attrNames inputs); };
+}
+EOF
+git -C "$topDir" add flake.nix
+
+# Print the wall time of each run, so the speedup can be inspected in
+# the test log.
+lockWith() {
+    local jobs=$1 start end
+    rm -f "$topDir/flake.lock" "$TEST_HOME/.cache/nix/fetcher-cache-v4.sqlite"*
+    start=$(date +%s%N)
+    nix flake lock --option lock-fetch-jobs "$jobs" "$topDir"
+    end=$(date +%s%N)
+    echo "lock-fetch-jobs=$jobs: $(( (end - start) / 1000000 )) ms" >&2
+}
+
+lockWith 1
+cp "$topDir/flake.lock" "$TEST_ROOT/serial.lock"
+
+lockWith 8
+diff "$TEST_ROOT/serial.lock" "$topDir/flake.lock"
+
+# `self` plus the inputs.
+[[ $(nix eval "$topDir#nrInputs") = $(( nrInputs + 1 )) ]]
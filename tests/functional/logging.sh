@@ -42,3 +42,25 @@ if [[ "$NIX_REMOTE" != "daemon" ]]; then
     grep '{"action":"start","fields":\[".*-dependencies-top.drv","",1,1\],"id":.*,"level":3,"parent":0' "$TEST_ROOT/log.json" >&2
     (( $(grep -c '{"action":"msg","level":5,"msg":"executing builder .*"}' "$TEST_ROOT/log.json" ) == 5 ))
 fi
+
+# Test `nix log --tail` on a compressed log that spans several zstd
+# frames, and reading logs compressed with bzip2 by older versions of
+# Nix.
+clearStore
+rm -rf "$NIX_LOG_DIR"
+outp="$(nix-build -E \
+    'with import '"${config_nix}"'; mkDerivation { name = "chatty"; buildCommand = "seq 1 500000; mkdir $out"; }' \
+    --no-out-link --compress-build-log)"
+logFile=$(find "$NIX_LOG_DIR/drvs" -name '*-chatty.drv.zst')
+[[ -n "$logFile" ]]
+nix log "$outp" > "$TEST_ROOT/chatty.log"
+(( $(wc -l < "$TEST_ROOT/chatty.log") >= 500000 ))
+[[ "$(nix log --tail 3 "$outp")" = "$(tail -n 3 "$TEST_ROOT/chatty.log")" ]]
+[[ "$(nix log --tail 200000 "$outp")" = "$(tail -n 200000 "$TEST_ROOT/chatty.log")" ]]
+
+if command -v bzip2 > /dev/null; then
+    bzip2 < "$TEST_ROOT/chatty.log" > "${logFile%.zst}.bz2"
+    rm "$logFile"
+    diff <(nix log "$outp") "$TEST_ROOT/chatty.log"
+    [[ "$(nix log --tail 3 "$outp")" = "$(tail -n 3 "$TEST_ROOT/chatty.log")" ]]
+fi
@@ -0,0 +1,27 @@
+#!/usr/bin/env bash
+
+source common.sh
+
+profileFile="$TEST_ROOT/memory.profile"
+
+profile() {
+    nix-instantiate --eval --strict \
+        --eval-profiler memory \
+        --eval-profile-file "$profileFile" \
+        "$@" >/dev/null
+}
+
+# With an interval of 0, every allocation is sampled with its exact size.
+profile --eval-profiler-memory-interval 0 --expr 'let f = n: builtins.genList (x: x) n; in f 1000'
+grepQuiet '^«string»:1:42:f;«string»:1:12:primop genList;allocate list 8000$' "$profileFile"
+grepQuiet '^«string»:1:42:f;«string»:1:12:primop genList;allocate value [0-9]*$' "$profileFile"
+
+# Allocations outside of any function call have no stack.
+profile --eval-profiler-memory-interval 0 --expr '"foobar" + "baz"'
+grepQuiet '^allocate string [0-9]*$' "$profileFile"
+
+# With sampling, the sizes still add up to about the amount of memory
+# allocated.
+profile --eval-profiler-memory-interval 1024 --expr 'builtins.length (builtins.genList (x: x) 100000)'
+total=$(awk '{ total += $NF } END { print total }' "$profileFile")
+[[ $total -ge 800000 ]]
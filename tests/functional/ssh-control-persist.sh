@@ -0,0 +1,68 @@
+#!/usr/bin/env bash
+
+source common.sh
+
+# Test that SSH master connections with `control-persist` are shared
+# between Nix processes. We don't have SSH here, so put a stand-in on
+# PATH that pretends to be a master when given `-M`, and otherwise runs
+# the remote command locally.
+
+fakeSshDir=$TEST_ROOT/fake-ssh
+sshLog=$TEST_ROOT/ssh.log
+mkdir -p "$fakeSshDir"
+rm -f "$sshLog"
+
+cat > "$fakeSshDir/ssh" <<EOF
+#!$SHELL
+echo "\$*" >> "$sshLog"
+socket=
+master=
+check=
+while [ \$# -gt 0 ]; do
+    case "\$1" in
+        -O) check=1; shift 2;;
+        -S) socket=\$2; shift 2;;
+        -E|-i) shift 2;;
+        -M) master=1; shift;;
+        --) shift; break;;
+        *) shift;;
+    esac
+done
+if [ -n "\$check" ]; then
+    [ -n "\$socket" ] && [ -e "\$socket" ]
+    exit
+fi
+if [ -n "\$master" ]; then
+    touch "\$socket"
+    echo started
+    exit 0
+fi
+# Like the \`LocalCommand\` that Nix passes.
+[ -n "\$socket" ] || echo started
+exec "\$@"
+EOF
+chmod +x "$fakeSshDir/ssh"
+
+export PATH=$fakeSshDir:$PATH
+
+remoteStore=$TEST_ROOT/remote-store
+store="ssh-ng://fakehost?remote-store=$remoteStore&control-persist=60"
+
+nix store info --store "$store"
+nix store info --store "$store"
+
+# Only the first process started a master; the second one reused it.
+[[ $(grep -c -- ' -M ' "$sshLog") = 1 ]]
+grepQuiet -- '-oControlPersist=60s' "$sshLog"
+socket=$(sed -n 's/.* -M -N -S \([^ ]*\).*/\1/p' "$sshLog")
+[[ $socket = "$TEST_HOME"/.cache/nix/ssh/* ]]
+[[ $(grep -c -- "-S $socket .*nix-daemon --stdio" "$sshLog") = 2 ]]
+
+# Different options mean a different master.
+NIX_SSHOPTS=-4 nix store info --store "$store"
+[[ $(grep -c -- ' -M ' "$sshLog") = 2 ]]
+
+# Without `control-persist`, a single connection doesn't use a master.
+rm -f "$sshLog"
+nix store info --store "ssh-ng://fakehost?remote-store=$remoteStore"
+grepQuietInverse -- ' -M ' "$sshLog"